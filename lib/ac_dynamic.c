@@ -0,0 +1,401 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ac_dynamic.h"
+#include "ac_utf8.h"
+
+/* Allocation step for dynamic::patterns array */
+#define REALLOC_CHUNK_PATTERNS 256
+
+
+/* Private Functions */
+AC_SNAPSHOT * ac_dynamic_copy        (STRING * patterns, unsigned long num,
+                                      unsigned long version);
+void          ac_dynamic_compile     (AC_DYNAMIC * thiz, AC_SNAPSHOT * snap);
+void          ac_dynamic_free        (AC_SNAPSHOT * snap);
+void          ac_dynamic_publish     (AC_DYNAMIC * thiz, AC_SNAPSHOT * snap);
+void *        ac_dynamic_builder     (void * param);
+
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_init
+
+DESCRIPTION:
+	Initialize an empty pattern set and start its builder thread.
+	'mc' and 'fold' are applied to every snapshot.
+******************************************************************************/
+void ac_dynamic_init (AC_DYNAMIC * thiz, MATCH_CALBACK mc, AC_FOLD fold)
+{
+	memset (thiz, 0, sizeof(AC_DYNAMIC));
+	thiz->match_callback = mc;
+	thiz->fold = fold;
+
+	pthread_mutex_init (&thiz->lock, NULL);
+	pthread_cond_init (&thiz->changed, NULL);
+	pthread_cond_init (&thiz->published, NULL);
+
+	/* Searches are possible (and find nothing) before the first commit */
+	thiz->current = ac_dynamic_copy (NULL, 0, 0);
+	ac_dynamic_compile (thiz, thiz->current);
+
+	pthread_create (&thiz->builder, NULL, ac_dynamic_builder, thiz);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_add_string
+
+RETURNS:
+	ACERR_NONE on success
+	ACERR_LONG_STRING, ACERR_ZERO_STRING, ACERR_PARTIAL_STRING as
+	ac_automata_add_string()
+
+DESCRIPTION:
+	Add a pattern to the pending set; the string is copied.
+	It is searched after the next ac_dynamic_commit() is built.
+	Duplicates are dropped while building the snapshot.
+******************************************************************************/
+AC_ERROR ac_dynamic_add_string (AC_DYNAMIC * thiz, STRING * str)
+{
+	STRING * copy;
+
+	if (!str->length)
+		return ACERR_ZERO_STRING;
+
+	if (str->length > AC_PATTRN_MAX_LENGTH)
+		return ACERR_LONG_STRING;
+
+	if (thiz->fold == AC_FOLD_UTF8 && !AC_UTF8_LEAD(str->str[0]))
+		return ACERR_PARTIAL_STRING;
+
+	pthread_mutex_lock (&thiz->lock);
+
+	if (thiz->patterns_num >= thiz->patterns_max)
+	{
+		thiz->patterns_max += REALLOC_CHUNK_PATTERNS;
+		thiz->patterns = (STRING *) realloc
+			(thiz->patterns, thiz->patterns_max*sizeof(STRING));
+	}
+
+	copy = &thiz->patterns[thiz->patterns_num++];
+	copy->str = (ALPHA *) malloc (str->length*sizeof(ALPHA));
+	memcpy (copy->str, str->str, str->length*sizeof(ALPHA));
+	copy->length = str->length;
+	copy->id = str->id;
+
+	pthread_mutex_unlock (&thiz->lock);
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_remove_string
+
+RETURNS:
+	Number of removed patterns
+
+DESCRIPTION:
+	Remove all pending patterns with the given id. Takes effect with the
+	next ac_dynamic_commit().
+******************************************************************************/
+int ac_dynamic_remove_string (AC_DYNAMIC * thiz, STRINGID id)
+{
+	unsigned long i;
+	int removed = 0;
+
+	pthread_mutex_lock (&thiz->lock);
+
+	for (i=0; i < thiz->patterns_num; )
+	{
+		if (thiz->patterns[i].id == id)
+		{
+			free (thiz->patterns[i].str);
+			thiz->patterns[i] = thiz->patterns[--thiz->patterns_num];
+			removed++;
+		}
+		else
+			i++;
+	}
+
+	pthread_mutex_unlock (&thiz->lock);
+
+	return removed;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_commit
+
+RETURNS:
+	The version which will include all changes made so far
+
+DESCRIPTION:
+	Ask the builder to publish the pending set. It returns immediately;
+	commits made while a build is running are batched into the next one.
+******************************************************************************/
+unsigned long ac_dynamic_commit (AC_DYNAMIC * thiz)
+{
+	unsigned long version;
+
+	pthread_mutex_lock (&thiz->lock);
+	version = ++thiz->committed;
+	pthread_cond_signal (&thiz->changed);
+	pthread_mutex_unlock (&thiz->lock);
+
+	return version;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_sync
+
+DESCRIPTION:
+	Wait until a snapshot of at least the given version is published.
+******************************************************************************/
+void ac_dynamic_sync (AC_DYNAMIC * thiz, unsigned long version)
+{
+	pthread_mutex_lock (&thiz->lock);
+	while (thiz->built < version)
+		pthread_cond_wait (&thiz->published, &thiz->lock);
+	pthread_mutex_unlock (&thiz->lock);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_enter
+
+PARAMS:
+	unsigned int * ticket: To be passed to ac_dynamic_leave()
+
+RETURNS:
+	The current snapshot. It stays valid until ac_dynamic_leave()
+
+DESCRIPTION:
+	Start a search. It never blocks: it only announces the reader in
+	the counter of the current epoch. Use a view of the snapshot's
+	automata to search (see ac_automata_view).
+******************************************************************************/
+AC_SNAPSHOT * ac_dynamic_enter (AC_DYNAMIC * thiz, unsigned int * ticket)
+{
+	unsigned long epoch;
+
+	for (;;)
+	{
+		epoch = __atomic_load_n (&thiz->epoch, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add (&thiz->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+
+		/* If the builder started a grace period meanwhile, it may not
+		   have seen us: register again in the new epoch */
+		if (__atomic_load_n (&thiz->epoch, __ATOMIC_SEQ_CST) == epoch)
+			break;
+
+		__atomic_fetch_sub (&thiz->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+	}
+
+	*ticket = epoch & 1;
+
+	return __atomic_load_n (&thiz->current, __ATOMIC_SEQ_CST);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_leave
+
+DESCRIPTION:
+	End of the search started by ac_dynamic_enter().
+******************************************************************************/
+void ac_dynamic_leave (AC_DYNAMIC * thiz, unsigned int ticket)
+{
+	__atomic_fetch_sub (&thiz->readers[ticket], 1, __ATOMIC_SEQ_CST);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_copy
+
+DESCRIPTION:
+	Create a snapshot holding its own copy of the given patterns, so that
+	it does not depend on later changes of the pending set.
+******************************************************************************/
+AC_SNAPSHOT * ac_dynamic_copy (STRING * patterns, unsigned long num,
+		unsigned long version)
+{
+	AC_SNAPSHOT * snap;
+	unsigned long i, size = 0;
+	ALPHA * p;
+
+	snap = (AC_SNAPSHOT *) malloc (sizeof(AC_SNAPSHOT));
+	snap->version = version;
+	snap->patterns_num = num;
+
+	for (i=0; i < num; i++)
+		size += patterns[i].length;
+
+	snap->patterns = (STRING *) malloc ((num ? num : 1)*sizeof(STRING));
+	snap->text = p = (ALPHA *) malloc ((size ? size : 1)*sizeof(ALPHA));
+
+	for (i=0; i < num; i++)
+	{
+		memcpy (p, patterns[i].str, patterns[i].length*sizeof(ALPHA));
+		snap->patterns[i].str = p;
+		snap->patterns[i].length = patterns[i].length;
+		snap->patterns[i].id = patterns[i].id;
+		p += patterns[i].length;
+	}
+
+	return snap;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_compile
+
+DESCRIPTION:
+	Build and locate the automata of the snapshot.
+******************************************************************************/
+void ac_dynamic_compile (AC_DYNAMIC * thiz, AC_SNAPSHOT * snap)
+{
+	unsigned long i;
+
+	ac_automata_init (&snap->automata, thiz->match_callback);
+	ac_automata_set_fold (&snap->automata, thiz->fold);
+
+	for (i=0; i < snap->patterns_num; i++)
+		ac_automata_add_string (&snap->automata, &snap->patterns[i]);
+
+	ac_automata_locate_failure (&snap->automata);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_free
+
+DESCRIPTION:
+	Release a snapshot which no reader can see any more.
+******************************************************************************/
+void ac_dynamic_free (AC_SNAPSHOT * snap)
+{
+	ac_automata_release (&snap->automata);
+	free (snap->patterns);
+	free (snap->text);
+	free (snap);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_publish
+
+DESCRIPTION:
+	Swap in the new snapshot, wait for a grace period and free the old one.
+	Readers that entered before the swap are registered in the counter of
+	the old epoch; the epoch is advanced after the swap, so readers of the
+	new epoch only see the new snapshot.
+******************************************************************************/
+void ac_dynamic_publish (AC_DYNAMIC * thiz, AC_SNAPSHOT * snap)
+{
+	AC_SNAPSHOT * old;
+	unsigned long epoch;
+
+	old = __atomic_exchange_n (&thiz->current, snap, __ATOMIC_SEQ_CST);
+	epoch = __atomic_fetch_add (&thiz->epoch, 1, __ATOMIC_SEQ_CST);
+
+	while (__atomic_load_n (&thiz->readers[epoch & 1], __ATOMIC_SEQ_CST))
+		sched_yield ();
+
+	ac_dynamic_free (old);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_builder
+
+DESCRIPTION:
+	Body of the builder thread: whenever there are new commits, build the
+	pending set into a snapshot and publish it.
+******************************************************************************/
+void * ac_dynamic_builder (void * param)
+{
+	AC_DYNAMIC * thiz = (AC_DYNAMIC *) param;
+	AC_SNAPSHOT * snap;
+	unsigned long version;
+
+	pthread_mutex_lock (&thiz->lock);
+
+	for (;;)
+	{
+		while (thiz->built == thiz->committed && !thiz->stop)
+			pthread_cond_wait (&thiz->changed, &thiz->lock);
+
+		if (thiz->stop)
+			break;
+
+		/* Take a copy of the pending set and build it outside of
+		   the lock, so that changes are not blocked meanwhile */
+		version = thiz->committed;
+		snap = ac_dynamic_copy (thiz->patterns, thiz->patterns_num, version);
+
+		pthread_mutex_unlock (&thiz->lock);
+		ac_dynamic_compile (thiz, snap);
+		ac_dynamic_publish (thiz, snap);
+		pthread_mutex_lock (&thiz->lock);
+
+		thiz->built = version;
+		pthread_cond_broadcast (&thiz->published);
+	}
+
+	pthread_mutex_unlock (&thiz->lock);
+
+	return NULL;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_dynamic_release
+
+DESCRIPTION:
+	Stop the builder and release all memories. No search may be running.
+******************************************************************************/
+void ac_dynamic_release (AC_DYNAMIC * thiz)
+{
+	unsigned long i;
+
+	pthread_mutex_lock (&thiz->lock);
+	thiz->stop = 1;
+	pthread_cond_signal (&thiz->changed);
+	pthread_mutex_unlock (&thiz->lock);
+
+	pthread_join (thiz->builder, NULL);
+
+	ac_dynamic_free (thiz->current);
+
+	for (i=0; i < thiz->patterns_num; i++)
+		free (thiz->patterns[i].str);
+	free (thiz->patterns);
+
+	pthread_mutex_destroy (&thiz->lock);
+	pthread_cond_destroy (&thiz->changed);
+	pthread_cond_destroy (&thiz->published);
+}
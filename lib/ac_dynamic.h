@@ -0,0 +1,83 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_DYNAMIC_H_
+#define _AC_DYNAMIC_H_
+
+#include <pthread.h>
+
+#include "aho_corasick.h"
+
+typedef struct
+/* An immutable, located automata built from the pattern set of one moment */
+{
+	AC_AUTOMATA automata; /* Search it through ac_automata_view() */
+	STRING * patterns; /* The patterns it was built from */
+	unsigned long patterns_num;
+	ALPHA * text; /* Storage of the pattern strings */
+	unsigned long version; /* Number of ac_dynamic_commit() it includes */
+} AC_SNAPSHOT;
+
+typedef struct
+/* A pattern set which may change while it is being searched.
+
+   Changes are collected by ac_dynamic_add_string() and
+   ac_dynamic_remove_string() and published by ac_dynamic_commit(): a
+   builder thread compiles the whole set into a new snapshot and swaps
+   it in with an atomic pointer store. Searches run on the snapshot they
+   entered with (ac_dynamic_enter .. ac_dynamic_leave) and never block;
+   an old snapshot is freed once every search that might use it has left.
+*/
+{
+	AC_SNAPSHOT * current; /* The published snapshot (atomic) */
+
+	/* Grace period tracking: a reader registers in readers[epoch & 1],
+	   the builder waits for the previous parity to drain before freeing */
+	unsigned long epoch;
+	unsigned long readers[2];
+
+	/* Pattern set with pending changes, protected by 'lock' */
+	pthread_mutex_t lock;
+	pthread_cond_t changed; /* Wakes up the builder */
+	pthread_cond_t published; /* Wakes up ac_dynamic_sync() */
+	STRING * patterns;
+	unsigned long patterns_num;
+	unsigned long patterns_max;
+	unsigned long committed; /* Number of commits */
+	unsigned long built; /* Version of the published snapshot */
+	int stop;
+
+	MATCH_CALBACK match_callback; /* Callback of all snapshots */
+	AC_FOLD fold; /* Case folding of all snapshots */
+	pthread_t builder;
+} AC_DYNAMIC;
+
+
+/* Public Functions */
+void          ac_dynamic_init           (AC_DYNAMIC * thiz, MATCH_CALBACK mc, AC_FOLD fold);
+AC_ERROR      ac_dynamic_add_string     (AC_DYNAMIC * thiz, STRING * str);
+int           ac_dynamic_remove_string  (AC_DYNAMIC * thiz, STRINGID id);
+unsigned long ac_dynamic_commit         (AC_DYNAMIC * thiz);
+void          ac_dynamic_sync           (AC_DYNAMIC * thiz, unsigned long version);
+AC_SNAPSHOT * ac_dynamic_enter          (AC_DYNAMIC * thiz, unsigned int * ticket);
+void          ac_dynamic_leave          (AC_DYNAMIC * thiz, unsigned int ticket);
+void          ac_dynamic_release        (AC_DYNAMIC * thiz);
+
+#endif
@@ -0,0 +1,434 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/* C++17 search engine
+
+   ac::engine builds its automata with the C library (so it gets the same
+   trie, failure nodes and case folding) and flattens it into arrays sized
+   by its template parameters:
+
+	Alpha        alpha type of patterns and input; one byte wide, like ALPHA
+	StateIndex   unsigned integer type of state numbers; the smaller, the
+	             smaller the tables (std::length_error if it is too small)
+	Transitions  ac::sparse_transitions: sorted edges and failure links,
+	             memory in proportion to the trie
+	             ac::dense_transitions: one row of 256 states per state,
+	             failure links resolved, one load per input alpha
+
+   The match sink is a template parameter of search(), so it is inlined in
+   the search loop. It is called as
+
+	sink (std::size_t position, const STRING * strings, std::size_t num)
+
+   with the same meaning as the fields of MATCH, and may return bool: true
+   stops the search. ac::callback_sink calls a MATCH_CALBACK; with it the
+   engine behaves like ac_automata_search().
+
+   Only the overlapping semantics without groups and boundary flags is
+   supported here; use the C API for those.
+*/
+
+#ifndef _AC_ENGINE_HPP_
+#define _AC_ENGINE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+extern "C" {
+#include "aho_corasick.h"
+}
+
+namespace ac {
+
+/* Transition policies */
+struct sparse_transitions {};
+struct dense_transitions {};
+
+
+/* Sink which reports matches to a MATCH_CALBACK, like the C API */
+struct callback_sink
+{
+	MATCH_CALBACK callback;
+	int automata_num;
+	int thread_num;
+
+	bool operator() (std::size_t position, const STRING * strings, std::size_t num) const
+	{
+		MATCH m;
+
+		m.matched_strings = const_cast<STRING *> (strings);
+		m.position = position;
+		m.match_num = num;
+		m.cp_position = 0;
+
+		return callback (&m, automata_num, thread_num) != 0;
+	}
+};
+
+
+template <typename Alpha = char, typename StateIndex = std::uint32_t,
+		typename Transitions = sparse_transitions>
+class engine
+{
+	static_assert (sizeof(Alpha) == sizeof(ALPHA),
+		"the trie of the C library is built of one byte alphas");
+	static_assert (std::is_unsigned<StateIndex>::value,
+		"StateIndex must be an unsigned integer type");
+
+public:
+	typedef Alpha alpha_type;
+	typedef StateIndex state_type;
+
+	/* Search state between chunks of one input */
+	struct cursor
+	{
+		StateIndex state = 0;
+		std::size_t base = 0; /* Position of the chunk in the input */
+	};
+
+	engine ()
+	{
+		ac_automata_init (&core, NULL);
+	}
+
+	~engine ()
+	{
+		ac_automata_release (&core);
+	}
+
+	engine (const engine &) = delete;
+	engine & operator= (const engine &) = delete;
+
+	/**************************************************************************
+	FUNCTION: engine::set_fold
+
+	DESCRIPTION:
+		See ac_automata_set_fold(); before the first add().
+	**************************************************************************/
+	AC_ERROR set_fold (AC_FOLD fold)
+	{
+		return ac_automata_set_fold (&core, fold);
+	}
+
+	/**************************************************************************
+	FUNCTION: engine::add
+
+	DESCRIPTION:
+		Add a copy of the pattern; returns as ac_automata_add_string().
+	**************************************************************************/
+	AC_ERROR add (const Alpha * pattern, std::size_t length, STRINGID id)
+	{
+		STRING s;
+		AC_ERROR err;
+
+		if (length > AC_PATTRN_MAX_LENGTH)
+			return ACERR_LONG_STRING;
+
+		storage.emplace_back (new ALPHA[length ? length : 1]);
+		std::copy (pattern, pattern + length, (Alpha *) storage.back ().get ());
+
+		s.str = storage.back ().get ();
+		s.length = length;
+		s.id = id;
+
+		if ((err = ac_automata_add_string (&core, &s)) != ACERR_NONE)
+			storage.pop_back ();
+
+		return err;
+	}
+
+	/**************************************************************************
+	FUNCTION: engine::compile
+
+	DESCRIPTION:
+		Locate failure nodes and build the tables. No add() after it.
+	**************************************************************************/
+	void compile ()
+	{
+		ac_automata_locate_failure (&core);
+
+		if (core.all_nodes_num - 1 > std::numeric_limits<StateIndex>::max ())
+			throw std::length_error ("ac::engine: too many states for StateIndex");
+
+		flatten (Transitions ());
+	}
+
+	/* Number of states */
+	std::size_t size () const
+	{
+		return core.all_nodes_num;
+	}
+
+	/* Size of the tables in bytes */
+	std::size_t memory () const
+	{
+		return fail.size () * sizeof(StateIndex) + begin.size () * sizeof(StateIndex) +
+			edge_alpha.size () + edge_next.size () * sizeof(StateIndex) +
+			table.size () * sizeof(StateIndex) +
+			out_begin.size () * sizeof(std::size_t) + out_ids.size () * sizeof(AC_INDEX);
+	}
+
+	/**************************************************************************
+	FUNCTION: engine::search
+
+	RETURNS:
+		true if the sink stopped the search
+
+	DESCRIPTION:
+		Search one chunk; the cursor carries the state to the next chunk
+		so matches crossing chunks are found, and positions are relative
+		to the whole input. The strings passed to the sink are built from
+		the pattern table, as the C API does, and are valid during the
+		call of the sink only.
+	**************************************************************************/
+	template <typename Sink>
+	bool search (cursor & c, const Alpha * text, std::size_t length, Sink && sink) const
+	{
+		StateIndex s = c.state;
+		std::size_t i, j, num;
+		std::vector<STRING> strings (max_outputs);
+		bool stop = false;
+
+		for (i = 0; i < length && !stop; i++)
+		{
+			s = next (s, (unsigned char) text[i], Transitions ());
+
+			if ((num = out_begin[s + 1] - out_begin[s]))
+			{
+				for (j = 0; j < num; j++)
+					strings[j] = core.patterns[out_ids[out_begin[s] + j]];
+				stop = deliver (sink, c.base + i + 1, strings.data (), num);
+			}
+		}
+
+		c.state = s;
+		c.base += i;
+
+		return stop;
+	}
+
+	/* Search a whole input */
+	template <typename Sink>
+	bool search (const Alpha * text, std::size_t length, Sink && sink) const
+	{
+		cursor c;
+		return search (c, text, length, sink);
+	}
+
+private:
+	AC_AUTOMATA core; /* Owns the trie and the matched strings */
+	std::vector<std::unique_ptr<ALPHA[]> > storage; /* Pattern copies */
+
+	/* Matched strings of state s are [out_begin[s], out_begin[s+1]) of
+	   out_ids, indices in the pattern table of 'core' */
+	std::vector<std::size_t> out_begin;
+	std::vector<AC_INDEX> out_ids;
+	std::size_t max_outputs = 0;
+
+	/* sparse_transitions: edges of state s are [begin[s], begin[s+1]) */
+	std::vector<StateIndex> fail;
+	std::vector<StateIndex> begin;
+	std::vector<unsigned char> edge_alpha;
+	std::vector<StateIndex> edge_next;
+
+	/* dense_transitions: table[s * 256 + alpha] */
+	std::vector<StateIndex> table;
+
+	template <typename Sink>
+	static bool deliver (Sink & sink, std::size_t position, const STRING * strings,
+			std::size_t num)
+	{
+		typedef decltype (sink (position, strings, num)) result;
+
+		if constexpr (std::is_convertible<result, bool>::value)
+			return sink (position, strings, num);
+		else
+		{
+			sink (position, strings, num);
+			return false;
+		}
+	}
+
+	/**************************************************************************
+	FUNCTION: engine::next (sparse)
+
+	DESCRIPTION:
+		Same transition as the C search loop: binary search of the edge,
+		following failure links until the root.
+	**************************************************************************/
+	StateIndex next (StateIndex s, unsigned char alpha, sparse_transitions) const
+	{
+		StateIndex lo, hi, mid;
+
+		for (;;)
+		{
+			lo = begin[s];
+			hi = begin[s + 1];
+
+			while (lo < hi)
+			{
+				mid = lo + ((hi - lo) >> 1);
+				if (edge_alpha[mid] < alpha)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			if (lo < begin[s + 1] && edge_alpha[lo] == alpha)
+				return edge_next[lo];
+
+			if (!s)
+				return 0;
+
+			s = fail[s];
+		}
+	}
+
+	StateIndex next (StateIndex s, unsigned char alpha, dense_transitions) const
+	{
+		return table[(std::size_t) s * 256 + alpha];
+	}
+
+	/**************************************************************************
+	FUNCTION: engine::flatten
+
+	DESCRIPTION:
+		Number states by NODE::id (the root is 0) and lay out the output
+		ranges by state, then build the tables of the transition policy.
+	**************************************************************************/
+	void flatten_outputs ()
+	{
+		AC_INDEX i;
+		NODE * node;
+
+		out_begin.assign (core.all_nodes_num + 1, 0);
+		out_ids.clear ();
+
+		for (i = 0; i < core.all_nodes_num; i++)
+		{
+			node = core.all_nodes[i];
+			out_begin[i] = out_ids.size ();
+			out_ids.insert (out_ids.end (), core.output_ids + node->outputs,
+				core.output_ids + node->outputs + node->outputs_num);
+			max_outputs = std::max (max_outputs, (std::size_t) node->outputs_num);
+		}
+		out_begin[core.all_nodes_num] = out_ids.size ();
+	}
+
+	void flatten (sparse_transitions)
+	{
+		AC_INDEX i, e, k = 0;
+		NODE * node;
+		std::size_t edges = 0;
+
+		flatten_outputs ();
+
+		for (i = 0; i < core.all_nodes_num; i++)
+			edges += core.all_nodes[i]->outgoing_degree;
+
+		if (edges > std::numeric_limits<StateIndex>::max ())
+			throw std::length_error ("ac::engine: too many edges for StateIndex");
+
+		fail.assign (core.all_nodes_num, 0);
+		begin.assign (core.all_nodes_num + 1, 0);
+		edge_alpha.resize (edges);
+		edge_next.resize (edges);
+
+		for (i = 0; i < core.all_nodes_num; i++)
+		{
+			node = core.all_nodes[i];
+			fail[i] = node->failure_node ? node->failure_node->id : 0;
+			begin[i] = k;
+
+			/* Edges are sorted by ALPHA, which may be signed */
+			for (e = 0; e < node->outgoing_degree; e++)
+				insert_edge (k, e, (unsigned char) node->outgoing[e].alpha,
+					node->outgoing[e].next->id);
+			k += node->outgoing_degree;
+		}
+		begin[core.all_nodes_num] = k;
+	}
+
+	/* Insertion sort by unsigned alpha of the e-th edge of a state */
+	void insert_edge (AC_INDEX first, AC_INDEX e, unsigned char alpha, AC_INDEX target)
+	{
+		AC_INDEX j = first + e;
+
+		while (j > first && edge_alpha[j - 1] > alpha)
+		{
+			edge_alpha[j] = edge_alpha[j - 1];
+			edge_next[j] = edge_next[j - 1];
+			j--;
+		}
+		edge_alpha[j] = alpha;
+		edge_next[j] = target;
+	}
+
+	void flatten (dense_transitions)
+	{
+		std::vector<NODE *> queue;
+		std::vector<bool> seen (core.all_nodes_num, false);
+		std::size_t head, a;
+		AC_COUNT e;
+		NODE * node, * next;
+		StateIndex * row;
+
+		flatten_outputs ();
+
+		table.assign ((std::size_t) core.all_nodes_num * 256, 0);
+
+		/* In BFS order the row of the failure node is complete before
+		   it is copied into the rows which fail to it */
+		queue.push_back (core.root);
+		seen[core.root->id] = true;
+
+		for (head = 0; head < queue.size (); head++)
+		{
+			node = queue[head];
+			row = &table[(std::size_t) node->id * 256];
+
+			if (node->failure_node)
+				for (a = 0; a < 256; a++)
+					row[a] = table[(std::size_t) node->failure_node->id * 256 + a];
+
+			for (e = 0; e < node->outgoing_degree; e++)
+			{
+				next = node->outgoing[e].next;
+				row[(unsigned char) node->outgoing[e].alpha] = next->id;
+
+				if (!seen[next->id])
+				{
+					seen[next->id] = true;
+					queue.push_back (next);
+				}
+			}
+		}
+	}
+};
+
+} /* namespace ac */
+
+#endif
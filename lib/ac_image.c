@@ -0,0 +1,720 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#define _GNU_SOURCE /* memfd_create */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ac_image.h"
+
+/* Arrays of an image start on this boundary */
+#define AC_IMAGE_ALIGN 8
+#define AC_IMAGE_ALIGNED(n) (((n) + AC_IMAGE_ALIGN - 1) & ~(unsigned long) (AC_IMAGE_ALIGN - 1))
+
+/* Nodes of up to this degree are searched linearly, others by bisection */
+#define AC_IMAGE_LINEAR 8
+
+/* Longest name of a published image, version included */
+#define AC_IMAGE_NAME_MAX 256
+
+/* Private Functions */
+int      ac_image_layout     (AC_AUTOMATA * thiz, AC_IMAGE * header);
+AC_ERROR ac_image_check      (const AC_IMAGE * image, unsigned long size);
+void     ac_image_version_name (char * buffer, const char * name, unsigned long version);
+AC_ERROR ac_image_open       (AC_IMAGE_MAP * map, const char * name, unsigned long version);
+int      ac_image_strings    (const AC_IMAGE * image, AC_IMAGE_CURSOR * c);
+
+
+
+/******************************************************************************
+FUNCTION: ac_image_layout
+
+DESCRIPTION:
+	Fill the counts, the offsets and the size of the image of the automata
+	in 'header'. Return 0 if the automata has no image: it is not located,
+	or it needs what images do not keep (boundaries, leftmost semantics).
+******************************************************************************/
+int ac_image_layout (AC_AUTOMATA * thiz, AC_IMAGE * header)
+{
+	unsigned long size, text = 0;
+	AC_INDEX i;
+
+	if (thiz->accept_strings || thiz->bounded ||
+		thiz->semantics != AC_SEMANTICS_OVERLAPPING || thiz->root->id != 0)
+		return 0;
+
+	memset (header, 0, sizeof(AC_IMAGE));
+	memcpy (header->magic, AC_IMAGE_MAGIC, sizeof(header->magic));
+	header->index_size = sizeof(AC_INDEX);
+	header->count_size = sizeof(AC_COUNT);
+
+	header->nodes_num = thiz->all_nodes_num;
+	header->outputs_num = thiz->outputs_num;
+	header->patterns_num = thiz->total_strings;
+
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		header->edges_num += thiz->all_nodes[i]->outgoing_degree;
+		if (thiz->all_nodes[i]->outputs_num > header->max_outputs)
+			header->max_outputs = thiz->all_nodes[i]->outputs_num;
+	}
+	for (i=0; i < thiz->total_strings; i++)
+		text += thiz->patterns[i].length;
+
+	size = AC_IMAGE_ALIGNED (sizeof(AC_IMAGE));
+	header->nodes = size;
+	size += AC_IMAGE_ALIGNED (header->nodes_num * sizeof(struct ac_image_node));
+	header->alphas = size;
+	size += AC_IMAGE_ALIGNED (header->edges_num * sizeof(ALPHA));
+	header->next = size;
+	size += AC_IMAGE_ALIGNED (header->edges_num * sizeof(AC_INDEX));
+	header->outputs = size;
+	size += AC_IMAGE_ALIGNED (header->outputs_num * sizeof(AC_INDEX));
+	header->patterns = size;
+	size += AC_IMAGE_ALIGNED (header->patterns_num * sizeof(struct ac_image_pattern));
+	header->size = size + text;
+
+	return 1;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_size
+
+DESCRIPTION:
+	Return the bytes of the image of the located automata, or 0 if it has
+	no image (see ac_image_write).
+******************************************************************************/
+unsigned long ac_image_size (AC_AUTOMATA * thiz)
+{
+	AC_IMAGE header;
+
+	return ac_image_layout (thiz, &header) ? header.size : 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_write
+
+PARAMS:
+	void * image: ac_image_size() bytes, aligned for unsigned long
+	unsigned long version: Stored in the image, 0 if not published
+
+DESCRIPTION:
+	Write the image of the located automata. Return ACERR_UNSUPPORTED if
+	it is not located, or has boundary flags, or leftmost semantics.
+	Groups are not kept: the image reports all strings.
+******************************************************************************/
+AC_ERROR ac_image_write (AC_AUTOMATA * thiz, void * image, unsigned long version)
+{
+	AC_IMAGE * header = (AC_IMAGE *) image;
+	struct ac_image_node * nodes;
+	struct ac_image_pattern * patterns;
+	ALPHA * alphas;
+	AC_INDEX * next, i, e = 0;
+	AC_COUNT j;
+	unsigned long text;
+	NODE * n;
+
+	if (!ac_image_layout (thiz, header))
+		return ACERR_UNSUPPORTED;
+	header->version = version;
+
+	nodes = (struct ac_image_node *) ((char *) image + header->nodes);
+	alphas = (ALPHA *) ((char *) image + header->alphas);
+	next = (AC_INDEX *) ((char *) image + header->next);
+	patterns = (struct ac_image_pattern *) ((char *) image + header->patterns);
+
+	/* Nodes keep their IDs, the root is node 0 */
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		n = thiz->all_nodes[i];
+
+		nodes[i].failure = n->failure_node ? n->failure_node->id : 0;
+		nodes[i].edges = e;
+		nodes[i].degree = n->outgoing_degree;
+		nodes[i].outputs = n->outputs;
+		nodes[i].outputs_num = n->outputs_num;
+
+		/* 'outgoing' is sorted by alpha */
+		for (j=0; j < n->outgoing_degree; j++, e++)
+		{
+			alphas[e] = n->outgoing[j].alpha;
+			next[e] = n->outgoing[j].next->id;
+		}
+	}
+
+	for (i=0; i < thiz->root->outgoing_degree; i++)
+		header->root[(unsigned char) thiz->root->outgoing[i].alpha] =
+			thiz->root->outgoing[i].next->id;
+
+	if (thiz->outputs_num)
+		memcpy ((char *) image + header->outputs, thiz->output_ids,
+			thiz->outputs_num * sizeof(AC_INDEX));
+
+	text = header->patterns +
+		AC_IMAGE_ALIGNED (header->patterns_num * sizeof(struct ac_image_pattern));
+	for (i=0; i < thiz->total_strings; i++)
+	{
+		patterns[i].str = text;
+		patterns[i].length = thiz->patterns[i].length;
+		patterns[i].id = thiz->patterns[i].id;
+		memcpy ((char *) image + text, thiz->patterns[i].str, thiz->patterns[i].length);
+		text += thiz->patterns[i].length;
+	}
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_check
+
+DESCRIPTION:
+	Validate the header of 'size' mapped bytes: an image of this build
+	(sizes of AC_INDEX and AC_COUNT) whose arrays are in the mapping.
+******************************************************************************/
+AC_ERROR ac_image_check (const AC_IMAGE * image, unsigned long size)
+{
+	if (size < sizeof(AC_IMAGE) ||
+		memcmp (image->magic, AC_IMAGE_MAGIC, sizeof(image->magic)) ||
+		image->index_size != sizeof(AC_INDEX) || image->count_size != sizeof(AC_COUNT) ||
+		image->size > size || image->patterns > image->size)
+		return ACERR_UNSUPPORTED;
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_memfd
+
+DESCRIPTION:
+	Write the image of the automata to a new memfd, sealed against writes
+	and resizing, and return it in 'fd'. Forked children inherit it; other
+	processes can receive it over a Unix domain socket (SCM_RIGHTS). Map it
+	with ac_image_map(). ACERR_SYSTEM leaves the cause in errno.
+******************************************************************************/
+AC_ERROR ac_image_memfd (AC_AUTOMATA * thiz, int * fd)
+{
+	unsigned long size = ac_image_size (thiz);
+	void * image;
+	int saved;
+
+	if (!size)
+		return ACERR_UNSUPPORTED;
+
+	if ((*fd = memfd_create ("ac_image", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+		return ACERR_SYSTEM;
+
+	if (ftruncate (*fd, size) ||
+		(image = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0)) == MAP_FAILED)
+		goto fail;
+
+	ac_image_write (thiz, image, 0);
+	munmap (image, size);
+
+	if (fcntl (*fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL))
+		goto fail;
+
+	return ACERR_NONE;
+
+fail:
+	saved = errno;
+	close (*fd);
+	errno = saved;
+	return ACERR_SYSTEM;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_map
+
+DESCRIPTION:
+	Map the image in 'fd' read-only. The fd may be closed afterwards.
+******************************************************************************/
+AC_ERROR ac_image_map (AC_IMAGE_MAP * map, int fd)
+{
+	struct stat st;
+	void * image;
+
+	memset (map, 0, sizeof(AC_IMAGE_MAP));
+
+	if (fstat (fd, &st) ||
+		(image = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		return ACERR_SYSTEM;
+
+	if (ac_image_check ((const AC_IMAGE *) image, st.st_size))
+	{
+		munmap (image, st.st_size);
+		return ACERR_UNSUPPORTED;
+	}
+
+	map->image = (const AC_IMAGE *) image;
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_version_name
+
+DESCRIPTION:
+	The shared memory name of a version of a published image.
+******************************************************************************/
+void ac_image_version_name (char * buffer, const char * name, unsigned long version)
+{
+	snprintf (buffer, AC_IMAGE_NAME_MAX, "%s.%lu", name, version);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_publish
+
+PARAMS:
+	const char * name: Shared memory name, as of shm_open(3): "/name"
+	unsigned long * version: The version published, may be NULL
+
+DESCRIPTION:
+	Publish the image of the automata under 'name' as a new version. The
+	name itself holds the current version; the image of version v is
+	"name.v". Publishers of one name are serialized by a lock on it. The
+	new image is complete before the name switches to it, then the former
+	one is unlinked: processes which mapped it keep it until they unmap it.
+******************************************************************************/
+AC_ERROR ac_image_publish (AC_AUTOMATA * thiz, const char * name, unsigned long * version)
+{
+	char image_name[AC_IMAGE_NAME_MAX];
+	unsigned long size = ac_image_size (thiz), * current = MAP_FAILED, v;
+	void * image;
+	int fd, ctl, saved;
+	AC_ERROR status = ACERR_SYSTEM;
+
+	if (!size)
+		return ACERR_UNSUPPORTED;
+	if (strlen (name) + 24 > AC_IMAGE_NAME_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return ACERR_SYSTEM;
+	}
+
+	if ((ctl = shm_open (name, O_RDWR | O_CREAT, 0600)) < 0)
+		return ACERR_SYSTEM;
+	if (flock (ctl, LOCK_EX) || ftruncate (ctl, sizeof(unsigned long)) ||
+		(current = (unsigned long *) mmap (NULL, sizeof(unsigned long),
+			PROT_READ | PROT_WRITE, MAP_SHARED, ctl, 0)) == MAP_FAILED)
+		goto done;
+
+	v = *current + 1;
+	ac_image_version_name (image_name, name, v);
+
+	/* A publisher which died before switching may have left it */
+	shm_unlink (image_name);
+	if ((fd = shm_open (image_name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+		goto done;
+	if (ftruncate (fd, size) ||
+		(image = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		saved = errno;
+		close (fd);
+		shm_unlink (image_name);
+		errno = saved;
+		goto done;
+	}
+	close (fd);
+
+	ac_image_write (thiz, image, v);
+	munmap (image, size);
+
+	__atomic_store_n (current, v, __ATOMIC_RELEASE);
+
+	if (v > 1)
+	{
+		ac_image_version_name (image_name, name, v - 1);
+		shm_unlink (image_name);
+	}
+
+	if (version)
+		*version = v;
+	status = ACERR_NONE;
+
+done:
+	saved = errno;
+	if (current != MAP_FAILED)
+		munmap (current, sizeof(unsigned long));
+	close (ctl); /* Releases the lock */
+	errno = saved;
+	return status;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_open
+
+DESCRIPTION:
+	Map the image of a version of a published name. ENOENT tells that it
+	is no longer (or not yet) there.
+******************************************************************************/
+AC_ERROR ac_image_open (AC_IMAGE_MAP * map, const char * name, unsigned long version)
+{
+	char image_name[AC_IMAGE_NAME_MAX];
+	AC_ERROR status;
+	int fd, saved;
+
+	ac_image_version_name (image_name, name, version);
+	if ((fd = shm_open (image_name, O_RDONLY, 0)) < 0)
+		return ACERR_SYSTEM;
+
+	status = ac_image_map (map, fd);
+	saved = errno;
+	close (fd);
+	errno = saved;
+
+	return status;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_attach
+
+DESCRIPTION:
+	Map the current version of the image published under 'name',
+	read-only. If a publisher replaces it meanwhile, the newer one is
+	mapped. Release it with ac_image_detach().
+******************************************************************************/
+AC_ERROR ac_image_attach (AC_IMAGE_MAP * map, const char * name)
+{
+	const unsigned long * current;
+	unsigned long v;
+	AC_ERROR status;
+	int ctl, saved;
+
+	memset (map, 0, sizeof(AC_IMAGE_MAP));
+
+	if (strlen (name) + 24 > AC_IMAGE_NAME_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return ACERR_SYSTEM;
+	}
+	if ((ctl = shm_open (name, O_RDONLY, 0)) < 0)
+		return ACERR_SYSTEM;
+	current = (const unsigned long *) mmap (NULL, sizeof(unsigned long), PROT_READ,
+		MAP_SHARED, ctl, 0);
+	saved = errno;
+	close (ctl);
+	errno = saved;
+	if (current == MAP_FAILED)
+		return ACERR_SYSTEM;
+
+	for (;;)
+	{
+		if (!(v = __atomic_load_n (current, __ATOMIC_ACQUIRE)))
+		{
+			errno = ENOENT;
+			status = ACERR_SYSTEM;
+			break;
+		}
+		status = ac_image_open (map, name, v);
+		if (status != ACERR_SYSTEM || errno != ENOENT ||
+			__atomic_load_n (current, __ATOMIC_ACQUIRE) == v)
+			break;
+	}
+
+	if (status)
+	{
+		saved = errno;
+		munmap ((void *) current, sizeof(unsigned long));
+		errno = saved;
+		return status;
+	}
+
+	map->name = strdup (name);
+	map->current = current;
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_refresh
+
+DESCRIPTION:
+	If a newer version was published under the name of the map, map it
+	and unmap the former one. Return 1 if it did: cursors on the map must
+	then be reset, their states are of the former image. Return 0 if the
+	map is current, or not of a published image, or if the newer version
+	can not be mapped (the former one stays).
+******************************************************************************/
+int ac_image_refresh (AC_IMAGE_MAP * map)
+{
+	AC_IMAGE_MAP fresh;
+	unsigned long v;
+
+	if (!map->current)
+		return 0;
+
+	while ((v = __atomic_load_n (map->current, __ATOMIC_ACQUIRE)) != map->image->version)
+	{
+		if (ac_image_open (&fresh, map->name, v) == ACERR_NONE)
+		{
+			munmap ((void *) map->image, map->image->size);
+			map->image = fresh.image;
+			return 1;
+		}
+		if (errno != ENOENT || __atomic_load_n (map->current, __ATOMIC_ACQUIRE) == v)
+			break;
+	}
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_detach
+
+DESCRIPTION:
+	Unmap the image, of ac_image_map() or ac_image_attach().
+******************************************************************************/
+void ac_image_detach (AC_IMAGE_MAP * map)
+{
+	if (map->image)
+		munmap ((void *) map->image, map->image->size);
+	if (map->current)
+		munmap ((void *) map->current, sizeof(unsigned long));
+	free ((char *) map->name);
+	memset (map, 0, sizeof(AC_IMAGE_MAP));
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_unlink
+
+DESCRIPTION:
+	Remove the name and its current image from shared memory. Mapped
+	images stay valid.
+******************************************************************************/
+void ac_image_unlink (const char * name)
+{
+	char image_name[AC_IMAGE_NAME_MAX];
+	unsigned long * current;
+	int ctl;
+
+	if (strlen (name) + 24 > AC_IMAGE_NAME_MAX ||
+		(ctl = shm_open (name, O_RDWR, 0)) < 0)
+		return;
+
+	flock (ctl, LOCK_EX);
+	current = (unsigned long *) mmap (NULL, sizeof(unsigned long), PROT_READ,
+		MAP_SHARED, ctl, 0);
+	if (current != MAP_FAILED)
+	{
+		ac_image_version_name (image_name, name, *current);
+		shm_unlink (image_name);
+		munmap (current, sizeof(unsigned long));
+	}
+	shm_unlink (name);
+	close (ctl);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_next
+
+DESCRIPTION:
+	The next node of a node of the image for an alpha, or 0 (the root,
+	which is no one's next node) if there is no edge.
+******************************************************************************/
+static inline AC_INDEX ac_image_next (const AC_IMAGE * image,
+		const struct ac_image_node * node, ALPHA alpha)
+{
+	const ALPHA * alphas = (const ALPHA *) ((const char *) image + image->alphas) + node->edges;
+	const AC_INDEX * next = (const AC_INDEX *) ((const char *) image + image->next) + node->edges;
+	int min = 0, max = node->degree - 1, mid;
+
+	if (node->degree <= AC_IMAGE_LINEAR)
+	{
+		for (; min <= max; min++)
+			if (alphas[min] == alpha)
+				return next[min];
+		return 0;
+	}
+
+	while (min <= max)
+	{
+		mid = (min + max) >> 1;
+		if (alpha > alphas[mid])
+			min = mid + 1;
+		else if (alpha < alphas[mid])
+			max = mid - 1;
+		else
+			return next[mid];
+	}
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_step
+
+DESCRIPTION:
+	The node after 'alpha' from node 'state': the goto edge of the state
+	or of the nearest node on its failure chain having one.
+******************************************************************************/
+static inline AC_INDEX ac_image_step (const AC_IMAGE * image,
+		const struct ac_image_node * nodes, AC_INDEX state, ALPHA alpha)
+{
+	AC_INDEX next;
+
+	for (; state; state = nodes[state].failure)
+		if ((next = ac_image_next (image, nodes + state, alpha)))
+			return next;
+
+	return image->root[(unsigned char) alpha];
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_strings
+
+DESCRIPTION:
+	Make room in the cursor for the matched strings of any node.
+******************************************************************************/
+int ac_image_strings (const AC_IMAGE * image, AC_IMAGE_CURSOR * c)
+{
+	STRING * strings;
+
+	if (c->strings_max >= image->max_outputs)
+		return 0;
+
+	if (!(strings = (STRING *) realloc (c->strings, image->max_outputs * sizeof(STRING))))
+		return -1;
+
+	c->strings = strings;
+	c->strings_max = image->max_outputs;
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_search
+
+DESCRIPTION:
+	Search a chunk of the input in the image, from the state of the
+	cursor, and call 'callback' for every match as ac_automata_search()
+	does; MATCH::matched_strings point into the image. Return 1 if the
+	callback stopped the search (the cursor is right after the match),
+	-1 if there is no memory for the matched strings.
+******************************************************************************/
+int ac_image_search (const AC_IMAGE * image, AC_IMAGE_CURSOR * c,
+		const ALPHA * text, unsigned long length,
+		MATCH_CALBACK callback, int automata_num, int thread_num)
+{
+	const struct ac_image_node * nodes =
+		(const struct ac_image_node *) ((const char *) image + image->nodes);
+	const struct ac_image_pattern * patterns =
+		(const struct ac_image_pattern *) ((const char *) image + image->patterns);
+	const AC_INDEX * outputs, * outputs_base =
+		(const AC_INDEX *) ((const char *) image + image->outputs);
+	AC_INDEX state = c->state;
+	unsigned long i;
+	AC_COUNT j;
+	MATCH m;
+
+	if (ac_image_strings (image, c))
+		return -1;
+
+	m.cp_position = 0;
+
+	for (i=0; i < length; i++)
+	{
+		state = ac_image_step (image, nodes, state, text[i]);
+
+		if (!nodes[state].outputs_num)
+			continue;
+
+		outputs = outputs_base + nodes[state].outputs;
+		for (j=0; j < nodes[state].outputs_num; j++)
+		{
+			c->strings[j].str = (ALPHA *) image + patterns[outputs[j]].str;
+			c->strings[j].length = patterns[outputs[j]].length;
+			c->strings[j].id = patterns[outputs[j]].id;
+		}
+
+		m.matched_strings = c->strings;
+		m.match_num = nodes[state].outputs_num;
+		m.position = c->base + i + 1;
+
+		if (callback (&m, automata_num, thread_num))
+		{
+			c->state = state;
+			c->base += i + 1;
+			return 1;
+		}
+	}
+
+	c->state = state;
+	c->base += length;
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_count
+
+DESCRIPTION:
+	Count the matches in a chunk of the input, as ac_automata_count() does.
+******************************************************************************/
+unsigned long ac_image_count (const AC_IMAGE * image, AC_IMAGE_CURSOR * c,
+		const ALPHA * text, unsigned long length)
+{
+	const struct ac_image_node * nodes =
+		(const struct ac_image_node *) ((const char *) image + image->nodes);
+	AC_INDEX state = c->state;
+	unsigned long i, found = 0;
+
+	for (i=0; i < length; i++)
+	{
+		state = ac_image_step (image, nodes, state, text[i]);
+		found += nodes[state].outputs_num;
+	}
+
+	c->state = state;
+	c->base += length;
+	return found;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_image_cursor_release
+
+DESCRIPTION:
+	Free the matched strings of the cursor and reset it.
+******************************************************************************/
+void ac_image_cursor_release (AC_IMAGE_CURSOR * c)
+{
+	free (c->strings);
+	memset (c, 0, sizeof(AC_IMAGE_CURSOR));
+}
@@ -0,0 +1,131 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef _AC_IMAGE_H_
+#define _AC_IMAGE_H_
+
+#include "config.h"
+#include "aho_corasick.h"
+
+/* Automata images
+
+   An image is a located automata flattened into one block of memory
+   where every reference is an index or an offset, never a pointer, so
+   the block can be mapped at any address: in shared memory, by many
+   processes at once, read-only. Searching it needs no build and no copy;
+   only the cursor (the search state) is per searcher.
+
+   An image is written to a memfd, to be inherited by forked workers or
+   passed over a socket (ac_image_memfd, ac_image_map), or published
+   under a name in POSIX shared memory (ac_image_publish, ac_image_attach).
+   A published name has versions: publishing again writes a new one,
+   switches the name to it and unlinks the old one. Mapped images stay
+   valid until their last process unmaps them (the kernel counts the
+   mappings), so readers move to the new version when they like, with
+   ac_image_refresh().
+
+   Images keep the strings, the goto edges, the failure nodes and the
+   output lists of the automata: they search with the overlapping
+   semantics and the case folding of the automata, report every matched
+   string whatever its group, and have no boundary flags.
+*/
+
+#define AC_IMAGE_MAGIC "ACIMAGE1"
+
+struct ac_image_node
+{
+	AC_INDEX failure; /* Failure node */
+	AC_INDEX edges; /* First edge in image::alphas and image::next */
+	AC_INDEX outputs; /* First matched string in image::outputs */
+	AC_COUNT degree; /* Number of edges, sorted by alpha */
+	AC_COUNT outputs_num; /* Number of matched strings */
+};
+
+struct ac_image_pattern
+{
+	unsigned long str; /* Offset of the string in the image */
+	AC_OFFSET length;
+	STRINGID id;
+};
+
+typedef struct ac_image
+{
+	char magic[8]; /* AC_IMAGE_MAGIC */
+	unsigned int index_size; /* sizeof(AC_INDEX) of the writer, see ac_types.h */
+	unsigned int count_size; /* sizeof(AC_COUNT) */
+	unsigned long size; /* Bytes of the whole image */
+	unsigned long version; /* Of a published image, else 0 */
+
+	AC_INDEX nodes_num;
+	AC_INDEX edges_num;
+	AC_INDEX outputs_num;
+	AC_INDEX patterns_num;
+	AC_COUNT max_outputs; /* Longest output list */
+
+	/* Offsets of the arrays from the start of the image */
+	unsigned long nodes; /* struct ac_image_node, node 0 is the root */
+	unsigned long alphas; /* unsigned char, alpha of every edge */
+	unsigned long next; /* AC_INDEX, node of every edge */
+	unsigned long outputs; /* AC_INDEX, index in patterns */
+	unsigned long patterns; /* struct ac_image_pattern */
+
+	AC_INDEX root[256]; /* Next node of the root for every alpha, 0 if none */
+} AC_IMAGE;
+
+/* A mapped image */
+typedef struct
+{
+	const AC_IMAGE * image; /* NULL if nothing is mapped */
+	const char * name; /* Of a published image, else NULL */
+	const unsigned long * current; /* Version published under 'name' */
+} AC_IMAGE_MAP;
+
+/* Search state of one input. 'strings' holds the matched strings of the
+   last match, as MATCH reports them. */
+typedef struct
+{
+	AC_INDEX state;
+	unsigned long base; /* Position of the next chunk in the input */
+	STRING * strings;
+	AC_COUNT strings_max;
+} AC_IMAGE_CURSOR;
+
+#define AC_IMAGE_CURSOR_INIT { 0, 0, NULL, 0 }
+
+
+unsigned long ac_image_size      (AC_AUTOMATA * thiz);
+AC_ERROR ac_image_write          (AC_AUTOMATA * thiz, void * image, unsigned long version);
+AC_ERROR ac_image_memfd          (AC_AUTOMATA * thiz, int * fd);
+AC_ERROR ac_image_publish        (AC_AUTOMATA * thiz, const char * name, unsigned long * version);
+AC_ERROR ac_image_map            (AC_IMAGE_MAP * map, int fd);
+AC_ERROR ac_image_attach         (AC_IMAGE_MAP * map, const char * name);
+int      ac_image_refresh        (AC_IMAGE_MAP * map);
+void     ac_image_detach         (AC_IMAGE_MAP * map);
+void     ac_image_unlink         (const char * name);
+
+int      ac_image_search         (const AC_IMAGE * image, AC_IMAGE_CURSOR * c,
+                                  const ALPHA * text, unsigned long length,
+                                  MATCH_CALBACK callback, int automata_num, int thread_num);
+unsigned long ac_image_count     (const AC_IMAGE * image, AC_IMAGE_CURSOR * c,
+                                  const ALPHA * text, unsigned long length);
+void     ac_image_cursor_release (AC_IMAGE_CURSOR * c);
+
+#endif
@@ -0,0 +1,324 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ac_output.h"
+
+/* Private Functions */
+char * ac_output_reserve      (AC_OUTPUT * thiz, size_t need);
+char * ac_output_put_uint     (char * p, unsigned long long v);
+char * ac_output_put_escaped  (char * p, STRING * str, AC_OUTPUT_FORMAT format);
+
+static const char hexdigits[] = "0123456789abcdef";
+
+
+
+/******************************************************************************
+FUNCTION: ac_output_init
+
+PARAMS:
+	AC_OUTPUT * thiz: Pointer to the writer
+	int fd: Output file descriptor
+	AC_OUTPUT_FORMAT format: Record format
+	pthread_mutex_t * lock: Lock shared by all writers of 'fd', or NULL
+	                        if this is the only writer
+
+DESCRIPTION:
+	Initialize the writer. No memory is allocated until the first match.
+******************************************************************************/
+void ac_output_init (AC_OUTPUT * thiz, int fd, AC_OUTPUT_FORMAT format, pthread_mutex_t * lock)
+{
+	memset (thiz, 0, sizeof(AC_OUTPUT));
+	thiz->fd = fd;
+	thiz->format = format;
+	thiz->lock = lock;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_parse_format
+
+RETURNS:
+	0 on success, -1 when 'name' is not one of "bin", "tsv", "jsonl"
+******************************************************************************/
+int ac_output_parse_format (const char * name, AC_OUTPUT_FORMAT * format)
+{
+	if (!strcmp (name, "bin"))
+		*format = AC_OUTPUT_BINARY;
+	else if (!strcmp (name, "tsv"))
+		*format = AC_OUTPUT_TSV;
+	else if (!strcmp (name, "jsonl"))
+		*format = AC_OUTPUT_JSONL;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_flush
+
+RETURNS:
+	0 on success, -1 if any write of this writer has failed
+
+DESCRIPTION:
+	Write all filled segments with one writev() and empty them.
+	Segments stay allocated for further use.
+******************************************************************************/
+int ac_output_flush (AC_OUTPUT * thiz)
+{
+	struct iovec iovs[AC_OUTPUT_SEGMENTS];
+	struct iovec * iov = iovs;
+	int iovcnt = thiz->current + 1;
+	ssize_t n;
+	unsigned int i;
+
+	if (!thiz->segments[0].iov_len)
+		return thiz->error ? -1 : 0;
+
+	/* Work on a copy, short writes move the base pointers */
+	memcpy (iovs, thiz->segments, iovcnt * sizeof(struct iovec));
+
+	if (thiz->lock)
+		pthread_mutex_lock (thiz->lock);
+
+	while (iovcnt && !thiz->error)
+	{
+		if ((n = writev (thiz->fd, iov, iovcnt)) < 0)
+		{
+			if (errno != EINTR)
+				thiz->error = 1;
+			continue;
+		}
+
+		/* Skip what is written, in case of a short write */
+		while (iovcnt && (size_t) n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt)
+		{
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	if (thiz->lock)
+		pthread_mutex_unlock (thiz->lock);
+
+	for (i=0; i <= thiz->current; i++)
+		thiz->segments[i].iov_len = 0;
+	thiz->current = 0;
+
+	return thiz->error ? -1 : 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_reserve
+
+DESCRIPTION:
+	Return a pointer to at least 'need' free bytes at the end of the buffer.
+	A record is never split between two segments. The caller adds the size
+	of what it actually wrote to iov_len of the current segment.
+******************************************************************************/
+char * ac_output_reserve (AC_OUTPUT * thiz, size_t need)
+{
+	struct iovec * seg = &thiz->segments[thiz->current];
+
+	if (seg->iov_base && seg->iov_len + need <= thiz->capacity[thiz->current])
+		return (char *) seg->iov_base + seg->iov_len;
+
+	if (seg->iov_base)
+	{
+		/* The current segment is full: go to the next one */
+		if (thiz->current + 1 == AC_OUTPUT_SEGMENTS)
+			ac_output_flush (thiz);
+		else
+			thiz->current++;
+		seg = &thiz->segments[thiz->current];
+	}
+
+	if (thiz->capacity[thiz->current] < need)
+	{
+		/* Allocate on first use, or grow for an unusually long record */
+		thiz->capacity[thiz->current] = need > AC_OUTPUT_SEGMENT_SIZE ?
+			need : AC_OUTPUT_SEGMENT_SIZE;
+		seg->iov_base = realloc (seg->iov_base, thiz->capacity[thiz->current]);
+	}
+
+	return (char *) seg->iov_base + seg->iov_len;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_put_uint
+
+DESCRIPTION:
+	Write decimal representation of 'v' at 'p'; return the end of it.
+******************************************************************************/
+char * ac_output_put_uint (char * p, unsigned long long v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do
+	{
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (n)
+		*p++ = tmp[--n];
+
+	return p;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_put_escaped
+
+DESCRIPTION:
+	Write the pattern at 'p', escaped for the given text format;
+	return the end of it. At most 6 bytes are written per input byte.
+******************************************************************************/
+char * ac_output_put_escaped (char * p, STRING * str, AC_OUTPUT_FORMAT format)
+{
+	AC_OFFSET i;
+	unsigned char c;
+
+	for (i=0; i < str->length; i++)
+	{
+		c = (unsigned char) str->str[i];
+
+		if (c == '\\' || (c == '"' && format == AC_OUTPUT_JSONL))
+		{
+			*p++ = '\\';
+			*p++ = c;
+		}
+		else if (c == '\t' || c == '\n' || c == '\r')
+		{
+			*p++ = '\\';
+			*p++ = (c == '\t') ? 't' : (c == '\n') ? 'n' : 'r';
+		}
+		else if (c < 0x20 || c == 0x7f)
+		{
+			*p++ = '\\';
+			*p++ = 'u';
+			*p++ = '0';
+			*p++ = '0';
+			*p++ = hexdigits[c >> 4];
+			*p++ = hexdigits[c & 0xf];
+		}
+		else
+			*p++ = c;
+	}
+
+	return p;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_match
+
+DESCRIPTION:
+	Append one record per matched string of 'm' to the buffer.
+	It is cheap enough to be called straight from the match callback.
+******************************************************************************/
+void ac_output_match (AC_OUTPUT * thiz, MATCH * m)
+{
+	unsigned int j;
+	STRING * s;
+	AC_OUTPUT_RECORD * rec;
+	char * start, * p;
+
+	for (j=0; j < m->match_num; j++)
+	{
+		s = &m->matched_strings[j];
+
+		switch (thiz->format)
+		{
+			case AC_OUTPUT_BINARY:
+				rec = (AC_OUTPUT_RECORD *) ac_output_reserve (thiz, sizeof(AC_OUTPUT_RECORD));
+				rec->position = m->position;
+				rec->id = s->id;
+				thiz->segments[thiz->current].iov_len += sizeof(AC_OUTPUT_RECORD);
+				break;
+
+			case AC_OUTPUT_TSV:
+				start = p = ac_output_reserve (thiz, 6 * s->length + 48);
+				p = ac_output_put_uint (p, m->position);
+				*p++ = '\t';
+				p = ac_output_put_uint (p, s->id);
+				*p++ = '\t';
+				p = ac_output_put_escaped (p, s, thiz->format);
+				*p++ = '\n';
+				thiz->segments[thiz->current].iov_len += p - start;
+				break;
+
+			case AC_OUTPUT_JSONL:
+				start = p = ac_output_reserve (thiz, 6 * s->length + 80);
+				memcpy (p, "{\"position\":", 12);
+				p = ac_output_put_uint (p + 12, m->position);
+				memcpy (p, ",\"id\":", 6);
+				p = ac_output_put_uint (p + 6, s->id);
+				memcpy (p, ",\"pattern\":\"", 12);
+				p = ac_output_put_escaped (p + 12, s, thiz->format);
+				memcpy (p, "\"}\n", 3);
+				p += 3;
+				thiz->segments[thiz->current].iov_len += p - start;
+				break;
+		}
+	}
+}
+
+
+/******************************************************************************
+FUNCTION: ac_output_release
+
+RETURNS:
+	0 on success, -1 if any write of this writer has failed
+
+DESCRIPTION:
+	Flush the remaining records and free the buffer.
+	The file descriptor is not closed.
+******************************************************************************/
+int ac_output_release (AC_OUTPUT * thiz)
+{
+	unsigned int i;
+	int ret;
+
+	ret = ac_output_flush (thiz);
+
+	for (i=0; i < AC_OUTPUT_SEGMENTS; i++)
+		free (thiz->segments[i].iov_base);
+
+	memset (thiz->segments, 0, sizeof(thiz->segments));
+	memset (thiz->capacity, 0, sizeof(thiz->capacity));
+
+	return ret;
+}
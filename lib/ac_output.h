@@ -0,0 +1,75 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_OUTPUT_H_
+#define _AC_OUTPUT_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "config.h"
+#include "ac_types.h"
+
+/* Every segment of the write buffer; a writer allocates its segments on
+   demand and hands all of them to a single writev() when they are full */
+#define AC_OUTPUT_SEGMENT_SIZE (64 * 1024)
+#define AC_OUTPUT_SEGMENTS 16
+
+/* Record formats */
+typedef enum
+{
+	AC_OUTPUT_BINARY = 0, /* AC_OUTPUT_RECORD per matched string */
+	AC_OUTPUT_TSV,        /* position <TAB> id <TAB> pattern */
+	AC_OUTPUT_JSONL,      /* {"position":..,"id":..,"pattern":".."} */
+} AC_OUTPUT_FORMAT;
+
+/* Binary record: host byte order, no padding */
+typedef struct __attribute__((packed))
+{
+	uint64_t position; /* Same as MATCH::position */
+	uint64_t id; /* Same as STRING::id */
+} AC_OUTPUT_RECORD;
+
+typedef struct
+/* Buffered match writer. Use one writer per thread; writers sharing a file
+   descriptor should share a lock, so that their flushes do not interleave. */
+{
+	int fd; /* Output file descriptor */
+	AC_OUTPUT_FORMAT format;
+	pthread_mutex_t * lock; /* Serializes flushes to 'fd' (optional) */
+
+	struct iovec segments[AC_OUTPUT_SEGMENTS]; /* iov_len is the filled size */
+	size_t capacity[AC_OUTPUT_SEGMENTS]; /* Allocated size of every segment */
+	unsigned int current; /* The segment being filled */
+
+	int error; /* A write has failed */
+} AC_OUTPUT;
+
+
+/* Public Functions */
+void ac_output_init    (AC_OUTPUT * thiz, int fd, AC_OUTPUT_FORMAT format, pthread_mutex_t * lock);
+void ac_output_match   (AC_OUTPUT * thiz, MATCH * m);
+int  ac_output_flush   (AC_OUTPUT * thiz);
+int  ac_output_release (AC_OUTPUT * thiz);
+int  ac_output_parse_format (const char * name, AC_OUTPUT_FORMAT * format);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ac_pages.h"
+
+/* Private Functions */
+unsigned long ac_pages_round (unsigned long size, AC_PAGES got);
+
+
+
+/******************************************************************************
+FUNCTION: ac_pages_round
+
+DESCRIPTION:
+	The size of the mapping of a region of 'size' bytes.
+******************************************************************************/
+unsigned long ac_pages_round (unsigned long size, AC_PAGES got)
+{
+	if (got == AC_PAGES_HUGE || got == AC_PAGES_HUGETLB)
+		return (size + AC_PAGES_HUGE_SIZE - 1) & ~(AC_PAGES_HUGE_SIZE - 1);
+
+	return size;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_pages_alloc
+
+PARAMS:
+	unsigned long size: Bytes of the region, not 0
+	AC_PAGES pages: The pages wanted
+	AC_PAGES * got: The pages of the region, AC_PAGES_PACKED if they are
+	                not huge
+
+RETURNS:
+	The region, zero filled, or NULL if there is no memory at all
+
+DESCRIPTION:
+	Map a region, in huge pages if the kernel gives them, falling back to
+	transparent huge pages and then to normal pages (see ac_pages.h).
+	AC_PAGES_DEFAULT is taken as AC_PAGES_PACKED. Release it with
+	ac_pages_free().
+******************************************************************************/
+void * ac_pages_alloc (unsigned long size, AC_PAGES pages, AC_PAGES * got)
+{
+	unsigned long length, skip, page;
+	char * region;
+
+#ifdef MAP_HUGETLB
+	if (pages == AC_PAGES_HUGETLB)
+	{
+		region = (char *) mmap (NULL, ac_pages_round (size, AC_PAGES_HUGETLB),
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (region != MAP_FAILED)
+		{
+			*got = AC_PAGES_HUGETLB;
+			return region;
+		}
+	}
+#endif
+
+#ifdef MADV_HUGEPAGE
+	if (pages == AC_PAGES_HUGE || pages == AC_PAGES_HUGETLB)
+	{
+		/* A huge page must be aligned: map one more, trim both ends */
+		length = ac_pages_round (size, AC_PAGES_HUGE);
+		region = (char *) mmap (NULL, length + AC_PAGES_HUGE_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED)
+			return NULL;
+
+		skip = (AC_PAGES_HUGE_SIZE - ((unsigned long) region & (AC_PAGES_HUGE_SIZE - 1))) &
+			(AC_PAGES_HUGE_SIZE - 1);
+		if (skip)
+			munmap (region, skip);
+		munmap (region + skip + length, AC_PAGES_HUGE_SIZE - skip);
+		region += skip;
+
+		*got = madvise (region, length, MADV_HUGEPAGE) ? AC_PAGES_PACKED : AC_PAGES_HUGE;
+		if (*got == AC_PAGES_PACKED)
+		{
+			/* Keep the size of the mapping ac_pages_free() expects */
+			page = sysconf (_SC_PAGESIZE);
+			skip = (size + page - 1) & ~(page - 1);
+			if (skip < length)
+				munmap (region + skip, length - skip);
+		}
+		return region;
+	}
+#endif
+
+	region = (char *) mmap (NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	*got = AC_PAGES_PACKED;
+
+	return region == MAP_FAILED ? NULL : region;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_pages_free
+
+DESCRIPTION:
+	Unmap a region of ac_pages_alloc(), given its size and its pages.
+******************************************************************************/
+void ac_pages_free (void * region, unsigned long size, AC_PAGES got)
+{
+	if (region)
+		munmap (region, ac_pages_round (size, got));
+}
+
+
+/******************************************************************************
+FUNCTION: ac_pages_name
+
+DESCRIPTION:
+	The name of a mode, as the command line tools take it.
+******************************************************************************/
+const char * ac_pages_name (AC_PAGES pages)
+{
+	switch (pages)
+	{
+		case AC_PAGES_PACKED:
+			return "packed";
+		case AC_PAGES_HUGE:
+			return "huge";
+		case AC_PAGES_HUGETLB:
+			return "hugetlb";
+		default:
+			return "default";
+	}
+}
@@ -0,0 +1,49 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_PAGES_H_
+#define _AC_PAGES_H_
+
+#include "config.h"
+#include "ac_types.h"
+
+/* Regions of memory in huge pages
+
+   A region is mapped anonymously, private to the process. AC_PAGES_HUGETLB
+   maps it with MAP_HUGETLB, which needs huge pages reserved in
+   /proc/sys/vm/nr_hugepages; AC_PAGES_HUGE aligns it to AC_PAGES_HUGE_SIZE
+   and marks it with madvise(MADV_HUGEPAGE), which needs transparent huge
+   pages in "always" or "madvise" mode. Either falls back to the next mode
+   down when the kernel refuses it, and 'got' tells which mode the region
+   has. Huge pages of a region marked AC_PAGES_HUGE may also come later,
+   from khugepaged, or never if the kernel has none to spare: the
+   AnonHugePages of /proc/self/smaps tell how much is actually huge.
+*/
+
+/* Size of a huge page */
+#define AC_PAGES_HUGE_SIZE (2UL << 20)
+
+
+/* Public Functions */
+void * ac_pages_alloc (unsigned long size, AC_PAGES pages, AC_PAGES * got);
+void   ac_pages_free  (void * region, unsigned long size, AC_PAGES got);
+const char * ac_pages_name (AC_PAGES pages);
+
+#endif
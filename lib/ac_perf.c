@@ -0,0 +1,168 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include "ac_perf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static const struct { unsigned int type; unsigned long long config; }
+ac_perf_events[AC_PERF_COUNTERS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+/* Counters the CPU may not have; the others are counted without them */
+#define AC_PERF_OPTIONAL(i) ((i) == AC_PERF_DTLB_MISSES)
+#endif
+
+
+
+/******************************************************************************
+FUNCTION: ac_perf_open
+
+RETURNS:
+	0 on success, -1 if the counters are not available
+
+DESCRIPTION:
+	Open the counters for the calling thread, stopped.
+******************************************************************************/
+int ac_perf_open (AC_PERF * thiz)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	int i, leader = -1;
+
+	memset (thiz, 0, sizeof(AC_PERF));
+
+	for (i=0; i < AC_PERF_COUNTERS; i++)
+	{
+		memset (&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = ac_perf_events[i].type;
+		attr.config = ac_perf_events[i].config;
+		attr.disabled = (leader == -1);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		thiz->fd[i] = syscall (__NR_perf_event_open, &attr, 0, -1, leader, 0);
+		if (thiz->fd[i] < 0 && AC_PERF_OPTIONAL(i))
+			continue;
+		if (thiz->fd[i] < 0)
+		{
+			while (i--)
+				if (thiz->fd[i] >= 0)
+					close (thiz->fd[i]);
+			return -1;
+		}
+
+		if (leader == -1)
+			leader = thiz->fd[i];
+	}
+
+	thiz->on = 1;
+	return 0;
+#else
+	memset (thiz, 0, sizeof(AC_PERF));
+	return -1;
+#endif
+}
+
+
+/******************************************************************************
+FUNCTION: ac_perf_close
+******************************************************************************/
+void ac_perf_close (AC_PERF * thiz)
+{
+	int i;
+
+	if (!thiz->on)
+		return;
+
+	for (i=0; i < AC_PERF_COUNTERS; i++)
+		if (thiz->fd[i] >= 0)
+			close (thiz->fd[i]);
+	thiz->on = 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_perf_start
+
+DESCRIPTION:
+	Reset and start the counters.
+******************************************************************************/
+void ac_perf_start (AC_PERF * thiz)
+{
+#ifdef __linux__
+	if (!thiz->on)
+		return;
+
+	ioctl (thiz->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl (thiz->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+
+/******************************************************************************
+FUNCTION: ac_perf_stop
+
+PARAMS:
+	unsigned long long * values: AC_PERF_COUNTERS values, in the order of
+	                             the AC_PERF_* enum
+
+RETURNS:
+	1 if the values are read, otherwise 0
+
+DESCRIPTION:
+	Stop the counters and read them.
+******************************************************************************/
+int ac_perf_stop (AC_PERF * thiz, unsigned long long * values)
+{
+#ifdef __linux__
+	unsigned long long group[1 + AC_PERF_COUNTERS]; /* Number, then values */
+	ssize_t length;
+	int i, n = 0;
+
+	if (!thiz->on)
+		return 0;
+
+	ioctl (thiz->fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+	if ((length = read (thiz->fd[0], group, sizeof(group))) < (ssize_t) sizeof(group[0]) ||
+		length != (ssize_t) ((1 + group[0]) * sizeof(group[0])))
+		return 0;
+
+	/* Values of the open counters, in order; missing ones are 0 */
+	for (i=0; i < AC_PERF_COUNTERS; i++)
+		values[i] = thiz->fd[i] >= 0 ? group[1 + n++] : 0;
+	return 1;
+#else
+	return 0;
+#endif
+}
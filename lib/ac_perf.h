@@ -0,0 +1,57 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef _AC_PERF_H_
+#define _AC_PERF_H_
+
+#include "config.h"
+
+/* Hardware counters
+
+   The search of an automata built with AC_INSTRUMENT may read CPU
+   counters of the calling thread around every search call, through
+   perf_event_open(2) on Linux. They are counted in user space only, and
+   need /proc/sys/kernel/perf_event_paranoid to allow it.
+*/
+
+enum
+{
+	AC_PERF_CYCLES = 0,
+	AC_PERF_LLC_MISSES, /* Last level cache misses */
+	AC_PERF_BRANCH_MISSES,
+	AC_PERF_DTLB_MISSES, /* Data TLB load misses, 0 if the CPU has no such counter */
+	AC_PERF_COUNTERS
+};
+
+typedef struct ac_perf
+{
+	int on; /* 1 if the counters below are open */
+	int fd[AC_PERF_COUNTERS]; /* One group, led by fd[AC_PERF_CYCLES]; -1 if missing */
+} AC_PERF;
+
+
+/* Public Functions */
+int  ac_perf_open  (AC_PERF * thiz);
+void ac_perf_close (AC_PERF * thiz);
+void ac_perf_start (AC_PERF * thiz);
+int  ac_perf_stop  (AC_PERF * thiz, unsigned long long * values);
+
+#endif
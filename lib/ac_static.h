@@ -0,0 +1,108 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/* Automata compiled at build time
+
+   acgen (see src/) turns a pattern file into a header of static const
+   tables: a full transition table with failure nodes resolved, and the
+   matched strings of every state. Including the generated header defines
+
+	int           NAME_search (AC_STATIC_CURSOR * c, const ALPHA * text,
+	                  unsigned long length, MATCH_CALBACK callback,
+	                  int automata_num, int thread_num);
+	unsigned long NAME_count  (AC_STATIC_CURSOR * c, const ALPHA * text,
+	                  unsigned long length);
+
+   which need no initialization and no heap. The tables are read-only;
+   NAME_search returns 1 if the callback stopped it. The cursor keeps the
+   state between chunks of one input, like AC_AUTOMATA does.
+*/
+
+#ifndef _AC_STATIC_H_
+#define _AC_STATIC_H_
+
+#include "config.h"
+#include "ac_types.h"
+
+typedef struct ac_static_cursor
+{
+	unsigned long state;
+	unsigned long base; /* Position of the next chunk in the input */
+} AC_STATIC_CURSOR;
+
+#define AC_STATIC_CURSOR_INIT { 0, 0 }
+
+
+/* Define the search functions of the tables NAME_delta (state_type
+   [states][256]), NAME_out_begin and NAME_out */
+#define AC_STATIC_DEFINE(name, state_type)                                   \
+                                                                             \
+static inline int name##_search (AC_STATIC_CURSOR * c, const ALPHA * text,   \
+		unsigned long length, MATCH_CALBACK callback,                        \
+		int automata_num, int thread_num)                                    \
+{                                                                            \
+	state_type s = (state_type) c->state;                                    \
+	unsigned long i;                                                         \
+	MATCH m;                                                                 \
+                                                                             \
+	m.cp_position = 0;                                                       \
+                                                                             \
+	for (i = 0; i < length; i++)                                             \
+	{                                                                        \
+		s = name##_delta[s][(unsigned char) text[i]];                        \
+                                                                             \
+		if (name##_out_begin[s] == name##_out_begin[s + 1])                  \
+			continue;                                                        \
+                                                                             \
+		m.matched_strings = (STRING *) &name##_out[name##_out_begin[s]];     \
+		m.match_num = name##_out_begin[s + 1] - name##_out_begin[s];         \
+		m.position = c->base + i + 1;                                        \
+                                                                             \
+		if (callback (&m, automata_num, thread_num))                         \
+		{                                                                    \
+			c->state = s;                                                    \
+			c->base += i + 1;                                                \
+			return 1;                                                        \
+		}                                                                    \
+	}                                                                        \
+                                                                             \
+	c->state = s;                                                            \
+	c->base += length;                                                       \
+	return 0;                                                                \
+}                                                                            \
+                                                                             \
+static inline unsigned long name##_count (AC_STATIC_CURSOR * c,              \
+		const ALPHA * text, unsigned long length)                            \
+{                                                                            \
+	state_type s = (state_type) c->state;                                    \
+	unsigned long i, found = 0;                                              \
+                                                                             \
+	for (i = 0; i < length; i++)                                             \
+	{                                                                        \
+		s = name##_delta[s][(unsigned char) text[i]];                        \
+		found += name##_out_begin[s + 1] - name##_out_begin[s];              \
+	}                                                                        \
+                                                                             \
+	c->state = s;                                                            \
+	c->base += length;                                                       \
+	return found;                                                            \
+}
+
+#endif
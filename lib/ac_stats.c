@@ -0,0 +1,158 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <string.h>
+#include "ac_stats.h"
+#include "ac_pages.h"
+
+/* Private Functions */
+void ac_stats_print_array (FILE * fp, const char * name, unsigned long * values,
+		unsigned int num);
+
+
+
+/******************************************************************************
+FUNCTION: ac_automata_stats
+
+PARAMS:
+	AC_STATS * stats: Filled with the memory and the structure of the
+	                  automata
+
+DESCRIPTION:
+	Collect the statistics of the automata. It may be called at any time,
+	but output lists are only built by ac_automata_locate_failure().
+******************************************************************************/
+void ac_automata_stats (AC_AUTOMATA * thiz, AC_STATS * stats)
+{
+	AC_INDEX i;
+	unsigned long b;
+	NODE * n;
+
+	memset (stats, 0, sizeof(AC_STATS));
+
+	stats->nodes = thiz->all_nodes_num;
+	stats->patterns = thiz->total_strings;
+	stats->output_pool = thiz->outputs_num;
+
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		n = thiz->all_nodes[i];
+
+		stats->edges += n->outgoing_degree;
+		stats->edge_slack += (n->outgoing_max - n->outgoing_degree) * sizeof(struct edge);
+		stats->output_lists += n->outputs_num;
+		if (n->final)
+			stats->final_nodes++;
+
+		if (n->depth > stats->max_depth)
+			stats->max_depth = n->depth;
+		for (b = 0; b < AC_STATS_DEPTH_BUCKETS - 1 && (n->depth >> b); b++)
+			;
+		stats->depths[b]++;
+
+		if (n->outgoing_degree > stats->max_degree)
+			stats->max_degree = n->outgoing_degree;
+		stats->degrees[n->outgoing_degree < AC_STATS_DEGREES - 1 ?
+			n->outgoing_degree : AC_STATS_DEGREES - 1]++;
+
+		stats->encodings[n->encoding]++;
+		stats->edge_index_bytes += node_index_size (n);
+	}
+
+	stats->node_bytes = thiz->all_nodes_num * sizeof(NODE);
+	stats->node_index_bytes = thiz->all_nodes_num * sizeof(NODE *);
+	stats->node_index_slack = (thiz->all_nodes_max - thiz->all_nodes_num) * sizeof(NODE *);
+	stats->edge_bytes = stats->edges * sizeof(struct edge);
+
+	/* The node of every string is only kept until the automata is located */
+	b = sizeof(STRING) + sizeof(struct match_attr) +
+		(thiz->pattern_nodes ? sizeof(AC_INDEX) : 0);
+	stats->pattern_bytes = thiz->total_strings * b;
+	stats->pattern_slack = (thiz->patterns_max - thiz->total_strings) * b;
+
+	b = sizeof(AC_INDEX);
+	stats->output_bytes = thiz->outputs_num * b;
+	stats->output_slack = (thiz->outputs_max - thiz->outputs_num) * b;
+
+	stats->pages = thiz->region ? thiz->region_pages : AC_PAGES_DEFAULT;
+	stats->region_bytes = thiz->region_size;
+
+	if (thiz->wm)
+		stats->wm_bytes = sizeof(AC_WM) + thiz->wm->bucket[AC_WM_TABLE] *
+			sizeof(struct ac_wm_entry);
+
+	stats->total_bytes = stats->node_bytes + stats->node_index_bytes +
+		stats->edge_bytes + stats->edge_index_bytes + stats->pattern_bytes + stats->output_bytes +
+		stats->wm_bytes + stats->node_index_slack + stats->edge_slack +
+		stats->pattern_slack + stats->output_slack;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stats_print
+
+DESCRIPTION:
+	Print the statistics as one JSON object, on one line. Histograms are
+	arrays without their trailing zeros.
+******************************************************************************/
+void ac_stats_print (AC_STATS * stats, FILE * fp)
+{
+	fprintf (fp, "{\"bytes\": {\"nodes\": %lu, \"node_index\": %lu, \"edges\": %lu, "
+		"\"edge_index\": %lu, \"patterns\": %lu, \"outputs\": %lu, \"wm\": %lu, "
+		"\"total\": %lu}, ", stats->node_bytes, stats->node_index_bytes, stats->edge_bytes,
+		stats->edge_index_bytes, stats->pattern_bytes, stats->output_bytes, stats->wm_bytes, stats->total_bytes);
+	fprintf (fp, "\"slack\": {\"node_index\": %lu, \"edges\": %lu, \"patterns\": %lu, "
+		"\"outputs\": %lu}, ", stats->node_index_slack, stats->edge_slack,
+		stats->pattern_slack, stats->output_slack);
+	fprintf (fp, "\"nodes\": %lu, \"final_nodes\": %lu, \"edges\": %lu, \"patterns\": %lu, "
+		"\"output_lists\": %lu, \"output_pool\": %lu, \"max_depth\": %lu, "
+		"\"max_degree\": %lu, ", stats->nodes, stats->final_nodes, stats->edges,
+		stats->patterns, stats->output_lists, stats->output_pool, stats->max_depth,
+		stats->max_degree);
+	ac_stats_print_array (fp, "depths_log2", stats->depths, AC_STATS_DEPTH_BUCKETS);
+	fprintf (fp, ", ");
+	ac_stats_print_array (fp, "degrees", stats->degrees, AC_STATS_DEGREES);
+	fprintf (fp, ", \"encodings\": {\"sorted\": %lu, \"none\": %lu, \"one\": %lu, "
+		"\"small\": %lu, \"bitmap\": %lu, \"dense\": %lu}",
+		stats->encodings[NODE_EDGES_SORTED], stats->encodings[NODE_EDGES_NONE],
+		stats->encodings[NODE_EDGES_ONE], stats->encodings[NODE_EDGES_SMALL],
+		stats->encodings[NODE_EDGES_BITMAP], stats->encodings[NODE_EDGES_DENSE]);
+	fprintf (fp, ", \"pages\": {\"mode\": \"%s\", \"region\": %lu}",
+		ac_pages_name (stats->pages), stats->region_bytes);
+	fprintf (fp, "}");
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stats_print_array
+******************************************************************************/
+void ac_stats_print_array (FILE * fp, const char * name, unsigned long * values,
+		unsigned int num)
+{
+	unsigned int i;
+
+	while (num && !values[num - 1])
+		num--;
+
+	fprintf (fp, "\"%s\": [", name);
+	for (i=0; i < num; i++)
+		fprintf (fp, "%s%lu", i ? ", " : "", values[i]);
+	fprintf (fp, "]");
+}
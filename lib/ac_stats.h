@@ -0,0 +1,89 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef _AC_STATS_H_
+#define _AC_STATS_H_
+
+#include <stdio.h>
+
+#include "config.h"
+#include "aho_corasick.h"
+
+/* Memory and structure of an automata
+
+   ac_automata_stats() walks a located automata and reports the bytes it
+   asked from malloc by category, how much of it is unused capacity, and
+   the shape of the trie. Bytes are those requested; the overhead of
+   malloc itself is not included. Nodes packed into one region (see
+   ac_automata_set_pages) are counted the same.
+*/
+
+/* Depth histogram buckets: bucket 0 is the root, bucket b > 0 holds the
+   depths from 2^(b-1) to 2^b - 1 */
+#define AC_STATS_DEPTH_BUCKETS 22
+
+/* Out-degree histogram: one entry per degree, the last holds larger ones */
+#define AC_STATS_DEGREES 258
+
+typedef struct
+{
+	/* Bytes in use, by category */
+	unsigned long node_bytes; /* NODE structs */
+	unsigned long node_index_bytes; /* automata::all_nodes */
+	unsigned long edge_bytes; /* Outgoing edges */
+	unsigned long edge_index_bytes; /* Search indexes of the encodings of edges */
+	unsigned long pattern_bytes; /* Pattern table, without the strings */
+	unsigned long output_bytes; /* Output pool (ids) */
+	unsigned long wm_bytes; /* Wu-Manber tables, 0 if not used */
+
+	/* Bytes allocated beyond what is in use (capacity slack) */
+	unsigned long node_index_slack;
+	unsigned long edge_slack;
+	unsigned long pattern_slack;
+	unsigned long output_slack;
+
+	unsigned long total_bytes; /* All of the above */
+
+	/* Structure */
+	unsigned long nodes;
+	unsigned long final_nodes;
+	unsigned long edges; /* Folded edges included (see ac_automata_set_fold) */
+	unsigned long patterns;
+	unsigned long output_lists; /* Sum of node::outputs_num over all nodes */
+	unsigned long output_pool; /* Strings kept in the pool for those lists */
+	unsigned long max_depth;
+	unsigned long max_degree;
+	unsigned long encodings[NODE_EDGES_DENSE + 1]; /* Nodes by NODE_EDGES_* */
+	unsigned long depths[AC_STATS_DEPTH_BUCKETS]; /* Nodes by depth */
+	unsigned long degrees[AC_STATS_DEGREES]; /* Nodes by out-degree */
+
+	/* Memory pages (see AC_PAGES): the region holds the nodes, edges and
+	   their indexes counted above, in one mapping */
+	AC_PAGES pages; /* Pages the region got, AC_PAGES_DEFAULT if none */
+	unsigned long region_bytes;
+} AC_STATS;
+
+
+/* Public Functions */
+void ac_automata_stats (AC_AUTOMATA * thiz, AC_STATS * stats);
+void ac_stats_print    (AC_STATS * stats, FILE * fp);
+
+#endif
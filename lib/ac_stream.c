@@ -0,0 +1,400 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef AC_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef AC_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "ac_stream.h"
+#include "ac_pages.h"
+
+/* Private Functions */
+AC_STREAM_FORMAT ac_stream_detect  (int fd);
+long             ac_stream_fill    (AC_STREAM * thiz, ALPHA * buf, size_t size);
+void *           ac_stream_reader  (void * param);
+
+
+
+/******************************************************************************
+FUNCTION: ac_stream_detect
+
+DESCRIPTION:
+	Look at the magic number of the file to find out its format.
+	The file offset is left at the beginning of the file.
+******************************************************************************/
+AC_STREAM_FORMAT ac_stream_detect (int fd)
+{
+	unsigned char magic[4];
+	ssize_t n;
+
+	n = pread (fd, magic, sizeof(magic), 0);
+
+	if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return AC_STREAM_GZIP;
+	if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+			magic[2] == 0x2f && magic[3] == 0xfd)
+		return AC_STREAM_ZSTD;
+
+	return AC_STREAM_PLAIN;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_open
+
+RETURNS:
+	0 on success
+	-1 when the file can not be opened or its format is not supported
+	   by this build (see WITH_ZLIB and WITH_ZSTD in Makefile)
+
+DESCRIPTION:
+	Open the file, detect its format and start the reader thread.
+******************************************************************************/
+int ac_stream_open (AC_STREAM * thiz, const char * filename)
+{
+	return ac_stream_open_ex (thiz, filename, AC_PAGES_DEFAULT);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_open_ex
+
+PARAMS:
+	AC_PAGES pages: Pages of the ring of blocks (see AC_PAGES);
+	                with AC_PAGES_DEFAULT every block is malloc'd
+
+DESCRIPTION:
+	ac_stream_open() with the ring of blocks in one region of the given
+	pages, e.g. AC_PAGES_HUGE.
+******************************************************************************/
+int ac_stream_open_ex (AC_STREAM * thiz, const char * filename, AC_PAGES pages)
+{
+	unsigned int i;
+	#ifdef AC_WITH_ZLIB
+	int fd;
+	#endif
+
+	memset (thiz, 0, sizeof(AC_STREAM));
+
+	if ((thiz->fd = open (filename, O_RDONLY)) < 0)
+		return -1;
+
+	thiz->format = ac_stream_detect (thiz->fd);
+
+	switch (thiz->format)
+	{
+		case AC_STREAM_PLAIN:
+			break;
+		case AC_STREAM_GZIP:
+			#ifdef AC_WITH_ZLIB
+			/* gzdopen() takes the ownership of a descriptor; give it a copy */
+			if ((fd = dup (thiz->fd)) < 0)
+				goto fail;
+			if (!(thiz->decoder = gzdopen (fd, "rb")))
+			{
+				close (fd);
+				goto fail;
+			}
+			gzbuffer ((gzFile) thiz->decoder, 128 * 1024);
+			break;
+			#else
+			goto fail;
+			#endif
+		case AC_STREAM_ZSTD:
+			#ifdef AC_WITH_ZSTD
+			if (!(thiz->decoder = ZSTD_createDStream ()))
+				goto fail;
+			ZSTD_initDStream ((ZSTD_DStream *) thiz->decoder);
+			thiz->inbuf = malloc (ZSTD_DStreamInSize ());
+			break;
+			#else
+			goto fail;
+			#endif
+	}
+
+	if (pages != AC_PAGES_DEFAULT)
+		thiz->region = ac_pages_alloc (AC_STREAM_BLOCKS * AC_STREAM_BLOCK_SIZE * sizeof(ALPHA),
+			pages, &thiz->region_pages);
+
+	for (i=0; i < AC_STREAM_BLOCKS; i++)
+		thiz->blocks[i] = thiz->region ? (ALPHA *) thiz->region + i * AC_STREAM_BLOCK_SIZE :
+			(ALPHA *) malloc (AC_STREAM_BLOCK_SIZE * sizeof(ALPHA));
+
+	pthread_mutex_init (&thiz->lock, NULL);
+	pthread_cond_init (&thiz->filled, NULL);
+	pthread_cond_init (&thiz->freed, NULL);
+
+	if (pthread_create (&thiz->reader, NULL, ac_stream_reader, thiz))
+	{
+		ac_stream_close (thiz);
+		return -1;
+	}
+
+	return 0;
+
+fail:
+	close (thiz->fd);
+	thiz->fd = -1;
+	return -1;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_fill
+
+RETURNS:
+	Number of bytes written to 'buf', 0 at end of input, -1 on error
+
+DESCRIPTION:
+	Read (and decompress) up to 'size' bytes of input into 'buf'.
+	It only returns a short block at the end of input.
+******************************************************************************/
+long ac_stream_fill (AC_STREAM * thiz, ALPHA * buf, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+	#ifdef AC_WITH_ZLIB
+	int err = Z_OK;
+	#endif
+
+	while (done < size)
+	{
+		switch (thiz->format)
+		{
+			case AC_STREAM_PLAIN:
+				n = read (thiz->fd, buf + done, size - done);
+				if (n < 0 && errno == EINTR)
+					continue;
+				break;
+
+			#ifdef AC_WITH_ZLIB
+			case AC_STREAM_GZIP:
+				n = gzread ((gzFile) thiz->decoder, buf + done, size - done);
+				/* A truncated file ends without error from gzread() */
+				if (n == 0)
+					gzerror ((gzFile) thiz->decoder, &err);
+				if (n == 0 && err != Z_OK)
+					n = -1;
+				break;
+			#endif
+
+			#ifdef AC_WITH_ZSTD
+			case AC_STREAM_ZSTD:
+			{
+				ZSTD_inBuffer in = { thiz->inbuf, thiz->in_size, thiz->in_pos };
+				ZSTD_outBuffer out = { buf + done, size - done, 0 };
+				size_t ret;
+
+				if (in.pos == in.size)
+				{
+					n = read (thiz->fd, thiz->inbuf, ZSTD_DStreamInSize ());
+					/* Input ends in the middle of a frame */
+					if (n == 0 && thiz->frame_open)
+						n = -1;
+					if (n <= 0)
+						break;
+					in.size = n;
+					in.pos = 0;
+				}
+
+				ret = ZSTD_decompressStream ((ZSTD_DStream *) thiz->decoder, &out, &in);
+				thiz->in_size = in.size;
+				thiz->in_pos = in.pos;
+				thiz->frame_open = (ret != 0);
+				n = ZSTD_isError (ret) ? -1 : (ssize_t) out.pos;
+				if (!n)
+					continue; /* the decoder needs more input */
+				break;
+			}
+			#endif
+
+			default:
+				n = -1;
+		}
+
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_reader
+
+DESCRIPTION:
+	Body of the reader thread: fill free blocks of the ring until end of
+	input. The block being filled is not visible to the caller.
+******************************************************************************/
+void * ac_stream_reader (void * param)
+{
+	AC_STREAM * thiz = (AC_STREAM *) param;
+	unsigned int tail;
+	int stop;
+	long n;
+
+	for (;;)
+	{
+		pthread_mutex_lock (&thiz->lock);
+		while (thiz->filled_num == AC_STREAM_BLOCKS && !thiz->stop)
+			pthread_cond_wait (&thiz->freed, &thiz->lock);
+		tail = (thiz->head + thiz->filled_num) % AC_STREAM_BLOCKS;
+		stop = thiz->stop;
+		pthread_mutex_unlock (&thiz->lock);
+
+		if (stop)
+			break;
+
+		n = ac_stream_fill (thiz, thiz->blocks[tail], AC_STREAM_BLOCK_SIZE);
+
+		pthread_mutex_lock (&thiz->lock);
+		if (n > 0)
+		{
+			thiz->lengths[tail] = n;
+			thiz->filled_num++;
+		}
+		if (n < (long) AC_STREAM_BLOCK_SIZE)
+		{
+			if (n < 0)
+				thiz->error = 1;
+			else
+				thiz->eof = 1;
+		}
+		pthread_cond_signal (&thiz->filled);
+		pthread_mutex_unlock (&thiz->lock);
+
+		if (thiz->eof || thiz->error)
+			break;
+	}
+
+	return NULL;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_next
+
+RETURNS:
+	1 when a block is returned in 'block'
+	0 at end of input
+	-1 on read or decompression error
+
+DESCRIPTION:
+	Give the next block of (decompressed) input to the caller. The block
+	returned by the previous call is recycled, so the caller must be done
+	with it. Blocks are consecutive, pass them to ac_automata_search() in
+	order and the reported positions are relative to the whole input.
+******************************************************************************/
+int ac_stream_next (AC_STREAM * thiz, STRING * block)
+{
+	int ret;
+
+	pthread_mutex_lock (&thiz->lock);
+
+	if (thiz->held)
+	{
+		thiz->head = (thiz->head + 1) % AC_STREAM_BLOCKS;
+		thiz->filled_num--;
+		thiz->held = 0;
+		pthread_cond_signal (&thiz->freed);
+	}
+
+	while (!thiz->filled_num && !thiz->eof && !thiz->error)
+		pthread_cond_wait (&thiz->filled, &thiz->lock);
+
+	if (thiz->filled_num)
+	{
+		block->str = thiz->blocks[thiz->head];
+		block->length = thiz->lengths[thiz->head];
+		block->id = 0;
+		thiz->held = 1;
+		ret = 1;
+	}
+	else
+		ret = thiz->error ? -1 : 0;
+
+	pthread_mutex_unlock (&thiz->lock);
+
+	return ret;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_stream_close
+
+DESCRIPTION:
+	Stop the reader thread and release all resources of the stream.
+	It may be called before end of input.
+******************************************************************************/
+void ac_stream_close (AC_STREAM * thiz)
+{
+	unsigned int i;
+
+	if (thiz->fd < 0)
+		return;
+
+	pthread_mutex_lock (&thiz->lock);
+	thiz->stop = 1;
+	pthread_cond_signal (&thiz->freed);
+	pthread_mutex_unlock (&thiz->lock);
+
+	if (thiz->reader)
+		pthread_join (thiz->reader, NULL);
+
+	pthread_mutex_destroy (&thiz->lock);
+	pthread_cond_destroy (&thiz->filled);
+	pthread_cond_destroy (&thiz->freed);
+
+	if (thiz->region)
+		ac_pages_free (thiz->region, AC_STREAM_BLOCKS * AC_STREAM_BLOCK_SIZE * sizeof(ALPHA),
+			thiz->region_pages);
+	else
+	{
+		for (i=0; i < AC_STREAM_BLOCKS; i++)
+			free (thiz->blocks[i]);
+	}
+
+	#ifdef AC_WITH_ZLIB
+	if (thiz->format == AC_STREAM_GZIP)
+		gzclose ((gzFile) thiz->decoder);
+	#endif
+	#ifdef AC_WITH_ZSTD
+	if (thiz->format == AC_STREAM_ZSTD)
+		ZSTD_freeDStream ((ZSTD_DStream *) thiz->decoder);
+	#endif
+	free (thiz->inbuf);
+
+	close (thiz->fd);
+	thiz->fd = -1;
+}
@@ -0,0 +1,82 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_STREAM_H_
+#define _AC_STREAM_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "config.h"
+#include "ac_types.h"
+
+/* Size of every input block handed to the caller */
+#define AC_STREAM_BLOCK_SIZE (1 << 20)
+
+/* Number of blocks in the ring shared by the reader thread and the caller */
+#define AC_STREAM_BLOCKS 4
+
+/* Input formats recognized by ac_stream_open() */
+typedef enum
+{
+	AC_STREAM_PLAIN = 0,
+	AC_STREAM_GZIP,
+	AC_STREAM_ZSTD,
+} AC_STREAM_FORMAT;
+
+typedef struct
+/* Input stream: reads (and decompresses) a file on a separate thread and
+   hands it to the caller in blocks, so that ac_automata_search() on one
+   block overlaps with decoding of the next ones. */
+{
+	int fd; /* Input file */
+	AC_STREAM_FORMAT format; /* Detected format of the file */
+	void * decoder; /* Decoder state of the format (gzFile, ZSTD_DStream) */
+	void * inbuf; /* Compressed input buffer (zstd only) */
+	size_t in_size, in_pos; /* Filled and consumed part of 'inbuf' */
+	int frame_open; /* The decoder is in the middle of a frame (zstd only) */
+
+	pthread_t reader; /* Thread which fills the blocks */
+	pthread_mutex_t lock;
+	pthread_cond_t filled; /* Signaled when a block is filled */
+	pthread_cond_t freed; /* Signaled when the caller returns a block */
+
+	/* Ring of blocks, in one region of huge pages with ac_stream_open_ex() */
+	ALPHA * blocks[AC_STREAM_BLOCKS];
+	void * region; /* NULL if the blocks are allocated one by one */
+	AC_PAGES region_pages;
+	size_t lengths[AC_STREAM_BLOCKS];
+	unsigned int head; /* The oldest filled block */
+	unsigned int filled_num; /* Number of filled blocks (including held one) */
+	int held; /* 1: the caller is working on block 'head' */
+
+	int eof; /* The reader has reached end of input */
+	int error; /* The reader has failed */
+	int stop; /* Ask the reader to quit (ac_stream_close) */
+} AC_STREAM;
+
+
+/* Public Functions */
+int  ac_stream_open  (AC_STREAM * thiz, const char * filename);
+int  ac_stream_open_ex (AC_STREAM * thiz, const char * filename, AC_PAGES pages);
+int  ac_stream_next  (AC_STREAM * thiz, STRING * block);
+void ac_stream_close (AC_STREAM * thiz);
+
+#endif
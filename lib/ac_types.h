@@ -26,11 +26,34 @@
    We use fix alpha size in this implementation
    if you are intended to use variable size codings
    you must convert it to a fix one (see iconv library).
+   UTF-8 needs no conversion: patterns and input are searched as bytes,
+   see AC_FOLD_UTF8 and ac_automata_set_codepoints().
 
    define your alpha type in below.
 */
 typedef char ALPHA;
 
+/* Size Profile
+
+   Integer types of the automata come in two profiles.
+   The compact profile (default) keeps nodes small: it allows up to 2^32
+   nodes, patterns of AC_PATTRN_MAX_LENGTH (256) and input chunks of 4 GB.
+   Define AC_PROFILE_LARGE (below in config.h, or build with
+   'make PROFILE=large') for multi-million pattern sets, long patterns and
+   input chunks larger than 4 GB. Library and program must agree on it.
+*/
+#ifdef AC_PROFILE_LARGE
+typedef unsigned long AC_OFFSET; /* Lengths of strings and input chunks */
+typedef unsigned int  AC_COUNT;  /* Depth, out-degree and match list sizes of a node */
+typedef unsigned long AC_INDEX;  /* Number and IDs of nodes */
+#define AC_PATTRN_MAX_LENGTH (1 << 20)
+#else
+typedef unsigned int   AC_OFFSET;
+typedef unsigned short AC_COUNT;
+typedef unsigned int   AC_INDEX;
+#define AC_PATTRN_MAX_LENGTH 256
+#endif
+
 /* String Identifier 
 
    Every string may have an identifier to distinguish it
@@ -44,12 +67,43 @@ typedef unsigned long STRINGID;
 typedef struct
 {
 	ALPHA * str; /* Array of ALPHAs */
-	unsigned int length; /* Length of string */
+	AC_OFFSET length; /* Length of string */
 	STRINGID id; /* String identifier (Optional) */
 } STRING;
 
-/* Maximum Pattern Length */
-#define AC_PATTRN_MAX_LENGTH 256
+/* Boundary Flags
+
+   A string added by ac_automata_add_string_ex() with any of these flags
+   is only reported where the input around it satisfies them. The checks
+   are done inside the search loop and failing strings never reach the
+   callback. Word alphas are letters, digits, '_' and bytes above 0x7F.
+   Start and end of input count as boundaries; because of the right side
+   checks, a match ending a chunk is reported when the next chunk comes,
+   so finish the input with a zero length chunk.
+*/
+#define AC_BOUND_WORD_LEFT  0x01 /* Not preceded by a word alpha */
+#define AC_BOUND_WORD_RIGHT 0x02 /* Not followed by a word alpha */
+#define AC_BOUND_WORD       (AC_BOUND_WORD_LEFT | AC_BOUND_WORD_RIGHT)
+#define AC_BOUND_LINE_START 0x04 /* At the start of a line */
+#define AC_BOUND_LINE_END   0x08 /* At the end of a line */
+#define AC_BOUND_LINE       (AC_BOUND_LINE_START | AC_BOUND_LINE_END)
+
+/* Maximum length of a bounded string, and of any string when a leftmost
+   semantics is selected: both look back at this much of the input */
+#define AC_BOUND_MAX_LENGTH 256
+
+/* Groups
+
+   Strings may belong to groups, e.g. one group per tenant, so that the
+   pattern sets of many tenants are searched together in one automata and
+   one pass. Every node keeps the set of groups of its strings as a bit
+   mask, and a search reports only the groups it selects (see
+   ac_automata_select_groups).
+*/
+typedef unsigned long long AC_GROUPS;
+#define AC_GROUP_MAX 64
+#define AC_GROUP(g) ((AC_GROUPS) 1 << (g)) /* The set of group g */
+#define AC_GROUPS_ALL (~(AC_GROUPS) 0)
 
 /* Any Match is Reported in the following structure */
 typedef struct
@@ -61,6 +115,8 @@ typedef struct
 	long position;
 	/* Number of matched string (length of sid array) */
 	unsigned int match_num;
+	/* Matched Position in UTF-8 code points (see ac_automata_set_codepoints) */
+	unsigned long cp_position;
 } MATCH;
 
 /* MATCH_CALBACK: 
@@ -70,6 +126,62 @@ typedef struct
 */
 typedef int (*MATCH_CALBACK)(MATCH *, int, int);
 
+/* Case Folding
+
+   With folding, patterns are matched regardless of letter case. Patterns
+   are folded to lower case while being added and the upper case alphas
+   are added as extra edges of the trie, so the search loop costs the same.
+   AC_FOLD_LATIN1 also folds the ISO-8859-1 letters (0xC0-0xDE).
+   AC_FOLD_UTF8 takes patterns as UTF-8 and applies simple Unicode case
+   folding (see ac_utf8.c for the covered scripts) to case pairs of the
+   same UTF-8 length; the input is still searched byte by byte.
+*/
+typedef enum
+{
+	AC_FOLD_NONE = 0,
+	AC_FOLD_ASCII,
+	AC_FOLD_LATIN1,
+	AC_FOLD_UTF8,
+} AC_FOLD;
+
+/* Match Semantics
+
+   By default every occurrence of every string is reported, overlapping
+   ones included. The leftmost semantics report non-overlapping matches
+   only, scanning left to right: of the strings starting at the leftmost
+   position the longest one (AC_SEMANTICS_LEFTMOST_LONGEST) or the one
+   added first (AC_SEMANTICS_LEFTMOST_FIRST) is reported, one string per
+   MATCH, and the search goes on right after it. A match is reported once
+   no later one can start at or before it, so the search may report it
+   up to AC_BOUND_MAX_LENGTH alphas late, in the next chunk; finish the
+   input with a zero length chunk.
+*/
+typedef enum
+{
+	AC_SEMANTICS_OVERLAPPING = 0,
+	AC_SEMANTICS_LEFTMOST_LONGEST,
+	AC_SEMANTICS_LEFTMOST_FIRST,
+} AC_SEMANTICS;
+
+/* Memory Pages
+
+   By default every node and edge table of the automata is allocated on
+   its own. With AC_PAGES_PACKED, ac_automata_locate_failure() moves all
+   of them, in node order, into one region of memory; AC_PAGES_HUGE asks
+   the kernel to back that region with transparent huge pages (2 MB on
+   x86-64), and AC_PAGES_HUGETLB takes them from the reserved pool
+   (MAP_HUGETLB), so a large automata needs far fewer TLB entries. What is
+   not available falls back to the next mode down, AC_PAGES_PACKED at
+   least; see ac_pages.h.
+*/
+typedef enum
+{
+	AC_PAGES_DEFAULT = 0,
+	AC_PAGES_PACKED,
+	AC_PAGES_HUGE,
+	AC_PAGES_HUGETLB,
+} AC_PAGES;
+
 /* Error Numbers */
 typedef enum
 {
@@ -78,6 +190,10 @@ typedef enum
 	ACERR_LONG_STRING,
 	ACERR_ZERO_STRING,
 	ACERR_STRING_CLOSED,
+	ACERR_GROUP,
+	ACERR_UNSUPPORTED, /* Not available in this build or on this system */
+	ACERR_SYSTEM, /* A system call failed, see errno */
+	ACERR_PARTIAL_STRING, /* AC_FOLD_UTF8: starts inside a code point */
 } AC_ERROR;
 
 #endif
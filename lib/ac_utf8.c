@@ -0,0 +1,252 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ac_utf8.h"
+
+struct ac_utf8_rule
+/* Code points first, first + step, ... last fold to themselves + delta */
+{
+	unsigned long first;
+	unsigned long last;
+	long delta;
+	unsigned int step;
+};
+
+/* Simple case folding (CaseFolding.txt, status C and S) of the Latin,
+   Greek, Cyrillic, Armenian and Georgian scripts and a few symbol blocks.
+   Scripts with irregular pairs (Latin Extended-B outside the listed
+   runs, Greek Extended, Cherokee) are not folded. */
+static const struct ac_utf8_rule ac_utf8_rules[] = {
+	{ 0x0041, 0x005A, 32, 1 },
+	{ 0x00B5, 0x00B5, 0x03BC - 0x00B5, 1 },
+	{ 0x00C0, 0x00D6, 32, 1 },
+	{ 0x00D8, 0x00DE, 32, 1 },
+	{ 0x0100, 0x012E, 1, 2 },
+	{ 0x0132, 0x0136, 1, 2 },
+	{ 0x0139, 0x0147, 1, 2 },
+	{ 0x014A, 0x0176, 1, 2 },
+	{ 0x0178, 0x0178, 0x00FF - 0x0178, 1 },
+	{ 0x0179, 0x017D, 1, 2 },
+	{ 0x017F, 0x017F, 0x0073 - 0x017F, 1 },
+	{ 0x01CD, 0x01DB, 1, 2 },
+	{ 0x01DE, 0x01EE, 1, 2 },
+	{ 0x01F8, 0x021E, 1, 2 },
+	{ 0x0222, 0x0232, 1, 2 },
+	{ 0x0386, 0x0386, 38, 1 },
+	{ 0x0388, 0x038A, 37, 1 },
+	{ 0x038C, 0x038C, 64, 1 },
+	{ 0x038E, 0x038F, 63, 1 },
+	{ 0x0391, 0x03A1, 32, 1 },
+	{ 0x03A3, 0x03AB, 32, 1 },
+	{ 0x03C2, 0x03C2, 1, 1 },
+	{ 0x03D0, 0x03D0, 0x03B2 - 0x03D0, 1 },
+	{ 0x03D1, 0x03D1, 0x03B8 - 0x03D1, 1 },
+	{ 0x03D5, 0x03D5, 0x03C6 - 0x03D5, 1 },
+	{ 0x03D6, 0x03D6, 0x03C0 - 0x03D6, 1 },
+	{ 0x03D8, 0x03EE, 1, 2 },
+	{ 0x03F0, 0x03F0, 0x03BA - 0x03F0, 1 },
+	{ 0x03F1, 0x03F1, 0x03C1 - 0x03F1, 1 },
+	{ 0x03F5, 0x03F5, 0x03B5 - 0x03F5, 1 },
+	{ 0x0400, 0x040F, 80, 1 },
+	{ 0x0410, 0x042F, 32, 1 },
+	{ 0x0460, 0x0480, 1, 2 },
+	{ 0x048A, 0x04BE, 1, 2 },
+	{ 0x04C0, 0x04C0, 15, 1 },
+	{ 0x04C1, 0x04CD, 1, 2 },
+	{ 0x04D0, 0x052E, 1, 2 },
+	{ 0x0531, 0x0556, 48, 1 },
+	{ 0x10A0, 0x10C5, 0x2D00 - 0x10A0, 1 },
+	{ 0x1E00, 0x1E94, 1, 2 },
+	{ 0x1E9B, 0x1E9B, 0x1E61 - 0x1E9B, 1 },
+	{ 0x1E9E, 0x1E9E, 0x00DF - 0x1E9E, 1 },
+	{ 0x1EA0, 0x1EFE, 1, 2 },
+	{ 0x2126, 0x2126, 0x03C9 - 0x2126, 1 },
+	{ 0x212A, 0x212A, 0x006B - 0x212A, 1 },
+	{ 0x212B, 0x212B, 0x00E5 - 0x212B, 1 },
+	{ 0x2160, 0x216F, 16, 1 },
+	{ 0x24B6, 0x24CF, 26, 1 },
+	{ 0x2C00, 0x2C2F, 48, 1 },
+	{ 0xFF21, 0xFF3A, 32, 1 },
+	{ 0x10400, 0x10427, 40, 1 },
+};
+
+#define AC_UTF8_RULES (sizeof(ac_utf8_rules) / sizeof(ac_utf8_rules[0]))
+
+
+
+/******************************************************************************
+FUNCTION: ac_utf8_decode
+
+RETURNS:
+	Length of the UTF-8 sequence at 'str', 0 if it is not a valid one
+
+DESCRIPTION:
+	Decode one code point into 'cp'. Overlong sequences, surrogates and
+	truncated sequences are invalid.
+******************************************************************************/
+AC_OFFSET ac_utf8_decode (const ALPHA * str, AC_OFFSET length, unsigned long * cp)
+{
+	const unsigned char * s = (const unsigned char *) str;
+	static const unsigned long min[AC_UTF8_MAX + 1] = { 0, 0, 0x80, 0x800, 0x10000 };
+	AC_OFFSET n, i;
+
+	if (!length)
+		return 0;
+
+	if (s[0] < 0x80)
+	{
+		*cp = s[0];
+		return 1;
+	}
+	else if ((s[0] & 0xE0) == 0xC0)
+	{
+		n = 2;
+		*cp = s[0] & 0x1F;
+	}
+	else if ((s[0] & 0xF0) == 0xE0)
+	{
+		n = 3;
+		*cp = s[0] & 0x0F;
+	}
+	else if ((s[0] & 0xF8) == 0xF0)
+	{
+		n = 4;
+		*cp = s[0] & 0x07;
+	}
+	else
+		return 0;
+
+	if (n > length)
+		return 0;
+
+	for (i=1; i < n; i++)
+	{
+		if ((s[i] & 0xC0) != 0x80)
+			return 0;
+		*cp = (*cp << 6) | (s[i] & 0x3F);
+	}
+
+	if (*cp < min[n] || *cp > 0x10FFFF || (*cp >= 0xD800 && *cp <= 0xDFFF))
+		return 0;
+
+	return n;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_utf8_encode
+
+RETURNS:
+	Length of the UTF-8 sequence written at 'out' (at most AC_UTF8_MAX)
+******************************************************************************/
+unsigned int ac_utf8_encode (unsigned long cp, ALPHA * out)
+{
+	unsigned char * o = (unsigned char *) out;
+
+	if (cp < 0x80)
+	{
+		o[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800)
+	{
+		o[0] = 0xC0 | (cp >> 6);
+		o[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	}
+	if (cp < 0x10000)
+	{
+		o[0] = 0xE0 | (cp >> 12);
+		o[1] = 0x80 | ((cp >> 6) & 0x3F);
+		o[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	o[0] = 0xF0 | (cp >> 18);
+	o[1] = 0x80 | ((cp >> 12) & 0x3F);
+	o[2] = 0x80 | ((cp >> 6) & 0x3F);
+	o[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_utf8_fold
+
+RETURNS:
+	The simple case folding of the code point (itself if it has none)
+******************************************************************************/
+unsigned long ac_utf8_fold (unsigned long cp)
+{
+	unsigned int i;
+
+	for (i=0; i < AC_UTF8_RULES; i++)
+	{
+		if (cp >= ac_utf8_rules[i].first && cp <= ac_utf8_rules[i].last &&
+				(cp - ac_utf8_rules[i].first) % ac_utf8_rules[i].step == 0)
+			return cp + ac_utf8_rules[i].delta;
+	}
+
+	return cp;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_utf8_variants
+
+PARAMS:
+	unsigned long folded: A folded code point
+	unsigned long * variants: Array of AC_UTF8_VARIANTS code points
+
+RETURNS:
+	Number of the other code points which fold to 'folded'
+******************************************************************************/
+unsigned int ac_utf8_variants (unsigned long folded, unsigned long * variants)
+{
+	unsigned int i, num = 0;
+	unsigned long cp;
+
+	for (i=0; i < AC_UTF8_RULES && num < AC_UTF8_VARIANTS; i++)
+	{
+		cp = folded - ac_utf8_rules[i].delta;
+
+		if (cp >= ac_utf8_rules[i].first && cp <= ac_utf8_rules[i].last &&
+				(cp - ac_utf8_rules[i].first) % ac_utf8_rules[i].step == 0)
+			variants[num++] = cp;
+	}
+
+	return num;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_utf8_count
+
+RETURNS:
+	Number of code points starting in the given alphas
+******************************************************************************/
+unsigned long ac_utf8_count (const ALPHA * str, unsigned long length)
+{
+	unsigned long i, num = 0;
+
+	for (i=0; i < length; i++)
+		num += AC_UTF8_LEAD(str[i]);
+
+	return num;
+}
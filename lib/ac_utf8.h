@@ -0,0 +1,44 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_UTF8_H_
+#define _AC_UTF8_H_
+
+#include "config.h"
+#include "ac_types.h"
+
+/* Longest UTF-8 sequence */
+#define AC_UTF8_MAX 4
+
+/* Most code points folding to the same one (e.g. 'S', 's' and U+017F) */
+#define AC_UTF8_VARIANTS 4
+
+/* 1 if the alpha starts a code point (is not a continuation byte) */
+#define AC_UTF8_LEAD(a) (((unsigned char) (a) & 0xC0) != 0x80)
+
+
+/* Public Functions */
+AC_OFFSET    ac_utf8_decode   (const ALPHA * str, AC_OFFSET length, unsigned long * cp);
+unsigned int ac_utf8_encode   (unsigned long cp, ALPHA * out);
+unsigned long ac_utf8_fold    (unsigned long cp);
+unsigned int ac_utf8_variants (unsigned long folded, unsigned long * variants);
+unsigned long ac_utf8_count   (const ALPHA * str, unsigned long length);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ac_wm.h"
+
+/* The node is where a string ends */
+#define AC_WM_OWN_STRING(n) ((n)->outputs_num && \
+	patterns[outputs[(n)->outputs]].length == (n)->depth)
+
+
+
+/******************************************************************************
+FUNCTION: ac_wm_build
+
+PARAMS:
+	NODE ** nodes: All nodes of a located automata
+	STRING * patterns: Its pattern table
+	AC_INDEX * outputs: Its output pool, of indices in 'patterns'
+
+RETURNS:
+	The tables, or NULL if a string is too short or too long for them
+
+DESCRIPTION:
+	Every string is taken from the node where it ends, i.e. where its
+	length is the depth of the node. A node's own strings are registered
+	before the ones of its failure nodes, so it is the first one; the
+	same string of other groups is only needed once.
+******************************************************************************/
+AC_WM * ac_wm_build (NODE ** nodes, AC_INDEX nodes_num, STRING * patterns,
+		AC_INDEX * outputs)
+{
+	AC_WM * thiz;
+	AC_INDEX i, num = 0, * fill;
+	AC_OFFSET q, m;
+	NODE * n;
+	const unsigned char * s;
+	unsigned int h;
+
+	thiz = (AC_WM *) calloc (1, sizeof(AC_WM));
+	thiz->shortest = AC_PATTRN_MAX_LENGTH;
+
+	for (i=0; i < nodes_num; i++)
+	{
+		if (!AC_WM_OWN_STRING(nodes[i]))
+			continue;
+		n = nodes[i];
+		if (n->depth < thiz->shortest)
+			thiz->shortest = n->depth;
+		if (n->depth > thiz->longest)
+			thiz->longest = n->depth;
+		thiz->groups |= n->groups;
+		num++;
+	}
+
+	if (!num || thiz->shortest < AC_WM_MIN_LENGTH || thiz->longest > AC_BOUND_MAX_LENGTH)
+	{
+		free (thiz);
+		return NULL;
+	}
+
+	m = thiz->shortest;
+	memset (thiz->shift, m - AC_WM_BLOCK + 1, sizeof(thiz->shift));
+
+	/* Shifts of the blocks of every window, and sizes of the buckets */
+	for (i=0; i < nodes_num; i++)
+	{
+		if (!AC_WM_OWN_STRING(nodes[i]))
+			continue;
+		n = nodes[i];
+
+		s = (const unsigned char *) patterns[outputs[n->outputs]].str;
+		for (q = AC_WM_BLOCK; q <= m; q++)
+		{
+			h = AC_WM_HASH(s + q - AC_WM_BLOCK);
+			if (thiz->shift[h] > m - q)
+				thiz->shift[h] = m - q;
+		}
+		thiz->bucket[AC_WM_HASH(s + m - AC_WM_BLOCK) + 1]++;
+	}
+
+	for (h=0; h < AC_WM_TABLE; h++)
+		thiz->bucket[h + 1] += thiz->bucket[h];
+
+	thiz->entries = (struct ac_wm_entry *) malloc (num * sizeof(struct ac_wm_entry));
+	fill = (AC_INDEX *) malloc (AC_WM_TABLE * sizeof(AC_INDEX));
+	memcpy (fill, thiz->bucket, AC_WM_TABLE * sizeof(AC_INDEX));
+
+	for (i=0; i < nodes_num; i++)
+	{
+		if (!AC_WM_OWN_STRING(nodes[i]))
+			continue;
+		n = nodes[i];
+
+		s = (const unsigned char *) patterns[outputs[n->outputs]].str;
+		h = AC_WM_HASH(s + m - AC_WM_BLOCK);
+		thiz->entries[fill[h]].str = patterns[outputs[n->outputs]].str;
+		thiz->entries[fill[h]].length = n->depth;
+		thiz->entries[fill[h]].prefix = AC_WM_PREFIX(s);
+		thiz->entries[fill[h]].node = n;
+		fill[h]++;
+	}
+
+	free (fill);
+
+	return thiz;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_wm_release
+******************************************************************************/
+void ac_wm_release (AC_WM * thiz)
+{
+	if (!thiz)
+		return;
+
+	free (thiz->entries);
+	free (thiz);
+}
@@ -0,0 +1,78 @@
+/*
+	Copyright 2010-2011 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    This file is part of multifast.
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AC_WM_H_
+#define _AC_WM_H_
+
+#include "config.h"
+#include "ac_types.h"
+#include "node.h"
+
+/* Wu-Manber tables
+
+   When all strings are long, the search skips ahead over the input: a
+   window of the length of the shortest string is moved along it, and the
+   last AC_WM_BLOCK alphas of the window tell how far it can move before a
+   string may end in it. Only where it can not move are strings compared.
+   ac_automata_locate_failure() builds these tables when every string is
+   at least AC_WM_MIN_LENGTH (and at most AC_BOUND_MAX_LENGTH) long.
+*/
+#define AC_WM_MIN_LENGTH 16
+#define AC_WM_BLOCK 3
+#define AC_WM_TABLE_BITS 15
+#define AC_WM_TABLE (1 << AC_WM_TABLE_BITS)
+
+/* Hash of the AC_WM_BLOCK alphas at 'p' */
+#define AC_WM_HASH(p) ((((unsigned int) (p)[0] << 7) ^ ((unsigned int) (p)[1] << 3) ^ \
+	(unsigned int) (p)[2]) & (AC_WM_TABLE - 1))
+
+/* The first two alphas at 'p', to filter strings before comparing them */
+#define AC_WM_PREFIX(p) ((unsigned short) ((p)[0] | ((p)[1] << 8)))
+
+struct ac_wm_entry
+{
+	const ALPHA * str;
+	AC_OFFSET length;
+	unsigned short prefix; /* AC_WM_PREFIX of the string */
+	NODE * node; /* Node of the string: its matched strings are reported */
+};
+
+typedef struct ac_wm
+{
+	AC_OFFSET shortest; /* Length of the window */
+	AC_OFFSET longest;
+	AC_GROUPS groups; /* Groups of all strings */
+
+	/* How far the window may move when its last block has this hash */
+	unsigned char shift[AC_WM_TABLE];
+
+	/* Strings whose window ends in a block of hash h (shift 0) are
+	   entries[bucket[h]] to entries[bucket[h+1] - 1] */
+	AC_INDEX bucket[AC_WM_TABLE + 1];
+	struct ac_wm_entry * entries;
+} AC_WM;
+
+
+/* Public Functions */
+AC_WM * ac_wm_build   (NODE ** nodes, AC_INDEX nodes_num, STRING * patterns,
+                       AC_INDEX * outputs);
+void    ac_wm_release (AC_WM * thiz);
+
+#endif
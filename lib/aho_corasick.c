@@ -18,21 +18,39 @@
 
 */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "aho_corasick.h"
+#include "ac_pages.h"
+#include "ac_utf8.h"
 
-/* Allocation step for automata::all_nodes array */
+/* Initial capacity of automata::all_nodes array; it doubles when full */
 #define REALLOC_CHUNK_ALLNODES 200
 
+/* Initial capacity of the pattern table and of the output pool; they
+   double when full */
+#define REALLOC_CHUNK_PATTERNS 64
+
 
 /* Private Functions */
 void   ac_automata_register_nodeptr  (AC_AUTOMATA * thiz, NODE * node);
-void   ac_automata_set_failure       (AC_AUTOMATA * thiz, NODE * node, ALPHA * alphas);
-void   ac_automata_dfs_traverse      (AC_AUTOMATA * thiz, NODE * node, ALPHA * alphas);
-void   ac_automata_union_matchstrs   (NODE * node);
+void   ac_automata_set_failure       (AC_AUTOMATA * thiz, NODE * node, NODE * parent, ALPHA alpha);
+void   ac_automata_bfs_traverse      (AC_AUTOMATA * thiz, AC_INDEX * own, AC_INDEX * own_begin);
+void   ac_automata_register_pattern  (AC_AUTOMATA * thiz, STRING * str, NODE * node,
+                                      unsigned int flags, unsigned int group);
+void   ac_automata_collect_outputs   (AC_AUTOMATA * thiz, NODE * node, AC_INDEX * own,
+                                      AC_INDEX own_num);
+ALPHA  ac_automata_fold_alpha        (AC_FOLD fold, ALPHA alpha);
+void   ac_automata_fold_edges        (AC_AUTOMATA * thiz, NODE * node);
+void   ac_automata_pack              (AC_AUTOMATA * thiz);
+void   ac_automata_keep_history      (AC_AUTOMATA * thiz, STRING * str, unsigned long consumed);
+STRING * ac_automata_match_strings   (AC_AUTOMATA * thiz, AC_INDEX num);
+NODE * ac_automata_next_node         (AC_AUTOMATA * thiz, NODE * node, ALPHA alpha);
+NODE * ac_automata_utf8_step         (AC_AUTOMATA * thiz, NODE * node, unsigned long cp,
+                                      AC_OFFSET length);
 
 
 
@@ -49,6 +67,7 @@ void ac_automata_init (AC_AUTOMATA * thiz, MATCH_CALBACK mc)
 {
 	memset (thiz, 0, sizeof(AC_AUTOMATA));
 	thiz->root = node_create ();
+	thiz->groups = AC_GROUPS_ALL;
 	thiz->all_nodes_max = REALLOC_CHUNK_ALLNODES;
 	thiz->all_nodes = (NODE **) malloc (thiz->all_nodes_max*sizeof(NODE *));
 	thiz->match_callback = mc;
@@ -70,6 +89,60 @@ void ac_automata_reset (AC_AUTOMATA * thiz)
 {
 	thiz->current_node = thiz->root;
 	thiz->base_position = 0;
+	thiz->pending_node = NULL;
+	thiz->history_len = 0;
+	thiz->candidate = NULL;
+	thiz->cp_mark = 0;
+	thiz->cp_count = 0;
+	thiz->wm_next = 0;
+	thiz->wm_verified = 0;
+	if (thiz->wm_pending_num)
+		memset (thiz->wm_pending, 0, sizeof(thiz->wm_pending));
+	thiz->wm_pending_num = 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_view
+
+PARAMS:
+	AC_AUTOMATA * view: The view to be initialized
+	AC_AUTOMATA * origin: A located (see ac_automata_locate_failure) automata
+	MATCH_CALBACK mc: callback function of the view, NULL to use origin's
+
+DESCRIPTION:
+	Make a view of the automata: it shares the nodes of 'origin' but has its
+	own search state, so many threads can search the same automata at the
+	same time, each through its own view. A view must not be passed to
+	ac_automata_add_string() or ac_automata_release(); it becomes invalid
+	when 'origin' is released. Drop it with ac_automata_view_release().
+******************************************************************************/
+void ac_automata_view (AC_AUTOMATA * view, AC_AUTOMATA * origin, MATCH_CALBACK mc)
+{
+	*view = *origin;
+	view->perf.on = 0; /* Counters are per thread */
+	view->match_strings = NULL; /* And so are the reported strings */
+	view->match_strings_max = 0;
+	if (mc)
+		view->match_callback = mc;
+	ac_automata_reset (view);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_view_release
+
+DESCRIPTION:
+	Release what a view of ac_automata_view() has of its own: the matched
+	strings of its reports and its hardware counters. The automata it
+	views is not touched.
+******************************************************************************/
+void ac_automata_view_release (AC_AUTOMATA * view)
+{
+	free (view->match_strings);
+	view->match_strings = NULL;
+	view->match_strings_max = 0;
+	ac_perf_close (&view->perf);
 }
 
 
@@ -83,34 +156,231 @@ void ac_automata_register_nodeptr (AC_AUTOMATA * thiz, NODE * node)
 {
 	if(thiz->all_nodes_num >= thiz->all_nodes_max)
 	{
-		thiz->all_nodes_max += REALLOC_CHUNK_ALLNODES;
+		thiz->all_nodes_max *= 2;
 		thiz->all_nodes = realloc (thiz->all_nodes, thiz->all_nodes_max*sizeof(NODE *));
 	}
 
+	node->id = thiz->all_nodes_num;
 	thiz->all_nodes[thiz->all_nodes_num++] = node;
 }
 
 
+/******************************************************************************
+FUNCTION: ac_automata_set_fold
+
+RETURNS:
+	ACERR_NONE on success
+	ACERR_STRING_CLOSED when strings are already added
+
+DESCRIPTION:
+	Select case folding mode (see AC_FOLD). It must be called before
+	adding the first string.
+******************************************************************************/
+AC_ERROR ac_automata_set_fold (AC_AUTOMATA * thiz, AC_FOLD fold)
+{
+	if (!thiz->accept_strings || thiz->total_strings)
+		return ACERR_STRING_CLOSED;
+
+	thiz->fold = fold;
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_set_semantics
+
+RETURNS:
+	ACERR_NONE on success
+	ACERR_STRING_CLOSED when strings are already added
+
+DESCRIPTION:
+	Select which matches are reported (see AC_SEMANTICS). It must be
+	called before adding the first string.
+******************************************************************************/
+AC_ERROR ac_automata_set_semantics (AC_AUTOMATA * thiz, AC_SEMANTICS semantics)
+{
+	if (!thiz->accept_strings || thiz->total_strings)
+		return ACERR_STRING_CLOSED;
+
+	thiz->semantics = semantics;
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_set_pages
+
+RETURNS:
+	ACERR_NONE on success
+	ACERR_STRING_CLOSED when the automata is already located
+
+DESCRIPTION:
+	Select the memory pages of the nodes (see AC_PAGES). It must be called
+	before ac_automata_locate_failure(), which packs the nodes.
+******************************************************************************/
+AC_ERROR ac_automata_set_pages (AC_AUTOMATA * thiz, AC_PAGES pages)
+{
+	if (!thiz->accept_strings)
+		return ACERR_STRING_CLOSED;
+
+	thiz->pages = pages;
+
+	return ACERR_NONE;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_select_groups
+
+DESCRIPTION:
+	Report only strings of the given groups (bit AC_GROUP(g) for group g)
+	from now on. Unselected strings cost nothing unless they share a
+	final node with selected ones. It may be changed between searches;
+	every view has its own selection, initially the one of its origin.
+******************************************************************************/
+void ac_automata_select_groups (AC_AUTOMATA * thiz, AC_GROUPS groups)
+{
+	thiz->groups = groups;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_set_codepoints
+
+DESCRIPTION:
+	With 'on' set, matches also get their position in UTF-8 code points
+	(MATCH::cp_position). Code points are counted lazily, only up to the
+	matches and the chunk ends, so it costs one pass over the input.
+	Select it before the search starts.
+******************************************************************************/
+void ac_automata_set_codepoints (AC_AUTOMATA * thiz, int on)
+{
+	thiz->codepoints = on;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_fold_alpha
+
+DESCRIPTION:
+	Return lower case of the alpha according to the folding mode.
+******************************************************************************/
+ALPHA ac_automata_fold_alpha (AC_FOLD fold, ALPHA alpha)
+{
+	unsigned char c = (unsigned char) alpha;
+
+	if (fold == AC_FOLD_NONE)
+		return alpha;
+
+	if (c >= 'A' && c <= 'Z')
+		return (ALPHA) (c + 32);
+
+	if (fold == AC_FOLD_LATIN1 && c >= 0xC0 && c <= 0xDE && c != 0xD7)
+		return (ALPHA) (c + 32);
+
+	return alpha;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_fold_string
+
+PARAMS:
+	AC_FOLD fold: The folding mode
+	STRING * str: The string to fold
+	ALPHA * folded: Receives str->length alphas
+
+DESCRIPTION:
+	Write the alphas of the path ac_automata_add_string() adds for the
+	string with this folding. Strings of the same folded form are
+	duplicates of each other, e.g. for splitting a pattern set.
+******************************************************************************/
+void ac_automata_fold_string (AC_FOLD fold, STRING * str, ALPHA * folded)
+{
+	ALPHA bytes[AC_UTF8_MAX];
+	unsigned long cp, f;
+	AC_OFFSET i, len;
+
+	for (i=0; i<str->length; )
+	{
+		if (fold == AC_FOLD_UTF8 &&
+			(len = ac_utf8_decode (str->str + i, str->length - i, &cp)))
+		{
+			/* As ac_automata_utf8_step() */
+			f = ac_utf8_fold (cp);
+			if (ac_utf8_encode (f, bytes) != len)
+				ac_utf8_encode (cp, bytes);
+			memcpy (folded + i, bytes, len);
+			i += len;
+			continue;
+		}
+
+		folded[i] = ac_automata_fold_alpha (fold, str->str[i]);
+		i++;
+	}
+}
+
+
 /******************************************************************************
 FUNCTION: ac_automata_add_string
 
+DESCRIPTION:
+	Add string to the automata, without boundary conditions.
+	See ac_automata_add_string_ex().
+******************************************************************************/
+AC_ERROR ac_automata_add_string (AC_AUTOMATA * thiz, STRING * str)
+{
+	return ac_automata_add_string_ex (thiz, str, 0);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_add_string_ex
+
+DESCRIPTION:
+	Add string with boundary flags to group 0.
+	See ac_automata_add_string_group().
+******************************************************************************/
+AC_ERROR ac_automata_add_string_ex (AC_AUTOMATA * thiz, STRING * str, unsigned int flags)
+{
+	return ac_automata_add_string_group (thiz, str, 0, flags);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_add_string_group
+
+PARAMS:
+	unsigned int group: Group (tenant) of the string, below AC_GROUP_MAX
+	unsigned int flags: AC_BOUND_* flags; the string is only reported
+	                    where the surrounding input satisfies them
+
 RETUERNS:
 	ACERR_NONE on success
-	ACERR_LONG_STRING when string length is longer than AC_PATTRN_MAX_LENGTH
-	ACERR_DUPLICATE_STRING on duplicte strings
+	ACERR_LONG_STRING when string length is longer than AC_PATTRN_MAX_LENGTH,
+	                  or than AC_BOUND_MAX_LENGTH for a bounded string or
+	                  under a leftmost semantics
+	ACERR_DUPLICATE_STRING on duplicte strings in the same group
 	ACERR_ZERO_STRING on zero length string
+	ACERR_GROUP when group is not below AC_GROUP_MAX
+	ACERR_PARTIAL_STRING with AC_FOLD_UTF8, when the string starts with a
+	                  continuation byte
 
 DESCRIPTION:
-	Add string to the automata.
+	Add string to the automata. The same string may be added to several
+	groups; every copy is reported as a separate matched string.
 	CAUTION: If the given string be larger than AC_PATTRN_MAX_LENGTH, it will
 	be cropped without any warning.
 ******************************************************************************/
-AC_ERROR ac_automata_add_string (AC_AUTOMATA * thiz, STRING * str)
+AC_ERROR ac_automata_add_string_group (AC_AUTOMATA * thiz, STRING * str,
+		unsigned int group, unsigned int flags)
 {
-	unsigned int i;
+	AC_OFFSET i, len;
 	NODE * n = thiz->root;
-	NODE * next;
 	ALPHA alpha;
+	unsigned long cp;
 
 	if(!thiz->accept_strings)
 		return ACERR_STRING_CLOSED;
@@ -118,31 +388,44 @@ AC_ERROR ac_automata_add_string (AC_AUTOMATA * thiz, STRING * str)
 	if (!str->length)
 		return ACERR_ZERO_STRING;
 
+	if (group >= AC_GROUP_MAX)
+		return ACERR_GROUP;
+
 	if (str->length > AC_PATTRN_MAX_LENGTH)
 		return ACERR_LONG_STRING;
 
-	for (i=0; i<str->length; i++)
+	if ((flags || thiz->semantics) && str->length > AC_BOUND_MAX_LENGTH)
+		return ACERR_LONG_STRING;
+
+	/* Such a string would be a suffix of one byte path of a code point but
+	   not of its case variants, which share their last node */
+	if (thiz->fold == AC_FOLD_UTF8 && !AC_UTF8_LEAD(str->str[0]))
+		return ACERR_PARTIAL_STRING;
+
+	for (i=0; i<str->length; )
 	{
-		alpha = str->str[i];
-		if ((next = node_find_next(n, alpha)))
+		/* Valid UTF-8 sequences are folded as code points, other
+		   alphas are taken as they are */
+		if (thiz->fold == AC_FOLD_UTF8 &&
+			(len = ac_utf8_decode (str->str + i, str->length - i, &cp)))
 		{
-			n = next;
+			n = ac_automata_utf8_step (thiz, n, cp, len);
+			i += len;
 			continue;
 		}
-		else
-		{
-			next = node_create_next(n, alpha);
-			next->depth = n->depth + 1;
-			n = next;
-			ac_automata_register_nodeptr(thiz, n);
-		}
+
+		alpha = ac_automata_fold_alpha (thiz->fold, str->str[i++]);
+		n = ac_automata_next_node (thiz, n, alpha);
 	}
 
-	if(n->final)
+	if(n->final && (n->groups & AC_GROUP(group)))
 		return ACERR_DUPLICATE_STRING;
 
 	n->final = 1;
-	node_register_matchstr(n, str);
+	n->bound |= flags;
+	n->groups |= AC_GROUP(group);
+	ac_automata_register_pattern (thiz, str, n, flags, group);
+	thiz->bounded |= flags;
 	thiz->total_strings++;
 
 	return ACERR_NONE;
@@ -150,183 +433,1478 @@ AC_ERROR ac_automata_add_string (AC_AUTOMATA * thiz, STRING * str)
 
 
 /******************************************************************************
-FUNCTION: ac_automata_release
+FUNCTION: ac_automata_next_node
 
 DESCRIPTION:
-	Release all alocated memories to the automata
+	Return the node reached from 'node' by 'alpha', creating it if needed.
 ******************************************************************************/
-void ac_automata_release (AC_AUTOMATA * thiz)
+NODE * ac_automata_next_node (AC_AUTOMATA * thiz, NODE * node, ALPHA alpha)
 {
-	unsigned int i;
-	NODE * n;
+	NODE * next;
 
-	for (i=0; i < thiz->all_nodes_num; i++)
-	{
-		n = thiz->all_nodes[i];
-		node_release(n);
-	}
+	if ((next = node_find_next(node, alpha)))
+		return next;
 
-	free(thiz->all_nodes);
+	next = node_create_next(node, alpha);
+	next->depth = node->depth + 1;
+	ac_automata_register_nodeptr(thiz, next);
+
+	return next;
 }
 
 
 /******************************************************************************
-FUNCTION: ac_automata_union_matchstrs
+FUNCTION: ac_automata_utf8_step
+
+PARAMS:
+	NODE * node: The node where the code point starts
+	unsigned long cp: The code point
+	AC_OFFSET length: Length of its UTF-8 sequence
+
+RETURNS:
+	The node after the folded code point
 
 DESCRIPTION:
-	Accepted string in any node consists of its own strings plus strings of
-	its failure node. this function collects all strings in failure node.
+	Add the path of the folded code point, and the paths of all its case
+	variants that have the same UTF-8 length; they all end at the same
+	node. Variants which share a lead byte with the folded code point
+	(e.g. U+0410 and U+0430) only add an edge; the others add a node for
+	their lead byte(s), which gets its failure node in the usual way. The
+	trie becomes a DAG whose nodes all have one depth, so positions and
+	failure nodes are as if the input was folded. Variants of another
+	length (e.g. U+212A KELVIN SIGN for 'k') are not folded.
 ******************************************************************************/
-void ac_automata_union_matchstrs (NODE * node)
+NODE * ac_automata_utf8_step (AC_AUTOMATA * thiz, NODE * node, unsigned long cp,
+		AC_OFFSET length)
 {
-	unsigned int i;
-	NODE * m = node;
+	unsigned long folded, variants[AC_UTF8_VARIANTS];
+	ALPHA bytes[AC_UTF8_MAX], vbytes[AC_UTF8_MAX];
+	unsigned int i, j, num, vlen;
+	NODE * end, * m;
+
+	folded = ac_utf8_fold (cp);
+	if (ac_utf8_encode (folded, bytes) != length)
+		folded = cp;
+	ac_utf8_encode (folded, bytes);
+
+	for (i=0, end = node; i < length; i++)
+		end = ac_automata_next_node (thiz, end, bytes[i]);
+
+	num = ac_utf8_variants (folded, variants);
 
-	while ((m = m->failure_node))
+	for (j=0; j < num; j++)
 	{
-		for (i=0; i < m->matched_strings_num; i++)
-			node_register_matchstr(node, &(m->matched_strings[i]));
+		if ((vlen = ac_utf8_encode (variants[j], vbytes)) != length)
+			continue;
+
+		for (i=0, m = node; i < vlen - 1; i++)
+			m = ac_automata_next_node (thiz, m, vbytes[i]);
 
-		if (m->final)
-			node->final = 1;
+		if (!node_find_next (m, vbytes[vlen - 1]))
+			node_register_outgoing (m, end, vbytes[vlen - 1]);
 	}
+
+	return end;
 }
 
 
 /******************************************************************************
-FUNCTION: ac_automata_set_failure
+FUNCTION: ac_automata_release
 
 DESCRIPTION:
-	find failure node for the given node.
+	Release all alocated memories to the automata
 ******************************************************************************/
-void ac_automata_set_failure (AC_AUTOMATA * thiz, NODE * node, ALPHA * alphas)
+void ac_automata_release (AC_AUTOMATA * thiz)
 {
-	unsigned int i, j;
-	NODE * m;
+	AC_INDEX i;
+	NODE * n;
 
-	for (i=1; i < node->depth; i++)
+	if (thiz->region)
+		ac_pages_free (thiz->region, thiz->region_size, thiz->region_pages);
+	else
 	{
-		m = thiz->root;
-		for (j=i; j < node->depth && m; j++)
-			m = node_find_next (m, alphas[j]);
-		if (m)
+		for (i=0; i < thiz->all_nodes_num; i++)
 		{
-			node->failure_node = m;
-			break;
+			n = thiz->all_nodes[i];
+			node_release(n);
 		}
 	}
-	if (!node->failure_node)
-		node->failure_node = thiz->root;
+
+	free(thiz->all_nodes);
+	free(thiz->patterns);
+	free(thiz->pattern_attrs);
+	free(thiz->pattern_nodes);
+	free(thiz->output_ids);
+	free(thiz->match_strings);
+	ac_wm_release(thiz->wm);
+	ac_perf_close(&thiz->perf);
 }
 
 
 /******************************************************************************
-FUNCTION: ac_automata_dfs_traverse
+FUNCTION: ac_automata_register_pattern
 
 DESCRIPTION:
-	Traverse all automata nodes using DFS (Deapth First Search), meanwile
-	it set the failure node for every node it passes through.
-*****************************************************************************/
-void ac_automata_dfs_traverse (AC_AUTOMATA * thiz, NODE * node, ALPHA * alphas)
+	Add the string to the pattern table. Its node is kept until the
+	output pool is built by ac_automata_locate_failure().
+******************************************************************************/
+void ac_automata_register_pattern (AC_AUTOMATA * thiz, STRING * str, NODE * node,
+		unsigned int flags, unsigned int group)
 {
-	unsigned int i;
-	NODE * next;
+	AC_INDEX i = thiz->total_strings;
 
-	for (i=0; i < node->outgoing_degree; i++)
+	if (i >= thiz->patterns_max)
 	{
-		alphas[node->depth] = node->outgoing[i].alpha;
-		next = node->outgoing[i].next;
-
-		/* At every node look for its failure node */
-		ac_automata_set_failure (thiz, next, alphas);
-
-		/* Recursively call itself to traverse all nodes */
-		ac_automata_dfs_traverse (thiz, next, alphas);
+		thiz->patterns_max = i ? 2 * i : REALLOC_CHUNK_PATTERNS;
+		thiz->patterns = (STRING *) realloc
+			(thiz->patterns, thiz->patterns_max*sizeof(STRING));
+		thiz->pattern_attrs = (struct match_attr *) realloc
+			(thiz->pattern_attrs, thiz->patterns_max*sizeof(struct match_attr));
+		thiz->pattern_nodes = (AC_INDEX *) realloc
+			(thiz->pattern_nodes, thiz->patterns_max*sizeof(AC_INDEX));
 	}
+
+	thiz->patterns[i].str = str->str;
+	thiz->patterns[i].length = str->length;
+	thiz->patterns[i].id = str->id;
+	thiz->pattern_attrs[i].flags = flags;
+	thiz->pattern_attrs[i].group = group;
+	thiz->pattern_nodes[i] = node->id;
 }
 
 
 /******************************************************************************
-FUNCTION: ac_automata_locate_failure
+FUNCTION: ac_automata_collect_outputs
+
+PARAMS:
+	AC_INDEX * own: Indices in the pattern table of the node's own strings
+	AC_INDEX own_num: Number of them
 
 DESCRIPTION:
-	Locate the failure node for all nodes.
+	Accepted string in any node consists of its own strings plus strings of
+	its failure node. Nodes are visited in BFS order, so the range of the
+	failure node is already complete. A node without strings of its own
+	shares it; otherwise a new range is added to the output pool with the
+	own strings first, in order of addition, followed by a copy of it.
 ******************************************************************************/
-void ac_automata_locate_failure (AC_AUTOMATA * thiz)
+void ac_automata_collect_outputs (AC_AUTOMATA * thiz, NODE * node, AC_INDEX * own,
+		AC_INDEX own_num)
 {
-	unsigned int i;
-	ALPHA alphas[AC_PATTRN_MAX_LENGTH];
-	NODE * node;
+	NODE * m = node->failure_node;
+	AC_INDEX i, need;
 
-	ac_automata_dfs_traverse (thiz, thiz->root, alphas);
+	node->bound |= m->bound;
+	node->groups |= m->groups;
 
-	for (i=0; i < thiz->all_nodes_num; i++)
+	if (m->final)
+		node->final = 1;
+
+	if (!own_num)
 	{
-		node = thiz->all_nodes[i];
-		ac_automata_union_matchstrs (node);
-		node_sort_edges (node);
+		node->outputs = m->outputs;
+		node->outputs_num = m->outputs_num;
+		return;
 	}
 
-	thiz->accept_strings = 0; /* do not accept strings any more */
+	need = thiz->outputs_num + own_num + m->outputs_num;
+	if (need > thiz->outputs_max)
+	{
+		thiz->outputs_max = thiz->outputs_max ? thiz->outputs_max : REALLOC_CHUNK_PATTERNS;
+		while (thiz->outputs_max < need)
+			thiz->outputs_max *= 2;
+		thiz->output_ids = (AC_INDEX *) realloc
+			(thiz->output_ids, thiz->outputs_max*sizeof(AC_INDEX));
+	}
+
+	node->outputs = thiz->outputs_num;
+	node->outputs_num = own_num + m->outputs_num;
+
+	for (i=0; i < own_num; i++)
+		thiz->output_ids[thiz->outputs_num++] = own[i];
+
+	memcpy (thiz->output_ids + thiz->outputs_num, thiz->output_ids + m->outputs,
+		m->outputs_num*sizeof(AC_INDEX));
+	thiz->outputs_num += m->outputs_num;
 }
 
 
 /******************************************************************************
-FUNCTION: ac_automata_search
+FUNCTION: ac_automata_fold_edges
 
 DESCRIPTION:
-	Search for patterns inside the given input, as it finds a match
-	it will call the Callback functions to report it to caller.
+	For every lower case edge of the node add an edge on its upper case
+	to the same target. The trie only contains folded alphas, so after
+	this the search loop does not need to fold the input.
+	It is called after failure nodes are located.
 ******************************************************************************/
-void ac_automata_search (AC_AUTOMATA * thiz, STRING * str, int automata_num, int thread_num)
+void ac_automata_fold_edges (AC_AUTOMATA * thiz, NODE * node)
 {
-	//printf("\nIn thread %d, automata %d\n", automata_num, thread_num);
-	unsigned long position;
-	NODE * current;
-	NODE * next;
+	AC_COUNT i, degree = node->outgoing_degree;
+	unsigned char c;
 
-	if(thiz->accept_strings)
-		/* you must call ac_automata_locate_failure() first */
+	for (i=0; i < degree; i++)
+	{
+		c = (unsigned char) node->outgoing[i].alpha;
+
+		if ((c >= 'a' && c <= 'z') ||
+			(thiz->fold == AC_FOLD_LATIN1 && c >= 0xE0 && c <= 0xFE && c != 0xF7))
+			node_register_outgoing (node, node->outgoing[i].next, (ALPHA) (c - 32));
+	}
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_pack
+
+DESCRIPTION:
+	Move the frozen nodes into one region of the pages of the automata:
+	every node is followed by the index of its encoding and its edges,
+	in order of node ID, and the pointers between them are moved along.
+	If no region can be mapped the nodes stay where they are.
+******************************************************************************/
+void ac_automata_pack (AC_AUTOMATA * thiz)
+{
+	NODE ** moved, * old, * n;
+	struct node_bitmap * bitmap;
+	NODE ** row;
+	unsigned long size = 0, index;
+	AC_INDEX i;
+	AC_COUNT j;
+	char * at;
+
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		old = thiz->all_nodes[i];
+		size += sizeof(NODE) + node_index_size (old) +
+			old->outgoing_degree * sizeof(struct edge);
+	}
+
+	if (!(at = (char *) ac_pages_alloc (size, thiz->pages, &thiz->region_pages)))
 		return;
+	thiz->region = at;
+	thiz->region_size = size;
 
-	position = 0;
-	/* reload status variable(s) */
-	current = thiz->current_node;
+	/* Where every node goes, to move the pointers to it */
+	moved = (NODE **) malloc (thiz->all_nodes_num*sizeof(NODE *));
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		moved[i] = (NODE *) at;
+		old = thiz->all_nodes[i];
+		at += sizeof(NODE) + node_index_size (old) +
+			old->outgoing_degree * sizeof(struct edge);
+	}
 
-	/* This is the main search loop. it must be keep 
-	   as lightwaight as possible. */
-	while (position < str->length)
+	for (i=0; i < thiz->all_nodes_num; i++)
 	{
-		if(!(next = node_findbs_next(current, str->str[position])))
+		old = thiz->all_nodes[i];
+		n = moved[i];
+		*n = *old;
+		at = (char *) (n + 1);
+
+		if (old->failure_node)
+			n->failure_node = moved[old->failure_node->id];
+
+		if ((index = node_index_size (old)))
 		{
-			if(current->failure_node /* we are not in root */)
-				current = current->failure_node;
-			else
-				position++;
+			memcpy (at, old->index, index);
+			n->index = at;
+			at += index;
 		}
-		else
+
+		switch (n->encoding)
 		{
-			current = next;
-			position++;
+			case NODE_EDGES_ONE:
+				n->index = moved[((NODE *) old->index)->id];
+				break;
+
+			case NODE_EDGES_BITMAP:
+				bitmap = (struct node_bitmap *) n->index;
+				for (j=0; j < n->outgoing_degree; j++)
+					bitmap->next[j] = moved[bitmap->next[j]->id];
+				break;
+
+			case NODE_EDGES_DENSE:
+				row = (NODE **) n->index;
+				for (j=0; j < 256; j++)
+					if (row[j])
+						row[j] = moved[row[j]->id];
+				break;
 		}
 
-		if(current->final && next)
-		/* We check 'next' to find out if we came here after a alpha transition 
-		   or due to a fail. in second case we should not report matching,
-		   because it was reported in previous node */
+		if (n->outgoing_degree)
 		{
-			thiz->match.position = position + thiz->base_position;
-			thiz->match.match_num = current->matched_strings_num;
-			thiz->match.matched_strings = current->matched_strings;
-			/* do callback: we found a match */
-			if (thiz->match_callback(&thiz->match, automata_num, thread_num))
-				break;
+			n->outgoing = (struct edge *) at;
+			for (j=0; j < n->outgoing_degree; j++)
+			{
+				n->outgoing[j].alpha = old->outgoing[j].alpha;
+				n->outgoing[j].next = moved[old->outgoing[j].next->id];
+			}
 		}
+		n->outgoing_max = n->outgoing_degree;
 	}
 
-	/* save status variables */
-	thiz->current_node = current;
-	thiz->base_position += position;
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		if (thiz->all_nodes[i] == thiz->root)
+			thiz->root = moved[i];
+		node_release (thiz->all_nodes[i]);
+		thiz->all_nodes[i] = moved[i];
+	}
+	thiz->current_node = thiz->root;
+
+	free (moved);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_set_failure
+
+DESCRIPTION:
+	find failure node for the given node: it is reached by 'alpha' from
+	the deepest node in the failure chain of its parent having such an
+	edge, or it is the root. The parent's failure node must be located.
+******************************************************************************/
+void ac_automata_set_failure (AC_AUTOMATA * thiz, NODE * node, NODE * parent, ALPHA alpha)
+{
+	NODE * m;
+
+	for (m = parent->failure_node; m; m = m->failure_node)
+	{
+		if ((node->failure_node = node_findbs_next (m, alpha)))
+			return;
+	}
+
+	node->failure_node = thiz->root;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_bfs_traverse
+
+DESCRIPTION:
+	Traverse all automata nodes using BFS (Breadth First Search), meanwhile
+	it set the failure node and collects the accepted strings for every
+	node it passes through; the own strings of node i are
+	own[own_begin[i] .. own_begin[i+1]). Every node is handled after all nodes of less
+	depth, which are the only possible failure nodes. No recursion is
+	involved, so pattern length is not limited by the stack.
+*****************************************************************************/
+void ac_automata_bfs_traverse (AC_AUTOMATA * thiz, AC_INDEX * own, AC_INDEX * own_begin)
+{
+	NODE ** queue;
+	AC_INDEX head = 0, tail = 0;
+	AC_COUNT i;
+	NODE * node, * next;
+
+	queue = (NODE **) malloc (thiz->all_nodes_num*sizeof(NODE *));
+	queue[tail++] = thiz->root;
+
+	while (head < tail)
+	{
+		node = queue[head++];
+
+		for (i=0; i < node->outgoing_degree; i++)
+		{
+			next = node->outgoing[i].next;
+
+			/* Already reached by another edge (AC_FOLD_UTF8) */
+			if (next->failure_node)
+				continue;
+
+			ac_automata_set_failure (thiz, next, node, node->outgoing[i].alpha);
+			ac_automata_collect_outputs (thiz, next, own + own_begin[next->id],
+				own_begin[next->id + 1] - own_begin[next->id]);
+
+			queue[tail++] = next;
+		}
+	}
+
+	free (queue);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_locate_failure
+
+DESCRIPTION:
+	Locate the failure node for all nodes.
+******************************************************************************/
+void ac_automata_locate_failure (AC_AUTOMATA * thiz)
+{
+	AC_INDEX i, * own, * own_begin;
+	NODE * node;
+
+	/* Sorted edges let the failure search use binary search */
+	for (i=0; i < thiz->all_nodes_num; i++)
+		node_sort_edges (thiz->all_nodes[i]);
+
+	/* Strings grouped by their node, in order of addition */
+	own = (AC_INDEX *) malloc ((thiz->total_strings + 1)*sizeof(AC_INDEX));
+	own_begin = (AC_INDEX *) calloc (thiz->all_nodes_num + 1, sizeof(AC_INDEX));
+
+	for (i=0; i < thiz->total_strings; i++)
+		own_begin[thiz->pattern_nodes[i] + 1]++;
+	for (i=0; i < thiz->all_nodes_num; i++)
+		own_begin[i + 1] += own_begin[i];
+	for (i=0; i < thiz->total_strings; i++)
+		own[own_begin[thiz->pattern_nodes[i]]++] = i;
+	/* Filling moved every begin to the next one */
+	memmove (own_begin + 1, own_begin, thiz->all_nodes_num*sizeof(AC_INDEX));
+	own_begin[0] = 0;
+
+	ac_automata_bfs_traverse (thiz, own, own_begin);
+
+	free (own);
+	free (own_begin);
+	free (thiz->pattern_nodes);
+	thiz->pattern_nodes = NULL;
+
+	if (thiz->outputs_num)
+	{
+		thiz->output_ids = (AC_INDEX *) realloc
+			(thiz->output_ids, thiz->outputs_num*sizeof(AC_INDEX));
+		thiz->outputs_max = thiz->outputs_num;
+	}
+
+	/* The leftmost match ending at a node is its longest string */
+	for (i=0; i < thiz->all_nodes_num; i++)
+		node_find_longest (thiz->all_nodes[i], thiz->patterns, thiz->output_ids);
+
+	/* AC_FOLD_UTF8 adds its edges along with the strings */
+	if (thiz->fold && thiz->fold != AC_FOLD_UTF8)
+	{
+		for (i=0; i < thiz->all_nodes_num; i++)
+		{
+			node = thiz->all_nodes[i];
+			ac_automata_fold_edges (thiz, node);
+			node_sort_edges (node);
+		}
+	}
+
+	/* Edges are final now: encode them for the search */
+	for (i=0; i < thiz->all_nodes_num; i++)
+	{
+		node = thiz->all_nodes[i];
+		node_freeze (node, node == thiz->root || (node->depth <= NODE_DENSE_DEPTH &&
+			node->outgoing_degree >= NODE_DENSE_DEGREE));
+	}
+
+	if (thiz->pages != AC_PAGES_DEFAULT)
+		ac_automata_pack (thiz);
+
+	/* Long strings are searched with skips, as long as it gives the same
+	   matches; with folding or boundaries the trie is needed */
+	if (!thiz->fold && !thiz->bounded)
+		thiz->wm = ac_wm_build (thiz->all_nodes, thiz->all_nodes_num,
+			thiz->patterns, thiz->output_ids);
+
+	thiz->accept_strings = 0; /* do not accept strings any more */
+}
+
+
+/* Kinds of search kernels, see ac_automata_kernel() */
+#define AC_KERNEL_CALLBACK   0
+#define AC_KERNEL_EXISTS     1
+#define AC_KERNEL_COUNT      2
+#define AC_KERNEL_COUNT_EACH 3
+#define AC_KERNEL_FIRST_N    4
+
+/* Counters of AC_SCAN_STATS; nothing is counted unless AC_INSTRUMENT */
+#ifdef AC_INSTRUMENT
+#define AC_STAT(thiz, field, n) ((thiz)->stats.field += (n))
+#define AC_STAT_OUTPUT(thiz, node) do { \
+		(thiz)->stats.final_nodes++; \
+		(thiz)->stats.outputs += (node)->outputs_num; \
+		if ((node)->outputs_num > (thiz)->stats.longest_output) \
+			(thiz)->stats.longest_output = (node)->outputs_num; \
+	} while (0)
+#else
+#define AC_STAT(thiz, field, n) ((void) 0)
+#define AC_STAT_OUTPUT(thiz, node) ((void) 0)
+#endif
+
+struct ac_kernel
+/* Arguments and result of a search kernel */
+{
+	MATCH * matches; /* Output array (AC_KERNEL_FIRST_N) */
+	unsigned long limit; /* Capacity of 'matches' or of 'counts' */
+	unsigned long * counts; /* Per string id counters (AC_KERNEL_COUNT_EACH) */
+	int automata_num; /* Passed to the callback (AC_KERNEL_CALLBACK) */
+	int thread_num;
+	unsigned long found; /* Result, see ac_automata_kernel() */
+	STRING * text; /* The chunk being searched */
+	AC_INDEX strings_used; /* Of match_strings by the matches (AC_KERNEL_FIRST_N) */
+};
+
+/* Word alphas for AC_BOUND_WORD_*: letters, digits, '_' and all non-ASCII
+   bytes, so that UTF-8 and Latin-1 letters do not make a boundary */
+static const unsigned char ac_word_alpha[256] = {
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,
+	0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,1,
+	0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+};
+
+/* Flags which need the alpha after a match */
+#define AC_BOUND_RIGHT_MASK (AC_BOUND_WORD_RIGHT | AC_BOUND_LINE_END)
+
+
+/******************************************************************************
+FUNCTION: ac_automata_alpha_before
+
+RETURNS:
+	The alpha at the given absolute position, which is before 'position'
+	in the current chunk; -1 if it is before the kept history
+******************************************************************************/
+static inline int ac_automata_alpha_before (AC_AUTOMATA * thiz, STRING * str,
+		unsigned long at)
+{
+	unsigned long back;
+
+	if (at >= thiz->base_position)
+		return (unsigned char) str->str[at - thiz->base_position];
+
+	back = thiz->base_position - at;
+	if (back > thiz->history_len)
+		return -1;
+
+	return (unsigned char) thiz->history[thiz->history_len - back];
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_cp_position
+
+RETURNS:
+	Number of code points before the given absolute (byte) position
+
+DESCRIPTION:
+	Code points are counted lazily from 'cp_mark' up to the position.
+	Reports are in order of position, except for matches reported late
+	(pending or leftmost candidates) which are counted back from the mark.
+******************************************************************************/
+static inline unsigned long ac_automata_cp_position (AC_AUTOMATA * thiz, STRING * str,
+		unsigned long at)
+{
+	unsigned long num;
+
+	if (at >= thiz->cp_mark)
+	{
+		thiz->cp_count += ac_utf8_count (str->str + (thiz->cp_mark - thiz->base_position),
+			at - thiz->cp_mark);
+		thiz->cp_mark = at;
+		return thiz->cp_count;
+	}
+
+	for (num = thiz->cp_count; at < thiz->cp_mark; at++)
+		num -= AC_UTF8_LEAD(ac_automata_alpha_before (thiz, str, at));
+
+	return num;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_match_strings
+
+RETURNS:
+	match_strings, with room for at least 'num' strings
+
+DESCRIPTION:
+	The output pool only has indices in the pattern table: the strings
+	MATCH reports are copied from it into match_strings, which grows here.
+******************************************************************************/
+STRING * ac_automata_match_strings (AC_AUTOMATA * thiz, AC_INDEX num)
+{
+	if (num > thiz->match_strings_max)
+	{
+		thiz->match_strings_max = thiz->match_strings_max ? thiz->match_strings_max : 8;
+		while (thiz->match_strings_max < num)
+			thiz->match_strings_max *= 2;
+		thiz->match_strings = (STRING *) realloc
+			(thiz->match_strings, thiz->match_strings_max*sizeof(STRING));
+	}
+
+	return thiz->match_strings;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_report
+
+RETURNS:
+	1 if the search must stop, otherwise 0
+
+DESCRIPTION:
+	Do what the kernel 'kind' does with matched strings ending at the
+	given (absolute) position.
+******************************************************************************/
+static inline __attribute__((always_inline))
+int ac_automata_report (AC_AUTOMATA * thiz, const int kind, struct ac_kernel * k,
+		const AC_INDEX * ids, AC_COUNT num, unsigned long position)
+{
+	STRING * strings;
+	AC_COUNT j;
+
+	AC_STAT(thiz, reports, 1);
+
+	switch (kind)
+	{
+		case AC_KERNEL_EXISTS:
+			k->found = 1;
+			return 1;
+
+		case AC_KERNEL_COUNT:
+			k->found += num;
+			break;
+
+		case AC_KERNEL_COUNT_EACH:
+			k->found += num;
+			for (j=0; j < num; j++)
+				if (thiz->patterns[ids[j]].id < k->limit)
+					k->counts[thiz->patterns[ids[j]].id]++;
+			break;
+
+		case AC_KERNEL_FIRST_N:
+			/* The strings of all the matches are kept; match_strings may
+			   move while they are added, so ac_automata_first_n() points
+			   the matches to them at the end */
+			strings = ac_automata_match_strings (thiz, k->strings_used + num) +
+				k->strings_used;
+			for (j=0; j < num; j++)
+				strings[j] = thiz->patterns[ids[j]];
+			k->strings_used += num;
+			if (thiz->codepoints)
+				k->matches[k->found].cp_position =
+					ac_automata_cp_position (thiz, k->text, position);
+			k->matches[k->found].position = position;
+			k->matches[k->found].match_num = num;
+			k->matches[k->found].matched_strings = NULL;
+			if (++k->found == k->limit)
+				return 1;
+			break;
+
+		case AC_KERNEL_CALLBACK:
+			strings = num > thiz->match_strings_max ?
+				ac_automata_match_strings (thiz, num) : thiz->match_strings;
+			for (j=0; j < num; j++)
+				strings[j] = thiz->patterns[ids[j]];
+			if (thiz->codepoints)
+				thiz->match.cp_position = ac_automata_cp_position (thiz, k->text, position);
+			thiz->match.position = position;
+			thiz->match.match_num = num;
+			thiz->match.matched_strings = strings;
+			AC_STAT(thiz, callbacks, 1);
+			/* do callback */
+			if (thiz->match_callback(&thiz->match, k->automata_num, k->thread_num))
+			{
+				k->found = 1;
+				return 1;
+			}
+			break;
+	}
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_passes
+
+PARAMS:
+	struct match_attr * attr: Attributes of the matched string
+	unsigned long start: Absolute position of the first alpha of the match
+	int next: The alpha after the match, -1 at end of input
+
+RETURNS:
+	1 if the string is in a selected group and the match satisfies its
+	boundary flags, otherwise 0
+******************************************************************************/
+static inline int ac_automata_passes (AC_AUTOMATA * thiz, STRING * str,
+		struct match_attr * attr, unsigned long start, int next)
+{
+	unsigned int flags = attr->flags;
+	int prev;
+
+	if (!(AC_GROUP(attr->group) & thiz->groups))
+		return 0;
+
+	if (!flags)
+		return 1;
+
+	prev = start ? ac_automata_alpha_before (thiz, str, start - 1) : -1;
+
+	return !(((flags & AC_BOUND_WORD_LEFT) && prev >= 0 && ac_word_alpha[prev]) ||
+		((flags & AC_BOUND_LINE_START) && prev >= 0 && prev != '\n') ||
+		((flags & AC_BOUND_WORD_RIGHT) && next >= 0 && ac_word_alpha[next]) ||
+		((flags & AC_BOUND_LINE_END) && next >= 0 && next != '\n'));
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_selective
+
+PARAMS:
+	NODE * node: A final node having strings with AC_BOUND_* flags or
+	             strings of groups which are not selected
+	unsigned long position: End of the match in the current chunk
+	int at_end: 1 if the chunk is empty, meaning end of input
+
+RETURNS:
+	1 if the search must stop, otherwise 0
+
+DESCRIPTION:
+	Check groups and boundaries of the node's strings and report the ones
+	that pass. Passing strings are reported in runs of adjacent strings,
+	so no copy of the string list is needed. If the match ends the chunk
+	and some strings need the next alpha, the node is kept in
+	'pending_node' and checked at the start of the next chunk.
+******************************************************************************/
+static inline __attribute__((always_inline))
+int ac_automata_selective (AC_AUTOMATA * thiz, const int kind, struct ac_kernel * k,
+		STRING * str, NODE * node, unsigned long position, int at_end)
+{
+	unsigned long end = thiz->base_position + position;
+	AC_COUNT i, first = 0;
+	AC_INDEX * ids = thiz->output_ids + node->outputs;
+	int next = -1; /* -1: end of input */
+
+	/* None of the groups of the node is selected */
+	if (!(node->groups & thiz->groups))
+		return 0;
+
+	if (position < str->length)
+		next = (unsigned char) str->str[position];
+	else if (!at_end && (node->bound & AC_BOUND_RIGHT_MASK))
+	{
+		thiz->pending_node = node;
+		return 0;
+	}
+
+	for (i=0; i <= node->outputs_num; i++)
+	{
+		if (i < node->outputs_num && ac_automata_passes (thiz, str,
+				&thiz->pattern_attrs[ids[i]], end - thiz->patterns[ids[i]].length, next))
+			continue; /* passes: extend the run */
+
+		if (i > first && ac_automata_report (thiz, kind, k,
+				&ids[first], i - first, end))
+			return 1;
+
+		first = i + 1;
+	}
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_keep_history
+
+DESCRIPTION:
+	Keep the last alphas of the consumed input for left boundary checks of
+	matches which start in the next chunk.
+******************************************************************************/
+void ac_automata_keep_history (AC_AUTOMATA * thiz, STRING * str, unsigned long consumed)
+{
+	const unsigned long size = sizeof(thiz->history);
+	unsigned long keep;
+
+	if (consumed >= size)
+	{
+		memcpy (thiz->history, str->str + consumed - size, size);
+		thiz->history_len = size;
+		return;
+	}
+
+	/* Shift older alphas to make room for the new ones */
+	keep = thiz->history_len;
+	if (keep + consumed > size)
+		keep = size - consumed;
+	memmove (thiz->history, thiz->history + thiz->history_len - keep, keep);
+	memcpy (thiz->history + keep, str->str, consumed);
+	thiz->history_len = keep + consumed;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_candidate
+
+PARAMS:
+	NODE * node: A final node reached in a leftmost search
+	long position: End of the match in the current chunk; it is negative
+	               while the search goes over 'history'
+	int at_end: 1 if the chunk is empty, meaning end of input
+
+DESCRIPTION:
+	Make the leftmost string ending at the node the candidate, if it is
+	better than the current one: it starts before it, or at the same
+	position and is longer (leftmost-longest) or added before it
+	(leftmost-first). Strings starting after the candidate are dropped
+	here; if they do not overlap it they are found again by the rescan
+	after the candidate is reported.
+******************************************************************************/
+static inline void ac_automata_candidate (AC_AUTOMATA * thiz, STRING * str,
+		NODE * node, long position, int at_end)
+{
+	unsigned long end = thiz->base_position + position, start;
+	AC_COUNT i, best = node->longest;
+	AC_INDEX * ids = thiz->output_ids + node->outputs;
+	STRING * strings = thiz->patterns;
+	int next = -1; /* -1: end of input */
+
+	if (node->bound || (node->groups & ~thiz->groups))
+	{
+		/* The longest string which passes its group and boundary checks */
+		if (position < (long) str->length)
+			next = ac_automata_alpha_before (thiz, str, end);
+		else if (!at_end && (node->bound & AC_BOUND_RIGHT_MASK))
+		{
+			thiz->pending_node = node;
+			return;
+		}
+
+		for (i=0, best = node->outputs_num; i < node->outputs_num; i++)
+			if ((best == node->outputs_num ||
+					strings[ids[i]].length > strings[ids[best]].length) &&
+				ac_automata_passes (thiz, str, &thiz->pattern_attrs[ids[i]],
+					end - strings[ids[i]].length, next))
+				best = i;
+
+		if (best == node->outputs_num)
+			return;
+	}
+
+	start = end - strings[ids[best]].length;
+
+	if (!thiz->candidate || start < thiz->candidate_start ||
+		(start == thiz->candidate_start &&
+			(thiz->semantics == AC_SEMANTICS_LEFTMOST_LONGEST ||
+			ids[best] < thiz->candidate_order)))
+	{
+		thiz->candidate = &strings[ids[best]];
+		thiz->candidate_start = start;
+		thiz->candidate_end = end;
+		thiz->candidate_order = ids[best];
+	}
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_leftmost
+
+RETURNS:
+	Same as ac_automata_kernel()
+
+DESCRIPTION:
+	Search loop of the leftmost semantics. The trie node reached at a
+	position is the longest suffix of the input which may still grow into
+	a match, so no later match can start before position - depth. Once
+	that is past the candidate's start, the candidate is final: it is
+	reported and the search restarts from the root right after it. If it
+	ended in an earlier chunk, the rescan starts in 'history'.
+******************************************************************************/
+static inline __attribute__((always_inline))
+unsigned long ac_automata_leftmost (AC_AUTOMATA * thiz, STRING * str, const int kind,
+		struct ac_kernel * k)
+{
+	const int at_end = !str->length;
+	long position = 0;
+	NODE * current;
+	NODE * next;
+	AC_INDEX match;
+	ALPHA alpha;
+
+	/* reload status variable(s) */
+	current = thiz->current_node;
+
+	/* A match at the end of previous chunk waits for this one */
+	if (thiz->pending_node)
+	{
+		next = thiz->pending_node;
+		thiz->pending_node = NULL;
+		ac_automata_candidate (thiz, str, next, 0, at_end);
+	}
+
+	for (;;)
+	{
+		if (thiz->candidate && ((at_end && position == (long) str->length) ||
+			thiz->base_position + position - current->depth > thiz->candidate_start))
+		{
+			match = thiz->candidate_order;
+			thiz->candidate = NULL;
+
+			if (ac_automata_report (thiz, kind, k, &match, 1, thiz->candidate_end))
+				break;
+
+			/* Non-overlapping: go on right after the reported string */
+			position = (long) (thiz->candidate_end - thiz->base_position);
+			current = thiz->root;
+			thiz->pending_node = NULL;
+		}
+
+		if (position >= (long) str->length)
+			break;
+
+		alpha = position < 0 ?
+			thiz->history[thiz->history_len + position] : str->str[position];
+		position++;
+
+		while (!(next = node_next(current, alpha)) && current->failure_node)
+		{
+			current = current->failure_node;
+			AC_STAT(thiz, failure_hops, 1);
+		}
+
+		if (!next)
+		{
+			AC_STAT(thiz, root_restarts, 1);
+			continue;
+		}
+
+		current = next;
+		AC_STAT(thiz, transitions, 1);
+
+		if (current->final)
+		{
+			AC_STAT_OUTPUT(thiz, current);
+			ac_automata_candidate (thiz, str, current, position, at_end);
+		}
+	}
+
+	if (position < 0)
+	{
+		/* Stopped while going over 'history' */
+		current = thiz->root;
+		position = 0;
+	}
+
+	ac_automata_keep_history (thiz, str, position);
+
+	if (thiz->codepoints)
+		ac_automata_cp_position (thiz, str, thiz->base_position + position);
+
+	/* save status variables */
+	thiz->current_node = current;
+	thiz->base_position += position;
+
+	return k->found;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_wm_flush
+
+RETURNS:
+	1 if the search must stop, otherwise 0
+
+DESCRIPTION:
+	Report the pending matches ending before 'limit', in order of end.
+	The node of the longest string ending at a position holds all strings
+	ending there, as the trie node the search would be at does.
+******************************************************************************/
+static inline __attribute__((always_inline))
+int ac_automata_wm_flush (AC_AUTOMATA * thiz, const int kind, struct ac_kernel * k,
+		unsigned long limit)
+{
+	NODE ** slot;
+
+	for (; thiz->wm_pending_num && thiz->wm_first < limit; thiz->wm_first++)
+	{
+		slot = &thiz->wm_pending[thiz->wm_first % (AC_BOUND_MAX_LENGTH + 1)];
+		if (!*slot)
+			continue;
+
+		thiz->wm_pending_num--;
+		if (ac_automata_report (thiz, kind, k, thiz->output_ids + (*slot)->outputs,
+				(*slot)->outputs_num, thiz->wm_first))
+		{
+			*slot = NULL;
+			thiz->wm_first++;
+			return 1;
+		}
+		*slot = NULL;
+	}
+
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_wm_scan
+
+PARAMS:
+	const ALPHA * text: Alphas from absolute position 'text_base' on
+	unsigned long * start: First window start to check; set to the next
+	unsigned long to: Windows start before this
+	unsigned long * deferred: Set to the least window start having a
+	                          string which ends after 'text'
+
+RETURNS:
+	1 if the search must stop, otherwise 0
+
+DESCRIPTION:
+	Strings ending at or before 'wm_verified' were found before.
+******************************************************************************/
+static inline __attribute__((always_inline))
+int ac_automata_wm_scan (AC_AUTOMATA * thiz, const int kind, struct ac_kernel * k,
+		const ALPHA * text, unsigned long text_base, unsigned long text_len,
+		unsigned long * start, unsigned long to, unsigned long * deferred)
+{
+	const AC_WM * wm = thiz->wm;
+	const unsigned char * t = (const unsigned char *) text - text_base;
+	const struct ac_wm_entry * e, * last;
+	unsigned long s = *start, end = text_base + text_len, match_end;
+	unsigned int h, shift;
+	unsigned short prefix;
+	NODE ** slot;
+
+	while (s < to)
+	{
+		AC_STAT(thiz, wm_windows, 1);
+		h = AC_WM_HASH(t + s + wm->shortest - AC_WM_BLOCK);
+		if ((shift = wm->shift[h]))
+		{
+			s += shift;
+			continue;
+		}
+
+		prefix = AC_WM_PREFIX(t + s);
+		last = wm->entries + wm->bucket[h + 1];
+
+		for (e = wm->entries + wm->bucket[h]; e < last; e++)
+		{
+			match_end = s + e->length;
+
+			if (e->prefix != prefix || match_end <= thiz->wm_verified)
+				continue;
+
+			if (match_end > end)
+			{
+				if (s < *deferred)
+					*deferred = s;
+				continue;
+			}
+
+			AC_STAT(thiz, wm_compares, 1);
+			if (memcmp (e->str, t + s, e->length))
+				continue;
+
+			/* Matches starting before 's' are all known */
+			if (ac_automata_wm_flush (thiz, kind, k, s + wm->shortest))
+			{
+				*start = s;
+				return 1;
+			}
+
+			slot = &thiz->wm_pending[match_end % (AC_BOUND_MAX_LENGTH + 1)];
+			if (!*slot)
+			{
+				if (!thiz->wm_pending_num++ || match_end < thiz->wm_first)
+					thiz->wm_first = match_end;
+				*slot = e->node;
+			}
+			else if ((*slot)->depth < e->length)
+				*slot = e->node;
+		}
+		s++;
+	}
+
+	*start = s;
+	return 0;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_wm
+
+RETURNS:
+	Same as ac_automata_kernel()
+
+DESCRIPTION:
+	Search loop of the Wu-Manber tables. Every window of the chunk is
+	checked, and matches are reported before it returns, like the trie
+	does. A string running past the end of the chunk is checked with the
+	next one: its window starts in 'history', and such windows are
+	searched in a copy of the seam of both chunks. If the search stops,
+	the chunk is consumed up to the window where it stopped.
+******************************************************************************/
+static inline __attribute__((always_inline))
+unsigned long ac_automata_wm (AC_AUTOMATA * thiz, STRING * str, const int kind,
+		struct ac_kernel * k)
+{
+	const AC_WM * wm = thiz->wm;
+	unsigned long base = thiz->base_position, end = base + str->length;
+	unsigned long start = thiz->wm_next, deferred = ULONG_MAX, to, a, seam_len = 0;
+	unsigned long consumed = str->length;
+	ALPHA seam[2 * AC_BOUND_MAX_LENGTH];
+
+	/* Windows which fit in the input so far */
+	to = end >= wm->shortest ? end - wm->shortest + 1 : 0;
+
+	if (start < base && start < to)
+	{
+		for (a = start; a < base; a++)
+			seam[seam_len++] = ac_automata_alpha_before (thiz, str, a);
+		for (a = 0; a < str->length && a < wm->longest; a++)
+			seam[seam_len++] = str->str[a];
+
+		if (ac_automata_wm_scan (thiz, kind, k, seam, start, seam_len, &start,
+				to < base ? to : base, &deferred))
+			goto stopped;
+	}
+
+	if (start < to && ac_automata_wm_scan (thiz, kind, k, str->str, base, str->length,
+			&start, to, &deferred))
+		goto stopped;
+
+	thiz->wm_verified = end;
+	thiz->wm_next = start < deferred ? start : deferred;
+	thiz->base_position = end;
+	ac_automata_keep_history (thiz, str, str->length);
+
+	/* Every window where a string may end in the chunk has been checked */
+	ac_automata_wm_flush (thiz, kind, k, end + 1);
+
+	return k->found;
+
+stopped:
+	if (start + wm->shortest - 1 > thiz->wm_verified)
+		thiz->wm_verified = start + wm->shortest - 1;
+	thiz->wm_next = start < deferred ? start : deferred;
+
+	if (start > base)
+		consumed = start - base;
+	else
+		consumed = 0;
+	ac_automata_keep_history (thiz, str, consumed);
+	thiz->base_position += consumed;
+
+	return k->found;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_kernel
+
+RETURNS:
+	AC_KERNEL_EXISTS: 1 if a match is found, otherwise 0
+	AC_KERNEL_COUNT, AC_KERNEL_COUNT_EACH: number of matched strings
+	AC_KERNEL_FIRST_N: number of MATCHes written to 'matches'
+	AC_KERNEL_CALLBACK: 1 if the callback asked to stop, otherwise 0
+
+DESCRIPTION:
+	This is the main search loop, shared by all search functions. It is
+	always inlined with a constant 'kind', so every caller gets its own
+	copy in which the unused branches are removed: the count and exists
+	kernels never build a MATCH nor call through the callback pointer.
+	It must be keep as lightwaight as possible: group and boundary checks
+	are only done on final nodes having unselected or bounded strings.
+	Leftmost semantics have their own loop, see ac_automata_leftmost(),
+	and so have long strings, see ac_automata_wm().
+******************************************************************************/
+static inline __attribute__((always_inline))
+unsigned long ac_automata_kernel (AC_AUTOMATA * thiz, STRING * str, const int kind,
+		struct ac_kernel * k)
+{
+	unsigned long position = 0;
+	NODE * current;
+	NODE * next;
+	ALPHA alpha;
+
+	k->found = 0;
+	k->text = str;
+
+	if (thiz->semantics)
+		return ac_automata_leftmost (thiz, str, kind, k);
+
+	if (thiz->wm && !thiz->codepoints && !(thiz->wm->groups & ~thiz->groups))
+		return ac_automata_wm (thiz, str, kind, k);
+
+	/* reload status variable(s) */
+	current = thiz->current_node;
+
+	/* A match at the end of previous chunk waits for this one */
+	if (thiz->pending_node)
+	{
+		next = thiz->pending_node;
+		thiz->pending_node = NULL;
+		if (ac_automata_selective (thiz, kind, k, str, next, 0, !str->length))
+			goto done;
+	}
+
+	while (position < str->length)
+	{
+		alpha = str->str[position++];
+
+		/* follow failure nodes until a transition on 'alpha' is found,
+		   the root has no failure node and absorbs unknown alphas */
+		while (!(next = node_next(current, alpha)) && current->failure_node)
+		{
+			current = current->failure_node;
+			AC_STAT(thiz, failure_hops, 1);
+		}
+
+		if (!next)
+		{
+			AC_STAT(thiz, root_restarts, 1);
+			continue;
+		}
+
+		current = next;
+		AC_STAT(thiz, transitions, 1);
+
+		if (!current->final)
+			continue;
+
+		/* We found a match */
+		AC_STAT_OUTPUT(thiz, current);
+		if (current->bound || (current->groups & ~thiz->groups))
+		{
+			if (ac_automata_selective (thiz, kind, k, str, current, position, 0))
+				goto done;
+		}
+		else if (ac_automata_report (thiz, kind, k, thiz->output_ids + current->outputs,
+				current->outputs_num, position + thiz->base_position))
+			goto done;
+	}
+
+done:
+	if (thiz->bounded)
+		ac_automata_keep_history (thiz, str, position);
+
+	if (thiz->codepoints)
+		ac_automata_cp_position (thiz, str, thiz->base_position + position);
+
+	/* save status variables */
+	thiz->current_node = current;
+	thiz->base_position += position;
+
+	return k->found;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_scan
+
+DESCRIPTION:
+	Run the kernel for one search call. In AC_INSTRUMENT builds the
+	counters of 'stats' start from zero and hardware counters are read
+	around it; otherwise it is the kernel itself.
+******************************************************************************/
+static inline __attribute__((always_inline))
+unsigned long ac_automata_scan (AC_AUTOMATA * thiz, STRING * str, const int kind,
+		struct ac_kernel * k)
+{
+#ifdef AC_INSTRUMENT
+	unsigned long found, base = thiz->base_position;
+	unsigned long long hw[AC_PERF_COUNTERS];
+
+	memset (&thiz->stats, 0, sizeof(AC_SCAN_STATS));
+	ac_perf_start (&thiz->perf);
+
+	found = ac_automata_kernel (thiz, str, kind, k);
+
+	if ((thiz->stats.hw = ac_perf_stop (&thiz->perf, hw)))
+	{
+		thiz->stats.cycles = hw[AC_PERF_CYCLES];
+		thiz->stats.llc_misses = hw[AC_PERF_LLC_MISSES];
+		thiz->stats.branch_misses = hw[AC_PERF_BRANCH_MISSES];
+		thiz->stats.dtlb_misses = hw[AC_PERF_DTLB_MISSES];
+	}
+	thiz->stats.alphas = thiz->base_position - base;
+
+	return found;
+#else
+	return ac_automata_kernel (thiz, str, kind, k);
+#endif
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_search
+
+DESCRIPTION:
+	Search for patterns inside the given input, as it finds a match
+	it will call the Callback functions to report it to caller.
+******************************************************************************/
+void ac_automata_search (AC_AUTOMATA * thiz, STRING * str, int automata_num, int thread_num)
+{
+	struct ac_kernel k = { NULL, 0, NULL, automata_num, thread_num, 0 };
+
+	if(thiz->accept_strings)
+		/* you must call ac_automata_locate_failure() first */
+		return;
+
+	ac_automata_scan (thiz, str, AC_KERNEL_CALLBACK, &k);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_exists
+
+RETURNS:
+	1 if any pattern occurs in the input, otherwise 0
+
+DESCRIPTION:
+	Like ac_automata_search() but stops at the first match without
+	reporting it. The automata state is left right after that match,
+	so a repeated call goes on from there.
+******************************************************************************/
+int ac_automata_exists (AC_AUTOMATA * thiz, STRING * str)
+{
+	struct ac_kernel k = { NULL, 0, NULL, 0, 0, 0 };
+
+	if(thiz->accept_strings)
+		return 0;
+
+	return ac_automata_scan (thiz, str, AC_KERNEL_EXISTS, &k);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_count
+
+RETURNS:
+	Number of pattern occurrences in the input, i.e. the sum of
+	MATCH::match_num over all matches ac_automata_search() would report.
+******************************************************************************/
+unsigned long ac_automata_count (AC_AUTOMATA * thiz, STRING * str)
+{
+	struct ac_kernel k = { NULL, 0, NULL, 0, 0, 0 };
+
+	if(thiz->accept_strings)
+		return 0;
+
+	return ac_automata_scan (thiz, str, AC_KERNEL_COUNT, &k);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_count_each
+
+PARAMS:
+	unsigned long * counts: Array of counters indexed by STRING::id
+	STRINGID counts_num: Length of 'counts'; strings with larger id
+	                     are counted in the return value only
+
+RETURNS:
+	Number of pattern occurrences in the input (see ac_automata_count)
+
+DESCRIPTION:
+	Add the number of occurrences of every pattern to its counter.
+	'counts' is not cleared, so it accumulates over chunks.
+******************************************************************************/
+unsigned long ac_automata_count_each (AC_AUTOMATA * thiz, STRING * str,
+		unsigned long * counts, STRINGID counts_num)
+{
+	struct ac_kernel k = { NULL, counts_num, counts, 0, 0, 0 };
+
+	if(thiz->accept_strings)
+		return 0;
+
+	return ac_automata_scan (thiz, str, AC_KERNEL_COUNT_EACH, &k);
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_first_n
+
+PARAMS:
+	MATCH * matches: Output array of at least 'n' elements
+	unsigned int n: Maximum number of matches to report
+
+RETURNS:
+	Number of matches written to 'matches'
+
+DESCRIPTION:
+	Collect the first 'n' matches and stop. matched_strings of the
+	returned matches point into the automata (or view) and stay valid
+	until its next search call. A repeated call goes on after the last
+	match.
+******************************************************************************/
+unsigned int ac_automata_first_n (AC_AUTOMATA * thiz, STRING * str,
+		MATCH * matches, unsigned int n)
+{
+	struct ac_kernel k = { matches, n, NULL, 0, 0, 0 };
+	unsigned int found, i;
+	AC_INDEX used = 0;
+
+	if(thiz->accept_strings || !n)
+		return 0;
+
+	found = ac_automata_scan (thiz, str, AC_KERNEL_FIRST_N, &k);
+
+	for (i=0; i < found; i++)
+	{
+		matches[i].matched_strings = thiz->match_strings + used;
+		used += matches[i].match_num;
+	}
+
+	return found;
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_scan_stats
+
+PARAMS:
+	AC_SCAN_STATS * stats: Set to the counters of the last search call
+
+RETURNS:
+	ACERR_NONE, or ACERR_UNSUPPORTED if the library is built without
+	AC_INSTRUMENT
+
+DESCRIPTION:
+	Every search call (ac_automata_search, ac_automata_count, ...) starts
+	the counters from zero, so they tell what that call did; e.g.
+	failure_hops / alphas is the number of failure links followed per
+	input alpha. A search of long strings with skips (see ac_wm.h)
+	counts windows instead of transitions.
+******************************************************************************/
+AC_ERROR ac_automata_scan_stats (AC_AUTOMATA * thiz, AC_SCAN_STATS * stats)
+{
+#ifdef AC_INSTRUMENT
+	*stats = thiz->stats;
+	return ACERR_NONE;
+#else
+	memset (stats, 0, sizeof(AC_SCAN_STATS));
+	return ACERR_UNSUPPORTED;
+#endif
+}
+
+
+/******************************************************************************
+FUNCTION: ac_automata_set_hw_counters
+
+PARAMS:
+	int on: 1 to read hardware counters around every search call, 0 to
+	        stop it and close them
+
+RETURNS:
+	ACERR_NONE, or ACERR_UNSUPPORTED without AC_INSTRUMENT or if the
+	system does not give the counters (see ac_perf.h)
+
+DESCRIPTION:
+	The counters are of the calling thread: turn them on from the thread
+	which searches, and on each view separately. ac_automata_view_release()
+	turns them off.
+******************************************************************************/
+AC_ERROR ac_automata_set_hw_counters (AC_AUTOMATA * thiz, int on)
+{
+#ifdef AC_INSTRUMENT
+	ac_perf_close (&thiz->perf);
+
+	if (on && ac_perf_open (&thiz->perf))
+		return ACERR_UNSUPPORTED;
+
+	return ACERR_NONE;
+#else
+	return on ? ACERR_UNSUPPORTED : ACERR_NONE;
+#endif
 }
 
 
@@ -340,27 +1918,29 @@ DESCRIPTION:
 #ifdef DEBUG_DISPLAY_AC
 void ac_automata_dbg_show (AC_AUTOMATA * thiz)
 {
-	unsigned int i, j;
+	AC_INDEX i;
+	AC_COUNT j;
 	NODE * n;
 	struct edge * e;
-	STRING sid;
+	STRING * sid;
 
 	for (i=0; i<thiz->all_nodes_num; i++)
 	{
 		if(!i)
 			printf("--------------------------------------\n");
 		n = thiz->all_nodes[i];
-		printf("NODE(%d)/----FAIL---> NODE(%d)\n", n->id, (n->failure_node)?n->failure_node->id:0);
+		printf("NODE(%lu)/----FAIL---> NODE(%lu)\n", (unsigned long) n->id,
+			(unsigned long) ((n->failure_node)?n->failure_node->id:0));
 		for (j=0; j<n->outgoing_degree; j++)
 		{
 			e = &n->outgoing[j];
-			printf("         |----(%c)----> NODE(%d)\n", e->alpha, e->next->id);
+			printf("         |----(%c)----> NODE(%lu)\n", e->alpha, (unsigned long) e->next->id);
 		}
 		printf("ACCEPTED STRING: {");
-		for (j=0; j<n->matched_strings_num; j++)
+		for (j=0; j<n->outputs_num; j++)
 		{
-			sid = n->matched_strings[j];
-			printf("%ld ", sid.id);
+			sid = &thiz->patterns[thiz->output_ids[n->outputs + j]];
+			printf("%ld ", sid->id);
 		}
 		printf("}\n");
 		printf("--------------------------------------\n");
@@ -23,6 +23,38 @@
 
 #include "config.h"
 #include "node.h"
+#include "ac_wm.h"
+#include "ac_perf.h"
+
+struct match_attr
+/* Attributes of a string, parallel to automata::patterns */
+{
+	unsigned char flags; /* AC_BOUND_* flags of the string */
+	unsigned char group; /* Group of the string */
+};
+
+typedef struct
+/* What the last search call did; counted in AC_INSTRUMENT builds only */
+{
+	unsigned long alphas; /* Input alphas consumed */
+	unsigned long transitions; /* Goto transitions taken */
+	unsigned long failure_hops; /* Failure links followed */
+	unsigned long root_restarts; /* Alphas without a transition, even at the root */
+	unsigned long final_nodes; /* Final nodes reached */
+	unsigned long outputs; /* Matched strings at them, i.e. output chain lengths */
+	unsigned long longest_output; /* Longest output chain */
+	unsigned long reports; /* Matches reported, to any kind of search */
+	unsigned long callbacks; /* Calls of the match callback */
+	unsigned long wm_windows; /* Wu-Manber windows looked up */
+	unsigned long wm_compares; /* Strings compared in Wu-Manber windows */
+
+	/* Hardware counters, see ac_automata_set_hw_counters() */
+	int hw; /* 1 if the values below are read */
+	unsigned long long cycles;
+	unsigned long long llc_misses;
+	unsigned long long branch_misses;
+	unsigned long long dtlb_misses; /* 0 if the CPU does not count them */
+} AC_SCAN_STATS;
 
 typedef struct
 {
@@ -33,10 +65,30 @@ typedef struct
 	   it will be used to traverse or release all nodes.
 	*/
 	NODE ** all_nodes;
-	unsigned int all_nodes_num; /* Number of all nodes in the automata */
-	unsigned int all_nodes_max; /* Max capacity of allocated memory for *all_nodes */
+	AC_INDEX all_nodes_num; /* Number of all nodes in the automata */
+	AC_INDEX all_nodes_max; /* Max capacity of allocated memory for *all_nodes */
+
+	/* Pattern table: every added string once, in order of addition. The
+	   index of a string is its priority in AC_SEMANTICS_LEFTMOST_FIRST. */
+	STRING * patterns;
+	struct match_attr * pattern_attrs;
+	AC_INDEX * pattern_nodes; /* Node ID of every string, until located */
+	AC_INDEX patterns_max; /* Max capacity of the pattern table */
+
+	/* Output pool: the matched strings of all nodes, as ranges given by
+	   node::outputs and node::outputs_num. A node without strings of its
+	   own shares the range of its failure node. output_ids are indices in
+	   the pattern table. */
+	AC_INDEX * output_ids;
+	AC_INDEX outputs_num; /* Size of the output pool */
+	AC_INDEX outputs_max; /* Max capacity of the output pool */
 
 	MATCH match; /* Any match is writen in here */
+
+	/* MATCH::matched_strings of the reports, built from the output pool;
+	   a view has its own (see ac_automata_view_release()) */
+	STRING * match_strings;
+	AC_INDEX match_strings_max;
 	MATCH_CALBACK match_callback; /* Match callback function */
 
 	/* this is a flag for string acceptance check 
@@ -45,6 +97,11 @@ typedef struct
 	*/
 	unsigned int accept_strings;
 
+	AC_FOLD fold; /* Case folding mode, see ac_automata_set_fold() */
+	AC_SEMANTICS semantics; /* See ac_automata_set_semantics() */
+	AC_GROUPS groups; /* Selected groups, see ac_automata_select_groups() */
+	int codepoints; /* Report MATCH::cp_position, see ac_automata_set_codepoints() */
+
 	/* 
 	   following members keep automata state for sake of repeated call for
 	   ac_automata_search(); it needed when we deal with larg input string.
@@ -54,18 +111,69 @@ typedef struct
 	NODE * current_node; /* Pointer to current node while searching */
 	unsigned long base_position; /* Represents the position of current chunk related to whole input */
 
+	/* Boundary checks (see AC_BOUND_* in ac_types.h) */
+	unsigned int bounded; /* OR of the flags of all strings */
+	NODE * pending_node; /* A match at end of last chunk, waiting for the next alpha */
+	AC_COUNT history_len; /* Length of 'history' */
+	ALPHA history[AC_BOUND_MAX_LENGTH + 1]; /* Last alphas before current chunk */
+
+	/* Leftmost semantics: the best match so far, not reported yet */
+	STRING * candidate; /* NULL if none */
+	unsigned long candidate_start; /* Absolute positions of the match */
+	unsigned long candidate_end;
+	AC_INDEX candidate_order; /* Index of the string in the pattern table */
+
+	/* Wu-Manber search of long strings (see ac_wm.h), NULL if not used.
+	   Matches are found by start and reported by end, so the longest one
+	   ending at each position waits in wm_pending until no other string
+	   can end there. */
+	AC_WM * wm;
+	unsigned long wm_next; /* Absolute start of the next window to check */
+	unsigned long wm_verified; /* Strings ending up to here are found */
+	unsigned long wm_first; /* Least end of the pending matches */
+	AC_COUNT wm_pending_num;
+	NODE * wm_pending[AC_BOUND_MAX_LENGTH + 1]; /* Indexed by end */
+
+	/* Memory pages of the nodes, see ac_automata_set_pages() */
+	AC_PAGES pages; /* Wanted */
+	void * region; /* Packed nodes and edge tables, NULL if not packed */
+	unsigned long region_size;
+	AC_PAGES region_pages; /* Pages the region got */
+
+	/* Code point positions: cp_count code points before byte cp_mark */
+	unsigned long cp_mark;
+	unsigned long cp_count;
+
 	/* Statistic Variables */
 	unsigned long total_strings; /* Total Strings in the Automata */
+	AC_SCAN_STATS stats; /* Of the last search call (AC_INSTRUMENT) */
+	AC_PERF perf; /* Hardware counters of the search (AC_INSTRUMENT) */
 
 } AC_AUTOMATA;
 
 
 /* Public Functions */
 void     ac_automata_init           (AC_AUTOMATA * thiz, MATCH_CALBACK mc);
+AC_ERROR ac_automata_set_fold       (AC_AUTOMATA * thiz, AC_FOLD fold);
+void     ac_automata_fold_string    (AC_FOLD fold, STRING * str, ALPHA * folded);
+AC_ERROR ac_automata_set_semantics  (AC_AUTOMATA * thiz, AC_SEMANTICS semantics);
 AC_ERROR ac_automata_add_string     (AC_AUTOMATA * thiz, STRING * str);
+AC_ERROR ac_automata_add_string_ex  (AC_AUTOMATA * thiz, STRING * str, unsigned int flags);
+AC_ERROR ac_automata_add_string_group (AC_AUTOMATA * thiz, STRING * str, unsigned int group, unsigned int flags);
+void     ac_automata_select_groups  (AC_AUTOMATA * thiz, AC_GROUPS groups);
+void     ac_automata_set_codepoints (AC_AUTOMATA * thiz, int on);
+AC_ERROR ac_automata_set_pages      (AC_AUTOMATA * thiz, AC_PAGES pages);
 void     ac_automata_locate_failure (AC_AUTOMATA * thiz);
 void     ac_automata_search         (AC_AUTOMATA * thiz, STRING * str, int automata_num, int thread_num);
+int      ac_automata_exists         (AC_AUTOMATA * thiz, STRING * str);
+unsigned long ac_automata_count     (AC_AUTOMATA * thiz, STRING * str);
+unsigned long ac_automata_count_each(AC_AUTOMATA * thiz, STRING * str, unsigned long * counts, STRINGID counts_num);
+unsigned int  ac_automata_first_n   (AC_AUTOMATA * thiz, STRING * str, MATCH * matches, unsigned int n);
+AC_ERROR ac_automata_scan_stats     (AC_AUTOMATA * thiz, AC_SCAN_STATS * stats);
+AC_ERROR ac_automata_set_hw_counters(AC_AUTOMATA * thiz, int on);
 void     ac_automata_reset          (AC_AUTOMATA * thiz);
+void     ac_automata_view           (AC_AUTOMATA * view, AC_AUTOMATA * origin, MATCH_CALBACK mc);
+void     ac_automata_view_release   (AC_AUTOMATA * view);
 void     ac_automata_release        (AC_AUTOMATA * thiz);
 
 #ifdef DEBUG_DISPLAY_AC
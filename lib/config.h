@@ -24,5 +24,12 @@
 /* Define below macro to enable automata display function: ac_automata_dbg_show() */
 #define DEBUG_DISPLAY_AC
 
+/* Define below macro to use 64-bit sizes (see Size Profile in ac_types.h) */
+/* #define AC_PROFILE_LARGE */
+
+/* Define below macro to count what every search call does, see
+   ac_automata_scan_stats() (make INSTRUMENT=1 in lib/) */
+/* #define AC_INSTRUMENT */
+
 #endif
 
@@ -23,9 +23,6 @@
 #include <stdlib.h>
 #include "node.h"
 
-/* reallocation step for node::matched_strings array */
-#define REALLOC_CHUNK_MATCHSTR 8
-
 /* reallocation step for node::outgoing array */
 #define REALLOC_CHUNK_OUTGOING 8
 /* TODO: For different depth of node, number of outgoing edges differs
@@ -35,7 +32,6 @@ different depths */
 /* Private Functions */
 void   node_init              (NODE * thiz);
 int    node_edge_compare      (const void * l, const void * r);
-int    node_has_matchstr      (NODE * thiz, STRING * newstr);
 
 
 
@@ -51,9 +47,6 @@ struct node * node_create(void)
 
 	thiz = (NODE *) malloc (sizeof(NODE));
 	node_init(thiz);
-	#ifdef DEBUG_DISPLAY_AC
-	node_assign_id(thiz);
-	#endif
 
 	return thiz;
 }
@@ -71,9 +64,6 @@ void node_init(NODE * thiz)
 
 	thiz->outgoing_max = REALLOC_CHUNK_OUTGOING;
 	thiz->outgoing = (struct edge *) malloc (thiz->outgoing_max*sizeof(struct edge));
-
-	thiz->matched_strings_max = REALLOC_CHUNK_MATCHSTR;
-	thiz->matched_strings = (STRING *) malloc (thiz->matched_strings_max*sizeof(STRING));
 }
 
 
@@ -85,7 +75,8 @@ DESCRIPTION:
 ******************************************************************************/
 void node_release(NODE * thiz)
 {
-	free(thiz->matched_strings);
+	if (thiz->encoding >= NODE_EDGES_SMALL)
+		free(thiz->index);
 	free(thiz->outgoing);
 	free(thiz);
 }
@@ -101,7 +92,7 @@ DESCRIPTION:
 ******************************************************************************/
 NODE * node_find_next(NODE * thiz, ALPHA alpha)
 {
-	int i;
+	AC_COUNT i;
 
 	for (i=0; i < thiz->outgoing_degree; i++)
 	{
@@ -145,37 +136,6 @@ NODE * node_findbs_next (NODE * thiz, ALPHA alpha)
 }
 
 
-/******************************************************************************
-FUNCTION: node_has_matchstr
-
-DESCRIPTION:
-	Determine if a final node contains an string in its accepted string list
-	Return values: 1 = has, 0 = hasn't
-******************************************************************************/
-int node_has_matchstr (NODE * thiz, STRING * newstr)
-{
-	int i, j;
-	STRING * str;
-
-	for (i=0; i < thiz->matched_strings_num; i++)
-	{
-		str = &thiz->matched_strings[i];
-
-		if (str->length != newstr->length)
-			continue;
-
-		for (j=0; j<str->length; j++)
-			if(str->str[j] != newstr->str[j])
-				continue;
-
-		if (j == str->length)
-			return 1;
-	}
-
-	return 0;
-}
-
-
 /******************************************************************************
 FUNCTION: node_create_next
 
@@ -198,29 +158,24 @@ NODE * node_create_next (NODE * thiz, ALPHA alpha)
 
 
 /******************************************************************************
-FUNCTION: node_register_matchstr
+FUNCTION: node_find_longest
 
 DESCRIPTION:
-	Add the string to the list of accepted strings
+	Set node::longest to the index of the longest matched string; of the
+	strings ending at the node, it is the one which starts first.
+	'outputs' is the output pool of the automata, of indices in its
+	pattern table 'patterns'.
 ******************************************************************************/
-void node_register_matchstr(NODE * thiz, STRING * str)
+void node_find_longest(NODE * thiz, STRING * patterns, AC_INDEX * outputs)
 {
-	/* Check if the new string already exists in the node list */
-	if (node_has_matchstr(thiz, str))
-		return;
+	AC_COUNT i;
+	AC_INDEX * ids = outputs + thiz->outputs;
 
-	/* Manage memory */
-	if (thiz->matched_strings_num >= thiz->matched_strings_max)
-	{
-		thiz->matched_strings_max += REALLOC_CHUNK_MATCHSTR;
-		thiz->matched_strings = (STRING *) realloc 
-			(thiz->matched_strings, thiz->matched_strings_max*sizeof(STRING));
-	}
+	thiz->longest = 0;
 
-	thiz->matched_strings[thiz->matched_strings_num].str = str->str;
-	thiz->matched_strings[thiz->matched_strings_num].length = str->length;
-	thiz->matched_strings[thiz->matched_strings_num].id = str->id;
-	thiz->matched_strings_num++;
+	for (i=1; i < thiz->outputs_num; i++)
+		if (patterns[ids[i]].length > patterns[ids[thiz->longest]].length)
+			thiz->longest = i;
 }
 
 
@@ -244,21 +199,6 @@ void node_register_outgoing (NODE * thiz, NODE * next, ALPHA alpha)
 }
 
 
-/******************************************************************************
-FUNCTION: node_assign_id
-
-DESCRIPTION: 
-	every node has a unique ID only for debugging purpose. it is not
-	necessary in normal execution.
-******************************************************************************/
-#ifdef DEBUG_DISPLAY_AC
-void node_assign_id (NODE * thiz)
-{
-	static int unique_id = 100;
-	thiz->id = unique_id ++;
-}
-#endif
-
 /******************************************************************************
 FUNCTION: node_edge_compare
 
@@ -294,3 +234,106 @@ void node_sort_edges (NODE * thiz)
 			node_edge_compare);
 }
 
+
+/******************************************************************************
+FUNCTION: node_index_size
+
+DESCRIPTION:
+	Bytes of the index of the encoding of the node, 0 if it has none.
+******************************************************************************/
+unsigned long node_index_size (NODE * thiz)
+{
+	switch (thiz->encoding)
+	{
+		case NODE_EDGES_SMALL:
+			return NODE_SMALL_MAX * sizeof(ALPHA);
+		case NODE_EDGES_BITMAP:
+			return sizeof(struct node_bitmap) + thiz->outgoing_degree * sizeof(NODE *);
+		case NODE_EDGES_DENSE:
+			return 256 * sizeof(NODE *);
+		default:
+			return 0;
+	}
+}
+
+
+/******************************************************************************
+FUNCTION: node_freeze
+
+PARAMS:
+	int dense: 1 to make it NODE_EDGES_DENSE
+
+DESCRIPTION:
+	Choose the encoding of the outgoing edges by the degree and build its
+	index; edges must be sorted and no more added. The 'outgoing' array
+	is kept, at its exact size, for whoever walks the edges.
+******************************************************************************/
+void node_freeze (NODE * thiz, int dense)
+{
+	struct node_bitmap * bitmap;
+	ALPHA * alphas;
+	NODE ** row;
+	AC_COUNT i;
+	unsigned char a;
+
+	if (thiz->outgoing_degree < thiz->outgoing_max)
+	{
+		thiz->outgoing_max = thiz->outgoing_degree;
+		if (thiz->outgoing_degree)
+			thiz->outgoing = (struct edge *) realloc
+				(thiz->outgoing, thiz->outgoing_max*sizeof(struct edge));
+		else
+		{
+			free (thiz->outgoing);
+			thiz->outgoing = NULL;
+		}
+	}
+
+	if (dense)
+	{
+		row = (NODE **) calloc (256, sizeof(NODE *));
+		for (i=0; i < thiz->outgoing_degree; i++)
+			row[(unsigned char) thiz->outgoing[i].alpha] = thiz->outgoing[i].next;
+		thiz->index = row;
+		thiz->encoding = NODE_EDGES_DENSE;
+	}
+	else if (!thiz->outgoing_degree)
+		thiz->encoding = NODE_EDGES_NONE;
+	else if (thiz->outgoing_degree == 1)
+	{
+		thiz->alpha = thiz->outgoing[0].alpha;
+		thiz->index = thiz->outgoing[0].next;
+		thiz->encoding = NODE_EDGES_ONE;
+	}
+	else if (thiz->outgoing_degree <= NODE_SMALL_MAX)
+	{
+		/* Always NODE_SMALL_MAX alphas, they are loaded at once */
+		alphas = (ALPHA *) calloc (NODE_SMALL_MAX, sizeof(ALPHA));
+		for (i=0; i < thiz->outgoing_degree; i++)
+			alphas[i] = thiz->outgoing[i].alpha;
+		thiz->index = alphas;
+		thiz->encoding = NODE_EDGES_SMALL;
+	}
+	else
+	{
+		bitmap = (struct node_bitmap *) calloc (1, sizeof(struct node_bitmap) +
+			thiz->outgoing_degree*sizeof(NODE *));
+		for (i=0; i < thiz->outgoing_degree; i++)
+		{
+			a = (unsigned char) thiz->outgoing[i].alpha;
+			bitmap->bits[a >> 6] |= 1ULL << (a & 63);
+		}
+		for (i=1; i < 4; i++)
+			bitmap->before[i] = bitmap->before[i - 1] +
+				__builtin_popcountll (bitmap->bits[i - 1]);
+		/* Edges are sorted by ALPHA, which may be signed */
+		for (i=0; i < thiz->outgoing_degree; i++)
+		{
+			a = (unsigned char) thiz->outgoing[i].alpha;
+			bitmap->next[bitmap->before[a >> 6] + __builtin_popcountll
+				(bitmap->bits[a >> 6] & ((1ULL << (a & 63)) - 1))] = thiz->outgoing[i].next;
+		}
+		thiz->index = bitmap;
+		thiz->encoding = NODE_EDGES_BITMAP;
+	}
+}
@@ -24,26 +24,54 @@
 #include "config.h"
 #include "ac_types.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* Forward Declaration */
 struct edge;
 
+/* Encodings of outgoing edges, chosen for every node by node_freeze()
+   when the automata is located; until then edges are only kept sorted */
+#define NODE_EDGES_SORTED 0 /* Binary search of 'outgoing' */
+#define NODE_EDGES_NONE   1 /* A leaf */
+#define NODE_EDGES_ONE    2 /* One edge, kept in the node */
+#define NODE_EDGES_SMALL  3 /* Up to NODE_SMALL_MAX alphas, compared at once */
+#define NODE_EDGES_BITMAP 4 /* A bit per alpha, the next node by its rank */
+#define NODE_EDGES_DENSE  5 /* The next node of every alpha */
+
+/* Largest degree of NODE_EDGES_SMALL */
+#define NODE_SMALL_MAX 16
+
+/* Nodes of up to this depth and at least this degree are NODE_EDGES_DENSE;
+   the root always is */
+#define NODE_DENSE_DEPTH 2
+#define NODE_DENSE_DEGREE 32
+
 typedef struct node
 /* The Node of the Automata */
 {
-	int id; /* Node ID : for debugging purpose */
+	AC_INDEX id; /* Node ID : index of the node in automata::all_nodes */
 	short int final; /* 0: no ; 1: yes, it is a final node */
+	unsigned char encoding; /* NODE_EDGES_*: how the next node is found */
+	ALPHA alpha; /* NODE_EDGES_ONE: alpha of the edge */
+	void * index; /* Next node (NODE_EDGES_ONE), alphas (NODE_EDGES_SMALL),
+	                 struct node_bitmap or row of 256 next nodes */
 	struct node * failure_node; /* The failure node of this node */
-	unsigned short depth; /* depth: distance between this node to the root */
+	AC_COUNT depth; /* depth: distance between this node to the root */
 
-	/* Matched Strings */
-	STRING * matched_strings; /* Array of matched strings */
-	unsigned short matched_strings_num; /* Number of matched string at this node */
-	unsigned short matched_strings_max; /* Max capacity of allocated memory for 'matched_strings' */
+	/* Matched Strings: a range of the output pool of the automata, shared
+	   with the failure node if the node has no string of its own */
+	AC_INDEX outputs; /* Index of the first matched string in the pool */
+	AC_COUNT outputs_num; /* Number of matched string at this node */
+	AC_COUNT longest; /* Index of the longest matched string in the range */
+	unsigned char bound; /* OR of AC_BOUND_* flags of matched strings */
+	AC_GROUPS groups; /* Groups of matched strings */
 
-	/* Outgoing Edges */
-	struct edge * outgoing; /* Array of outgoing edges */
-	unsigned short outgoing_degree; /* Number of outgoing edges */
-	unsigned short outgoing_max; /* Max capacity of allocated memory for 'outgoing' */
+	/* Outgoing Edges, in every encoding */
+	struct edge * outgoing; /* Array of outgoing edges, sorted by alpha */
+	AC_COUNT outgoing_degree; /* Number of outgoing edges */
+	AC_COUNT outgoing_max; /* Max capacity of allocated memory for 'outgoing' */
 } NODE;
 
 struct edge
@@ -53,15 +81,80 @@ struct edge
 	struct node * next; /* Target of the edge */
 };
 
+struct node_bitmap
+/* NODE_EDGES_BITMAP */
+{
+	unsigned long long bits[4]; /* Bit a is set if there is an edge on alpha a */
+	unsigned short before[4]; /* Number of edges of the preceding words */
+	struct node * next[]; /* Targets, by unsigned alpha */
+};
+
 /* Public Functions */
 NODE * node_create            (void);
 NODE * node_create_next       (NODE * thiz, ALPHA alpha);
-void   node_register_matchstr (NODE * thiz, STRING * str);
+void   node_find_longest      (NODE * thiz, STRING * patterns, AC_INDEX * outputs);
 void   node_register_outgoing (NODE * thiz, NODE * next, ALPHA alpha);
 NODE * node_find_next         (NODE * thiz, ALPHA alpha);
 NODE * node_findbs_next       (NODE * thiz, ALPHA alpha);
 void   node_release           (NODE * thiz);
-void   node_assign_id         (NODE * thiz);
 void   node_sort_edges        (NODE * thiz);
+void   node_freeze            (NODE * thiz, int dense);
+unsigned long node_index_size (NODE * thiz);
+
+
+/******************************************************************************
+FUNCTION: node_next
+
+DESCRIPTION:
+	Find out the target node from here for a given Alpha, in the encoding
+	of the node. It is the transition of the search loops, so it is inline.
+******************************************************************************/
+static inline NODE * node_next (NODE * thiz, ALPHA alpha)
+{
+	const struct node_bitmap * bitmap;
+	unsigned char a = (unsigned char) alpha;
+	unsigned long long bit;
+#ifdef __SSE2__
+	unsigned int mask;
+#else
+	AC_COUNT i;
+#endif
+
+	switch (thiz->encoding)
+	{
+		case NODE_EDGES_NONE:
+			return NULL;
+
+		case NODE_EDGES_ONE:
+			return (thiz->alpha == alpha) ? (NODE *) thiz->index : NULL;
+
+		case NODE_EDGES_SMALL:
+#ifdef __SSE2__
+			mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+				_mm_loadu_si128 ((const __m128i *) thiz->index),
+				_mm_set1_epi8 (alpha))) & ((1u << thiz->outgoing_degree) - 1);
+			return mask ? thiz->outgoing[__builtin_ctz (mask)].next : NULL;
+#else
+			for (i=0; i < thiz->outgoing_degree; i++)
+				if (((const ALPHA *) thiz->index)[i] == alpha)
+					return thiz->outgoing[i].next;
+			return NULL;
+#endif
+
+		case NODE_EDGES_BITMAP:
+			bitmap = (const struct node_bitmap *) thiz->index;
+			bit = 1ULL << (a & 63);
+			if (!(bitmap->bits[a >> 6] & bit))
+				return NULL;
+			return bitmap->next[bitmap->before[a >> 6] +
+				__builtin_popcountll (bitmap->bits[a >> 6] & (bit - 1))];
+
+		case NODE_EDGES_DENSE:
+			return ((NODE **) thiz->index)[a];
+
+		default:
+			return node_findbs_next (thiz, alpha);
+	}
+}
 
 #endif
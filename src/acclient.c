@@ -0,0 +1,390 @@
+/*
+	acclient: send a document to acserver many times, keeping up to
+	'depth' requests in flight, and print the latency of the requests
+	as seen by the client, with the statistics of the server, as JSON.
+
+	usage: acclient [-cepS] [-n requests] [-d depth] -U socket -a name input_file
+	       acclient -S -U socket
+
+	-p prints the matches of the first response instead, one per line as
+	"position id". The latency of a request goes from its first byte sent
+	to the last byte of its response read. Requests are sent by a thread
+	of their own while the responses are read, as the server stops
+	reading requests that are too far ahead of their responses.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "acserver.h"
+
+/* The requests to send, and how far their responses are */
+struct sender
+{
+	int fd;
+	uint16_t op;
+	const char *name;
+	const char *document;
+	uint32_t length;
+	unsigned long requests, depth;
+	unsigned long sent, received;
+	double *sent_at;
+	pthread_mutex_t lock;
+	pthread_cond_t room; /* A response came, so another request may go */
+};
+
+void *send_requests (void *arg);
+int connect_server (const char *path);
+void send_request (int fd, uint32_t tag, uint16_t op, const char *name,
+		const char *payload, uint32_t length);
+char *read_response (int fd, struct acs_response *response);
+char *read_file (const char *filename, uint32_t *length);
+int read_full (int fd, void *buffer, size_t length);
+int write_full (int fd, struct iovec *iov, int iovcnt);
+double now_usec (void);
+int compare_double (const void *l, const void *r);
+void print_usage (const char *exec_file);
+
+int main(int argc, char **argv)
+{
+	struct acs_response response;
+	struct acs_match *matches;
+	struct sender sender = { -1, 0, NULL, NULL, 0, 0, 0, 0, 0, NULL,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	unsigned long requests = 1000, depth = 1, received = 0, i, found = 0;
+	uint32_t length = 0;
+	double *latency, start, elapsed;
+	char *document = NULL, *payload;
+	pthread_t thread;
+	int fd, clopt;
+
+	/* Command line config */
+	const char *socket_path = NULL;
+	const char *name = NULL;
+	uint16_t op = ACS_SCAN;
+	short print = 0;
+	short stats = 0;
+
+	while ((clopt = getopt(argc, argv, "U:a:n:d:cepSh?")) != -1) {
+		switch (clopt) {
+			case 'U':
+				socket_path = optarg;
+				break;
+			case 'a':
+				name = optarg;
+				break;
+			case 'n':
+				requests = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				depth = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				op = ACS_COUNT;
+				break;
+			case 'e':
+				op = ACS_EXISTS;
+				break;
+			case 'p':
+				print = 1;
+				requests = 1;
+				break;
+			case 'S':
+				stats = 1;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!socket_path || (!stats && (!name || optind >= argc || !requests || !depth)) ||
+		(name && strlen(name) > ACS_MAX_NAME)) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+
+	fd = connect_server(socket_path);
+
+	if (stats && !name) {
+		send_request(fd, 0, ACS_STATS, "", NULL, 0);
+		payload = read_response(fd, &response);
+		printf("%.*s\n", (int) response.length, payload);
+		free(payload);
+		return 0;
+	}
+
+	document = read_file(argv[optind], &length);
+	latency = (double *) malloc(requests * sizeof(double));
+
+	sender.fd = fd;
+	sender.op = op;
+	sender.name = name;
+	sender.document = document;
+	sender.length = length;
+	sender.requests = requests;
+	sender.depth = depth;
+	sender.sent_at = (double *) malloc(requests * sizeof(double));
+
+	start = now_usec();
+	if (pthread_create(&thread, NULL, send_requests, &sender)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	while (received < requests) {
+		payload = read_response(fd, &response);
+
+		pthread_mutex_lock(&sender.lock);
+		if (response.tag >= sender.sent) {
+			fprintf(stderr, "Unexpected response - tag %u\n", response.tag);
+			exit(1);
+		}
+		latency[received++] = now_usec() - sender.sent_at[response.tag];
+		sender.received = received;
+		pthread_cond_signal(&sender.room);
+		pthread_mutex_unlock(&sender.lock);
+
+		if (response.status != ACS_OK) {
+			fprintf(stderr, "Request failed - status %u\n", response.status);
+			exit(1);
+		}
+		if (!response.tag) {
+			if (op == ACS_SCAN)
+				found = response.length / sizeof(struct acs_match);
+			else if (op == ACS_COUNT)
+				found = *(uint64_t *) payload;
+			else
+				found = *(uint32_t *) payload;
+		}
+		if (print && op == ACS_SCAN) {
+			matches = (struct acs_match *) payload;
+			for (i = 0; i < response.length / sizeof(struct acs_match); i++)
+				printf("%u %u\n", matches[i].position, matches[i].id);
+		}
+		free(payload);
+	}
+	elapsed = now_usec() - start;
+	pthread_join(thread, NULL);
+
+	if (print) {
+		if (op != ACS_SCAN)
+			printf("%lu\n", found);
+		return 0;
+	}
+
+	qsort(latency, requests, sizeof(double), compare_double);
+
+	printf("{\"automata\": \"%s\", \"requests\": %lu, \"depth\": %lu, \"payload_bytes\": %u, "
+		"\"matches\": %lu, \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+		"\"requests_per_s\": %.0f", name, requests, depth, length, found,
+		latency[(requests * 50 + 99) / 100 - 1], latency[(requests * 99 + 99) / 100 - 1],
+		latency[requests - 1], requests / elapsed * 1e6);
+
+	if (stats) {
+		send_request(fd, 0, ACS_STATS, "", NULL, 0);
+		payload = read_response(fd, &response);
+		printf(", \"server\": %.*s", (int) response.length, payload);
+		free(payload);
+	}
+	printf("}\n");
+
+	close(fd);
+	free(document);
+	free(sender.sent_at);
+	free(latency);
+
+	return 0;
+}
+
+
+/* Keep up to 'depth' requests in flight until all are sent */
+void *send_requests (void *arg)
+{
+	struct sender *s = (struct sender *) arg;
+	unsigned long tag;
+
+	for (tag = 0; tag < s->requests; tag++) {
+		pthread_mutex_lock(&s->lock);
+		while (tag - s->received >= s->depth)
+			pthread_cond_wait(&s->room, &s->lock);
+		s->sent_at[tag] = now_usec();
+		s->sent = tag + 1;
+		pthread_mutex_unlock(&s->lock);
+
+		send_request(s->fd, tag, s->op, s->name, s->document, s->length);
+	}
+
+	return NULL;
+}
+
+
+/* Connect, waiting up to 10 s for the server to come up */
+int connect_server (const char *path)
+{
+	struct sockaddr_un addr;
+	int fd, tries;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	for (tries = 0; ; tries++) {
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+			perror("socket");
+			exit(1);
+		}
+		if (!connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+			return fd;
+		close(fd);
+
+		if (tries == 100) {
+			fprintf(stderr, "Cannot connect to socket - %s: %s\n", path, strerror(errno));
+			exit(1);
+		}
+		usleep(100000);
+	}
+}
+
+
+void send_request (int fd, uint32_t tag, uint16_t op, const char *name,
+		const char *payload, uint32_t length)
+{
+	struct acs_request request = { tag, op, strlen(name), length };
+	struct iovec iov[3];
+
+	iov[0].iov_base = &request;
+	iov[0].iov_len = sizeof(request);
+	iov[1].iov_base = (void *) name;
+	iov[1].iov_len = request.name_length;
+	iov[2].iov_base = (void *) payload;
+	iov[2].iov_len = length;
+
+	if (write_full(fd, iov, 3)) {
+		perror("write");
+		exit(1);
+	}
+}
+
+
+/* The payload of the next response, to be freed */
+char *read_response (int fd, struct acs_response *response)
+{
+	char *payload;
+
+	if (read_full(fd, response, sizeof(*response))) {
+		fprintf(stderr, "Connection closed by the server\n");
+		exit(1);
+	}
+
+	payload = (char *) malloc(response->length ? response->length : 1);
+	if (read_full(fd, payload, response->length)) {
+		fprintf(stderr, "Connection closed by the server\n");
+		exit(1);
+	}
+
+	return payload;
+}
+
+
+char *read_file (const char *filename, uint32_t *length)
+{
+	char *buffer;
+	long size;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb")) || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ||
+		size > ACS_MAX_PAYLOAD) {
+		fprintf(stderr, "Cannot read input file - %s\n", filename);
+		exit(1);
+	}
+	rewind(fp);
+
+	buffer = (char *) malloc(size ? size : 1);
+	*length = fread(buffer, 1, size, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+
+/* Returns 0 when all of it is read */
+int read_full (int fd, void *buffer, size_t length)
+{
+	ssize_t got;
+
+	while (length) {
+		if ((got = read(fd, buffer, length)) <= 0) {
+			if (got < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer = (char *) buffer + got;
+		length -= got;
+	}
+
+	return 0;
+}
+
+
+/* Returns 0 when all of it is written */
+int write_full (int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t put;
+
+	while (iovcnt) {
+		if ((put = writev(fd, iov, iovcnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (; iovcnt && (size_t) put >= iov->iov_len; iov++, iovcnt--)
+			put -= iov->iov_len;
+		if (iovcnt) {
+			iov->iov_base = (char *) iov->iov_base + put;
+			iov->iov_len -= put;
+		}
+	}
+
+	return 0;
+}
+
+
+double now_usec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+int compare_double (const void *l, const void *r)
+{
+	double a = *(const double *) l, b = *(const double *) r;
+
+	return (a > b) - (a < b);
+}
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-cepS] [-n requests] [-d depth] -U socket -a name input_file\n", exec_file);
+	fprintf(stderr, "       %s -S -U socket\n", exec_file);
+	fprintf(stderr, "    -U socket    of acserver\n");
+	fprintf(stderr, "    -a name      automata to search\n");
+	fprintf(stderr, "    -n requests  number of requests (1000)\n");
+	fprintf(stderr, "    -d depth     requests in flight (1)\n");
+	fprintf(stderr, "    -c -e        count matches, or check existence, instead of a scan\n");
+	fprintf(stderr, "    -p           print the matches of one scan\n");
+	fprintf(stderr, "    -S           add the statistics of the server, alone print them\n");
+}
@@ -0,0 +1,161 @@
+/*
+	acgen: compile a pattern file into a C header of static const tables
+	for ac_static.h, so that a fixed pattern set costs nothing at start up.
+
+	usage: acgen [-i] [-m max_mb] -n name pattern_file > name.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aho_corasick.h"
+#include "patterns.h"
+#include "tables.h"
+
+void print_usage (const char *exec_file);
+void print_alphas (const ALPHA * str, unsigned long length);
+
+int main(int argc, char **argv)
+{
+	AC_AUTOMATA aca;
+	STRING *patterns;
+	unsigned int no_of_patterns, i, j, width;
+	unsigned long *offset, states, k;
+	unsigned long max_mb = 64;
+	AC_FOLD fold = AC_FOLD_NONE;
+	const char *name = NULL, *state_type;
+	struct tables t;
+	STRING *s;
+	int clopt;
+
+	while ((clopt = getopt(argc, argv, "n:m:ih?")) != -1) {
+		switch (clopt) {
+			case 'n':
+				name = optarg;
+				break;
+			case 'm':
+				max_mb = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!name || optind >= argc) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+
+	patterns = read_patterns(argv[optind], &no_of_patterns, 1);
+
+	ac_automata_init(&aca, NULL);
+	ac_automata_set_fold(&aca, fold);
+
+	for (i = 0; i < no_of_patterns; i++)
+		if (ac_automata_add_string(&aca, &patterns[i]) == ACERR_LONG_STRING)
+			fprintf(stderr, "Pattern %u is too long, skipped\n", i + 1);
+
+	ac_automata_locate_failure(&aca);
+
+	/* The smallest type which holds every state number */
+	states = aca.all_nodes_num;
+	if (states <= 0x100) {
+		state_type = "unsigned char";
+		width = 1;
+	}
+	else if (states <= 0x10000) {
+		state_type = "unsigned short";
+		width = 2;
+	}
+	else {
+		state_type = "unsigned int";
+		width = 4;
+	}
+
+	if (states * 256 * width > max_mb << 20) {
+		fprintf(stderr, "The table of %lu states needs %lu MB, more than %lu MB (-m)\n",
+			states, (states * 256 * width) >> 20, max_mb);
+		exit(1);
+	}
+
+	build_tables(&aca, &t);
+
+	printf("/* Generated by acgen from %s, do not edit */\n\n", argv[optind]);
+	printf("#include \"ac_static.h\"\n\n");
+	printf("#define %s_STATES %lu\n\n", name, states);
+
+	/* Transitions */
+	printf("static const %s %s_delta[%lu][256] = {\n", state_type, name, states);
+	for (k = 0; k < states; k++) {
+		printf("\t{");
+		for (j = 0; j < 256; j++)
+			printf("%s%lu%s", (j % 16) ? " " : "\n\t\t", t.delta[k * 256 + j],
+				j < 255 ? "," : "");
+		printf("\n\t},\n");
+	}
+	printf("};\n\n");
+
+	/* Every pattern once, one after the other */
+	offset = (unsigned long *) malloc((no_of_patterns + 1) * sizeof(unsigned long));
+	printf("static const ALPHA %s_alphas[] =", name);
+	for (i = 0, offset[0] = 0; i < no_of_patterns; i++) {
+		printf("\n\t");
+		print_alphas(patterns[i].str, patterns[i].length);
+		offset[i + 1] = offset[i] + patterns[i].length;
+	}
+	printf("%s;\n\n", no_of_patterns ? "" : " \"\"");
+
+	/* Matched strings of every state, as AC_AUTOMATA keeps them */
+	printf("static const STRING %s_out[] = {\n", name);
+	for (k = 0; k < t.out_num; k++) {
+		s = &aca.patterns[t.out[k]];
+		printf("\t{ (ALPHA *) %s_alphas + %lu, %lu, %lu },\n", name,
+			offset[s->id - 1], (unsigned long) s->length, (unsigned long) s->id);
+	}
+	if (!t.out_num)
+		printf("\t{ 0, 0, 0 },\n");
+	printf("};\n\n");
+
+	printf("static const unsigned int %s_out_begin[%lu] = {", name, states + 1);
+	for (k = 0; k <= states; k++)
+		printf("%s%lu,", (k % 16) ? " " : "\n\t", t.out_begin[k]);
+	printf("\n};\n\n");
+
+	printf("AC_STATIC_DEFINE(%s, %s)\n", name, state_type);
+
+	release_tables(&t);
+	ac_automata_release(&aca);
+
+	return 0;
+}
+
+/* A C string literal of the alphas */
+void print_alphas (const ALPHA * str, unsigned long length)
+{
+	unsigned long i;
+	unsigned char c;
+
+	putchar('"');
+	for (i = 0; i < length; i++) {
+		c = (unsigned char) str[i];
+		if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?')
+			putchar(c);
+		else
+			printf("\\%03o", c);
+	}
+	putchar('"');
+}
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage : %s [-i] [-m max_mb] -n name pattern_file > name.h\n", exec_file);
+	fprintf(stderr, "    -n name    prefix of the generated tables and functions\n");
+	fprintf(stderr, "    -i         case insensitive (Latin-1)\n");
+	fprintf(stderr, "    -m max_mb  largest transition table to generate (64)\n");
+}
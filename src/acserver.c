@@ -0,0 +1,564 @@
+/*
+	acserver: keep named automata loaded and scan texts sent over a Unix
+	domain socket, so that a small document costs a search, not a start
+	of a process and a build of the automata.
+
+	usage: acserver [-iw] [-s longest|first] [-n workers] -U socket
+	                -P name=pattern_file [-P name=pattern_file ...]
+
+	The protocol is in acserver.h; bin/acclient is a client. A reader
+	thread per connection reads its requests, so a client may pipeline
+	them, and puts them in one queue. A pool of workers (-n, the number
+	of processors by default) takes them in order of arrival and searches
+	each with its own view of the automata, so the automata are shared
+	and never copied. The response is written as soon as the search ends.
+	A reader stops reading while MAX_IN_FLIGHT requests of its connection,
+	or MAX_IN_FLIGHT_BYTES of their payload, wait for their responses, so
+	a client that sends faster than it is served cannot fill the memory.
+
+	The latency of a request, from its last byte read to the last byte of
+	its response written, is kept for the last LATENCY_SAMPLES requests;
+	ACS_STATS returns its p50 and p99. SIGINT or SIGTERM remove the socket
+	and stop the server.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "aho_corasick.h"
+#include "acserver.h"
+#include "patterns.h"
+
+#define MAX_AUTOMATA 64
+#define LATENCY_SAMPLES (1 << 16)
+#define MAX_IN_FLIGHT 64 /* Requests of a connection queued or in progress */
+#define MAX_IN_FLIGHT_BYTES (2 * ACS_MAX_PAYLOAD) /* Their payload */
+
+struct automata
+{
+	const char *name;
+	AC_AUTOMATA aca;
+	unsigned int no_of_patterns;
+};
+
+/* A client; freed when its reader and all its requests are done */
+struct connection
+{
+	int fd;
+	int refs;
+	pthread_mutex_t write_lock; /* Responses of workers are not interleaved */
+
+	/* Requests read and not responded yet; the reader waits on 'drained' */
+	unsigned int in_flight;
+	unsigned long in_flight_bytes;
+	pthread_mutex_t flight_lock;
+	pthread_cond_t drained;
+};
+
+struct job
+{
+	struct connection *conn;
+	struct acs_request request;
+	char name[ACS_MAX_NAME + 1];
+	ALPHA *payload;
+	double received; /* usec */
+	struct job *next;
+};
+
+struct worker
+{
+	pthread_t thread;
+	AC_AUTOMATA views[MAX_AUTOMATA]; /* One view of every automata */
+	struct acs_match *matches; /* Of the search in progress */
+	unsigned long matches_num, matches_max;
+};
+
+struct automata automata[MAX_AUTOMATA];
+unsigned int no_of_automata;
+struct worker *workers;
+
+/* Requests waiting for a worker, first in first out */
+struct job *queue_head, *queue_tail;
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+
+/* Latency of the last requests, usec */
+double latency[LATENCY_SAMPLES];
+unsigned long requests;
+pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *socket_path;
+
+void *reader (void *arg);
+void *work (void *arg);
+void serve (struct worker *w, struct job *job);
+void respond (struct connection *conn, uint32_t tag, uint16_t status,
+		const void *payload, uint32_t length, double received);
+int stats_json (char **json);
+void release_connection (struct connection *conn);
+int read_full (int fd, void *buffer, size_t length);
+int write_full (int fd, struct iovec *iov, int iovcnt);
+double now_usec (void);
+int compare_double (const void *l, const void *r);
+void stop (int signum);
+void print_usage (const char *exec_file);
+int match_handler(MATCH * m, int automata_num, int thread_num);
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_un addr;
+	struct connection *conn;
+	STRING *patterns;
+	unsigned int i, j, no_of_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int listener, fd, clopt;
+	pthread_t thread;
+	char *name;
+
+	/* Command line config */
+	const char *pattern_file[MAX_AUTOMATA];
+	AC_FOLD fold = AC_FOLD_NONE;
+	unsigned int bound = 0;
+	AC_SEMANTICS semantics = AC_SEMANTICS_OVERLAPPING;
+
+	while ((clopt = getopt(argc, argv, "P:U:n:s:iwh?")) != -1) {
+		switch (clopt) {
+			case 'P':
+				if (no_of_automata == MAX_AUTOMATA || !(name = strchr(optarg, '=')) ||
+					name == optarg || name - optarg > ACS_MAX_NAME) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				*name = 0;
+				automata[no_of_automata].name = optarg;
+				pattern_file[no_of_automata++] = name + 1;
+				break;
+			case 'U':
+				socket_path = optarg;
+				break;
+			case 'n':
+				no_of_workers = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				if (!strcmp(optarg, "longest"))
+					semantics = AC_SEMANTICS_LEFTMOST_LONGEST;
+				else if (!strcmp(optarg, "first"))
+					semantics = AC_SEMANTICS_LEFTMOST_FIRST;
+				else {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			case 'w':
+				bound = AC_BOUND_WORD;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!socket_path || !no_of_automata || strlen(socket_path) >= sizeof(addr.sun_path)) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+	if (!no_of_workers)
+		no_of_workers = 1;
+
+	for (i = 0; i < no_of_automata; i++) {
+		patterns = read_patterns(pattern_file[i], &automata[i].no_of_patterns, 1);
+
+		ac_automata_init(&automata[i].aca, match_handler);
+		ac_automata_set_fold(&automata[i].aca, fold);
+		ac_automata_set_semantics(&automata[i].aca, semantics);
+		for (j = 0; j < automata[i].no_of_patterns; j++)
+			ac_automata_add_string_ex(&automata[i].aca, &patterns[j], bound);
+		ac_automata_locate_failure(&automata[i].aca);
+
+		/* The automata refers to the strings, which live as long as the
+		   server; only the array goes */
+		free(patterns);
+	}
+
+	if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		exit(1);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+	unlink(socket_path);
+	if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) || listen(listener, 128)) {
+		fprintf(stderr, "Cannot listen on socket - %s: %s\n", socket_path, strerror(errno));
+		exit(1);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	workers = (struct worker *) calloc(no_of_workers, sizeof(struct worker));
+	for (i = 0; i < no_of_workers; i++) {
+		for (j = 0; j < no_of_automata; j++)
+			ac_automata_view(&workers[i].views[j], &automata[j].aca, NULL);
+		pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+	}
+
+	fprintf(stderr, "acserver: %u automata, %u workers, listening on %s\n",
+		no_of_automata, no_of_workers, socket_path);
+
+	for (;;) {
+		if ((fd = accept(listener, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+
+		conn = (struct connection *) malloc(sizeof(struct connection));
+		conn->fd = fd;
+		conn->refs = 1; /* The reader's */
+		conn->in_flight = 0;
+		conn->in_flight_bytes = 0;
+		pthread_mutex_init(&conn->write_lock, NULL);
+		pthread_mutex_init(&conn->flight_lock, NULL);
+		pthread_cond_init(&conn->drained, NULL);
+
+		if (pthread_create(&thread, NULL, reader, conn)) {
+			release_connection(conn);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	unlink(socket_path);
+
+	return 1;
+}
+
+
+/* Read the requests of a connection into the queue until it closes */
+void *reader (void *arg)
+{
+	struct connection *conn = (struct connection *) arg;
+	struct acs_request request;
+	struct job *job;
+
+	while (!read_full(conn->fd, &request, sizeof(request))) {
+		if (request.length > ACS_MAX_PAYLOAD || request.name_length > ACS_MAX_NAME) {
+			respond(conn, request.tag, ACS_TOO_LARGE, NULL, 0, now_usec());
+			break;
+		}
+
+		/* Read no more until the responses catch up; one request is
+		   always let in */
+		pthread_mutex_lock(&conn->flight_lock);
+		while (conn->in_flight && (conn->in_flight >= MAX_IN_FLIGHT ||
+				conn->in_flight_bytes + request.length > MAX_IN_FLIGHT_BYTES))
+			pthread_cond_wait(&conn->drained, &conn->flight_lock);
+		conn->in_flight++;
+		conn->in_flight_bytes += request.length;
+		pthread_mutex_unlock(&conn->flight_lock);
+
+		job = (struct job *) malloc(sizeof(struct job));
+		job->payload = (ALPHA *) malloc(request.length ? request.length : 1);
+		if (read_full(conn->fd, job->name, request.name_length) ||
+			read_full(conn->fd, job->payload, request.length)) {
+			free(job->payload);
+			free(job);
+			break;
+		}
+		job->name[request.name_length] = 0;
+		job->request = request;
+		job->conn = conn;
+		job->received = now_usec();
+		job->next = NULL;
+		__atomic_fetch_add(&conn->refs, 1, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_lock(&queue_lock);
+		if (queue_tail)
+			queue_tail->next = job;
+		else
+			queue_head = job;
+		queue_tail = job;
+		pthread_cond_signal(&queue_ready);
+		pthread_mutex_unlock(&queue_lock);
+	}
+
+	/* No more requests: the socket closes with the last response */
+	shutdown(conn->fd, SHUT_RD);
+	release_connection(conn);
+
+	return NULL;
+}
+
+
+void *work (void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&queue_lock);
+		while (!queue_head)
+			pthread_cond_wait(&queue_ready, &queue_lock);
+		job = queue_head;
+		if (!(queue_head = job->next))
+			queue_tail = NULL;
+		pthread_mutex_unlock(&queue_lock);
+
+		serve(w, job);
+
+		pthread_mutex_lock(&job->conn->flight_lock);
+		job->conn->in_flight--;
+		job->conn->in_flight_bytes -= job->request.length;
+		pthread_cond_signal(&job->conn->drained);
+		pthread_mutex_unlock(&job->conn->flight_lock);
+
+		release_connection(job->conn);
+		free(job->payload);
+		free(job);
+	}
+
+	return NULL;
+}
+
+
+/* Run one request and write its response */
+void serve (struct worker *w, struct job *job)
+{
+	unsigned int i;
+	AC_AUTOMATA *view = NULL;
+	STRING text;
+	uint64_t count;
+	uint32_t exists;
+	char *json;
+	int length;
+
+	if (job->request.op == ACS_STATS) {
+		length = stats_json(&json);
+		respond(job->conn, job->request.tag, ACS_OK, json, length, job->received);
+		free(json);
+		return;
+	}
+
+	for (i = 0; i < no_of_automata; i++)
+		if (!strcmp(automata[i].name, job->name))
+			view = &w->views[i];
+
+	if (!view) {
+		respond(job->conn, job->request.tag, ACS_NO_AUTOMATA, NULL, 0, job->received);
+		return;
+	}
+
+	text.str = job->payload;
+	text.length = job->request.length;
+	ac_automata_reset(view);
+
+	switch (job->request.op) {
+		case ACS_SCAN:
+			w->matches_num = 0;
+			ac_automata_search(view, &text, 0, w - workers);
+			text.length = 0;
+			ac_automata_search(view, &text, 0, w - workers);
+			respond(job->conn, job->request.tag, ACS_OK, w->matches,
+				w->matches_num * sizeof(struct acs_match), job->received);
+			break;
+		case ACS_COUNT:
+			count = ac_automata_count(view, &text);
+			text.length = 0;
+			count += ac_automata_count(view, &text);
+			respond(job->conn, job->request.tag, ACS_OK, &count, sizeof(count), job->received);
+			break;
+		case ACS_EXISTS:
+			exists = ac_automata_exists(view, &text);
+			text.length = 0;
+			exists = exists || ac_automata_exists(view, &text);
+			respond(job->conn, job->request.tag, ACS_OK, &exists, sizeof(exists), job->received);
+			break;
+		default:
+			respond(job->conn, job->request.tag, ACS_BAD_REQUEST, NULL, 0, job->received);
+	}
+}
+
+
+/* Write a response and count its latency */
+void respond (struct connection *conn, uint32_t tag, uint16_t status,
+		const void *payload, uint32_t length, double received)
+{
+	struct acs_response response = { tag, status, 0, length };
+	struct iovec iov[2];
+
+	iov[0].iov_base = &response;
+	iov[0].iov_len = sizeof(response);
+	iov[1].iov_base = (void *) payload;
+	iov[1].iov_len = length;
+
+	pthread_mutex_lock(&conn->write_lock);
+	write_full(conn->fd, iov, length ? 2 : 1);
+	pthread_mutex_unlock(&conn->write_lock);
+
+	pthread_mutex_lock(&stats_lock);
+	latency[requests++ % LATENCY_SAMPLES] = now_usec() - received;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+
+/* The automata and the latency so far, as JSON; returns its length */
+int stats_json (char **json)
+{
+	unsigned long i, n;
+	double *sorted, p50 = 0, p99 = 0;
+	size_t size = 256 + no_of_automata * (ACS_MAX_NAME + 64);
+	int length;
+
+	pthread_mutex_lock(&stats_lock);
+	n = requests < LATENCY_SAMPLES ? requests : LATENCY_SAMPLES;
+	sorted = (double *) malloc((n ? n : 1) * sizeof(double));
+	memcpy(sorted, latency, n * sizeof(double));
+	i = requests;
+	pthread_mutex_unlock(&stats_lock);
+
+	if (n) {
+		qsort(sorted, n, sizeof(double), compare_double);
+		p50 = sorted[(n * 50 + 99) / 100 - 1];
+		p99 = sorted[(n * 99 + 99) / 100 - 1];
+	}
+	free(sorted);
+
+	*json = (char *) malloc(size);
+	length = snprintf(*json, size, "{\"requests\": %lu, \"latency_us\": {\"samples\": %lu, "
+		"\"p50\": %.1f, \"p99\": %.1f}, \"automata\": [", i, n, p50, p99);
+	for (i = 0; i < no_of_automata; i++)
+		length += snprintf(*json + length, size - length,
+			"%s{\"name\": \"%s\", \"patterns\": %u, \"states\": %lu}", i ? ", " : "",
+			automata[i].name, automata[i].no_of_patterns,
+			(unsigned long) automata[i].aca.all_nodes_num);
+	length += snprintf(*json + length, size - length, "]}");
+
+	return length;
+}
+
+
+void release_connection (struct connection *conn)
+{
+	if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	close(conn->fd);
+	pthread_mutex_destroy(&conn->write_lock);
+	pthread_mutex_destroy(&conn->flight_lock);
+	pthread_cond_destroy(&conn->drained);
+	free(conn);
+}
+
+
+/* Returns 0 when all of it is read */
+int read_full (int fd, void *buffer, size_t length)
+{
+	ssize_t got;
+
+	while (length) {
+		if ((got = read(fd, buffer, length)) <= 0) {
+			if (got < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer = (char *) buffer + got;
+		length -= got;
+	}
+
+	return 0;
+}
+
+
+/* Returns 0 when all of it is written */
+int write_full (int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t put;
+
+	while (iovcnt) {
+		if ((put = writev(fd, iov, iovcnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (; iovcnt && (size_t) put >= iov->iov_len; iov++, iovcnt--)
+			put -= iov->iov_len;
+		if (iovcnt) {
+			iov->iov_base = (char *) iov->iov_base + put;
+			iov->iov_len -= put;
+		}
+	}
+
+	return 0;
+}
+
+
+double now_usec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+int compare_double (const void *l, const void *r)
+{
+	double a = *(const double *) l, b = *(const double *) r;
+
+	return (a > b) - (a < b);
+}
+
+
+void stop (int signum)
+{
+	unlink(socket_path);
+	_exit(0);
+}
+
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-iw] [-s longest|first] [-n workers] -U socket -P name=pattern_file [-P name=pattern_file ...]\n", exec_file);
+	fprintf(stderr, "    -U socket  path of the Unix domain socket to listen on\n");
+	fprintf(stderr, "    -P         load the patterns of the file as the automata 'name'\n");
+	fprintf(stderr, "    -n workers threads searching (number of processors)\n");
+	fprintf(stderr, "    -i -w -s   as for serial, for all automata\n");
+}
+
+
+/* thread_num is the worker */
+int match_handler(MATCH * m, int automata_num, int thread_num)
+{
+	struct worker *w = &workers[thread_num];
+	unsigned int j;
+
+	if (w->matches_num + m->match_num > w->matches_max) {
+		w->matches_max = 2 * (w->matches_num + m->match_num);
+		w->matches = (struct acs_match *) realloc(w->matches,
+			w->matches_max * sizeof(struct acs_match));
+	}
+
+	for (j = 0; j < m->match_num; j++) {
+		w->matches[w->matches_num].position = m->position;
+		w->matches[w->matches_num].id = m->matched_strings[j].id;
+		w->matches_num++;
+	}
+
+	return 0;
+}
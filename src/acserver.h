@@ -0,0 +1,62 @@
+/*
+	Protocol of acserver over its Unix domain socket, shared with acclient.
+
+	A client sends requests: an acs_request, the name of an automata and
+	'length' alphas of payload. It may send more before the responses
+	come (pipelining). Every request gets one response, an acs_response
+	with the same tag and 'length' bytes of payload; responses may come
+	in another order than their requests, so tags should be unique
+	among the requests in flight. Integers are in host byte order: both
+	ends are on the same host.
+
+	ACS_SCAN    payload: the text, searched as a whole input
+	            response: an acs_match per matched string, in order
+	ACS_COUNT   response: the number of matches, a uint64_t
+	ACS_EXISTS  response: a uint32_t, 1 if anything matches
+	ACS_STATS   no name nor payload; response: a JSON object with the
+	            loaded automata and the latency of the requests so far
+*/
+
+#ifndef _ACSERVER_H_
+#define _ACSERVER_H_
+
+#include <stdint.h>
+
+#define ACS_MAX_NAME 255
+#define ACS_MAX_PAYLOAD (64 << 20)
+
+/* Operations */
+#define ACS_SCAN   1
+#define ACS_COUNT  2
+#define ACS_EXISTS 3
+#define ACS_STATS  4
+
+/* Status of a response */
+#define ACS_OK           0
+#define ACS_NO_AUTOMATA  1 /* No automata of that name */
+#define ACS_BAD_REQUEST  2 /* Unknown operation */
+#define ACS_TOO_LARGE    3 /* Payload over ACS_MAX_PAYLOAD; the connection is closed */
+
+struct acs_request
+{
+	uint32_t tag; /* Returned in the response */
+	uint16_t op; /* ACS_SCAN .. ACS_STATS */
+	uint16_t name_length; /* Alphas of the name after this header */
+	uint32_t length; /* Alphas of payload after the name */
+};
+
+struct acs_response
+{
+	uint32_t tag;
+	uint16_t status; /* ACS_OK .. ACS_TOO_LARGE */
+	uint16_t reserved;
+	uint32_t length; /* Bytes of payload after this header */
+};
+
+struct acs_match
+{
+	uint32_t position; /* End of the match in the text */
+	uint32_t id; /* Line of the string in its pattern file, from 1 */
+};
+
+#endif
@@ -0,0 +1,317 @@
+/*
+	acshm: share one automata image among worker processes, and check
+	that every worker finds what the automata finds.
+
+	usage: acshm [-imr] [-w workers] [-n passes] [-N name] -P pattern_file input_file
+
+	The parent builds the automata once and publishes its image in POSIX
+	shared memory under 'name' (/acshm.PID by default), or with -m writes
+	it to a memfd the workers inherit. Every worker attaches the image
+	read-only, with no build, and counts the matches in the input 'passes'
+	times, the first time through the match callback too. With -r the
+	parent publishes a second version after the first pass of every
+	worker; workers pick it up with ac_image_refresh() before their next
+	pass, while the first version stays mapped until then.
+
+	It prints a JSON line per worker, with the version searched last and
+	the memory the worker maps, private and shared (from /proc), and one
+	for the parent, and exits 1 if a count differs from the automata's.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "aho_corasick.h"
+#include "ac_image.h"
+#include "patterns.h"
+
+char *read_file (const char *filename, unsigned long *length);
+int worker (int number, AC_IMAGE_MAP *map, const char *text, unsigned long length,
+		unsigned long passes, unsigned long expected, int ready, int go);
+unsigned long resident_kb (const char *field);
+double now_msec (void);
+int count_handler (MATCH *m, int automata_num, int thread_num);
+void print_usage (const char *exec_file);
+
+unsigned long callback_matches = 0;
+
+int main(int argc, char **argv)
+{
+	AC_AUTOMATA aca;
+	AC_IMAGE_MAP map;
+	STRING *patterns, input;
+	unsigned long length, expected, passes = 3, version = 0, i;
+	unsigned int no_of_patterns, j;
+	char *text, default_name[64], byte;
+	int ready[2], go[2], fd = -1, status, failed = 0, clopt;
+	double start, build_ms;
+	pid_t pid;
+	AC_ERROR error;
+
+	/* Command line config */
+	const char *pattern_file = NULL;
+	const char *name = NULL;
+	unsigned long workers = 4;
+	short memfd = 0;
+	short reload = 0;
+	AC_FOLD fold = AC_FOLD_NONE;
+
+	while ((clopt = getopt(argc, argv, "P:N:w:n:imrh?")) != -1) {
+		switch (clopt) {
+			case 'P':
+				pattern_file = optarg;
+				break;
+			case 'N':
+				name = optarg;
+				break;
+			case 'w':
+				workers = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				passes = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			case 'm':
+				memfd = 1;
+				break;
+			case 'r':
+				reload = 1;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!pattern_file || optind >= argc || !workers || !passes || (memfd && reload)) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+	if (!name) {
+		sprintf(default_name, "/acshm.%ld", (long) getpid());
+		name = default_name;
+	}
+
+	text = read_file(argv[optind], &length);
+	patterns = read_patterns(pattern_file, &no_of_patterns, 1);
+
+	start = now_msec();
+	ac_automata_init(&aca, count_handler);
+	ac_automata_set_fold(&aca, fold);
+	for (j = 0; j < no_of_patterns; j++)
+		ac_automata_add_string(&aca, &patterns[j]);
+	ac_automata_locate_failure(&aca);
+	build_ms = now_msec() - start;
+
+	input.str = text;
+	input.length = length;
+	expected = ac_automata_count(&aca, &input);
+
+	if (memfd)
+		error = ac_image_memfd(&aca, &fd);
+	else
+		error = ac_image_publish(&aca, name, &version);
+	if (error) {
+		fprintf(stderr, "Cannot share the image - %s\n",
+			error == ACERR_SYSTEM ? strerror(errno) : "not supported by the automata");
+		exit(1);
+	}
+
+	if (pipe(ready) || pipe(go)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	for (i = 0; i < workers; i++) {
+		if ((pid = fork()) < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid)
+			continue;
+
+		/* The worker: nothing of the automata is used from here on */
+		close(ready[0]);
+		close(go[1]);
+		error = memfd ? ac_image_map(&map, fd) : ac_image_attach(&map, name);
+		if (error) {
+			fprintf(stderr, "Worker %lu cannot map the image - %s\n", i,
+				error == ACERR_SYSTEM ? strerror(errno) : "not an image of this build");
+			exit(1);
+		}
+		exit(worker(i, &map, text, length, passes, expected,
+			reload ? ready[1] : -1, reload ? go[0] : -1));
+	}
+	close(ready[1]);
+	close(go[0]);
+
+	if (reload) {
+		/* A second version once every worker searched the first one */
+		for (i = 0; i < workers; i++)
+			if (read(ready[0], &byte, 1) != 1)
+				break;
+		if (ac_image_publish(&aca, name, &version))
+			fprintf(stderr, "Cannot publish again - %s\n", strerror(errno));
+		for (i = 0; i < workers; i++)
+			if (write(go[1], "g", 1) != 1)
+				break;
+	}
+	close(ready[0]);
+	close(go[1]);
+
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+
+	printf("{\"process\": \"parent\", \"patterns\": %u, \"build_ms\": %.1f, \"matches\": %lu, "
+		"\"image_bytes\": %lu, \"version\": %lu, \"private_kb\": %lu, \"%s\": \"%s\"}\n",
+		no_of_patterns, build_ms, expected, ac_image_size(&aca), version,
+		resident_kb("Private_Clean:") + resident_kb("Private_Dirty:"),
+		memfd ? "memfd" : "name", memfd ? "inherited" : name);
+
+	if (memfd)
+		close(fd);
+	else
+		ac_image_unlink(name);
+
+	ac_automata_release(&aca);
+	for (j = 0; j < no_of_patterns; j++)
+		free(patterns[j].str);
+	free(patterns);
+	free(text);
+
+	if (failed)
+		fprintf(stderr, "acshm: a worker failed or found other matches\n");
+
+	return failed;
+}
+
+
+/* Search the mapped image; returns the exit status of the worker */
+int worker (int number, AC_IMAGE_MAP *map, const char *text, unsigned long length,
+		unsigned long passes, unsigned long expected, int ready, int go)
+{
+	AC_IMAGE_CURSOR cursor = AC_IMAGE_CURSOR_INIT;
+	unsigned long pass, found = 0, refreshed = 0;
+	double start = now_msec();
+	char byte;
+	int status = 0;
+
+	for (pass = 0; pass < passes; pass++) {
+		if (ac_image_refresh(map))
+			refreshed++;
+
+		cursor.state = 0;
+		cursor.base = 0;
+		if (pass == 0) {
+			callback_matches = 0;
+			ac_image_search(map->image, &cursor, text, length, count_handler, 0, number);
+			if (callback_matches != expected)
+				status = 1;
+			cursor.state = 0;
+			cursor.base = 0;
+		}
+		found = ac_image_count(map->image, &cursor, text, length);
+		if (found != expected)
+			status = 1;
+
+		/* Wait for the second version (-r) */
+		if (pass == 0 && ready >= 0) {
+			if (write(ready, "r", 1) != 1 || read(go, &byte, 1) != 1)
+				status = 1;
+		}
+	}
+
+	printf("{\"process\": \"worker\", \"worker\": %d, \"passes\": %lu, \"matches\": %lu, "
+		"\"version\": %lu, \"refreshed\": %lu, \"ms_per_pass\": %.1f, "
+		"\"private_kb\": %lu, \"shared_kb\": %lu, \"ok\": %s}\n",
+		number, passes, found, map->image->version, refreshed,
+		(now_msec() - start) / passes,
+		resident_kb("Private_Clean:") + resident_kb("Private_Dirty:"),
+		resident_kb("Shared_Clean:") + resident_kb("Shared_Dirty:"),
+		status ? "false" : "true");
+	fflush(stdout);
+
+	ac_image_cursor_release(&cursor);
+	ac_image_detach(map);
+
+	return status;
+}
+
+
+/* A field of /proc/self/smaps_rollup in kB, 0 if not available */
+unsigned long resident_kb (const char *field)
+{
+	char line[256];
+	unsigned long kb = 0;
+	FILE *fp;
+
+	if (!(fp = fopen("/proc/self/smaps_rollup", "r")))
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (!strncmp(line, field, strlen(field))) {
+			kb = strtoul(line + strlen(field), NULL, 10);
+			break;
+		}
+	fclose(fp);
+
+	return kb;
+}
+
+
+char *read_file (const char *filename, unsigned long *length)
+{
+	char *buffer;
+	long size;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb")) || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0) {
+		fprintf(stderr, "Cannot read input file - %s\n", filename);
+		exit(1);
+	}
+	rewind(fp);
+
+	buffer = (char *) malloc(size ? size : 1);
+	*length = fread(buffer, 1, size, fp);
+	fclose(fp);
+
+	return buffer;
+}
+
+
+
+double now_msec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+int count_handler (MATCH *m, int automata_num, int thread_num)
+{
+	callback_matches += m->match_num;
+
+	return 0;
+}
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-imr] [-w workers] [-n passes] [-N name] -P pattern_file input_file\n", exec_file);
+	fprintf(stderr, "    -w workers  processes attaching the image (4)\n");
+	fprintf(stderr, "    -n passes   searches of the input by every worker (3)\n");
+	fprintf(stderr, "    -N name     shared memory name (/acshm.PID)\n");
+	fprintf(stderr, "    -m          pass the image in an inherited memfd instead\n");
+	fprintf(stderr, "    -r          publish a second version during the search\n");
+	fprintf(stderr, "    -i          case insensitive\n");
+}
@@ -0,0 +1,392 @@
+/*
+	bench: time every phase of a search with a monotonic wall clock, over
+	repeated runs, and print the statistics as JSON.
+
+	usage: bench [-ciwH] [-s longest|first] [-p pages] [-b pages] [-r repeat]
+	             -P pattern_file input_file
+
+	A run loads the patterns, adds them to a new automata, locates failure
+	nodes, reads the whole input into memory (plain, .gz or .zst), searches
+	it in one chunk and releases everything; each of them is a phase.
+	With a library built with INSTRUMENT=1 it also prints the counters of
+	the search of the last run (see ac_automata_scan_stats), with -H the
+	hardware ones too. The memory and structure of the automata are
+	those of ac_automata_stats().
+
+	-p puts the automata in the given pages (packed, huge or hugetlb, see
+	AC_PAGES), -b the input buffer. The AnonHugePages of the process
+	after the search tell whether huge pages were given; the dTLB misses
+	are among the hardware counters (-H).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aho_corasick.h"
+#include "ac_pages.h"
+#include "ac_stream.h"
+#include "ac_stats.h"
+#include "patterns.h"
+
+/* Phases of a run, in order */
+enum { LOAD, ADD, LOCATE, READ, SEARCH, RELEASE, PHASES };
+
+const char *phase_names[PHASES] = {
+	"load", "add", "locate_failure", "read", "search", "release"
+};
+
+unsigned long hits;
+
+ALPHA* read_input (const char *filename, unsigned long *length, AC_PAGES pages, AC_PAGES *got);
+int parse_pages (const char *name, AC_PAGES *pages);
+unsigned long anon_huge_kb (void);
+double now_msec (void);
+int compare_double (const void *l, const void *r);
+double percentile (double *sorted, unsigned int n, unsigned int p);
+void print_string (const char *s);
+void print_usage (const char *exec_file);
+int match_handler(MATCH * m, int automata_num, int thread_num);
+
+int main(int argc, char **argv)
+{
+	AC_AUTOMATA aca;
+	STRING *patterns, text;
+	ALPHA *input;
+	unsigned int no_of_patterns, i, r, repeat = 5, states = 0;
+	unsigned long length = 0, found = 0, huge_kb = 0;
+	double *msec[PHASES], t, search;
+	AC_SCAN_STATS scan;
+	AC_STATS stats;
+	AC_ERROR instrumented = ACERR_UNSUPPORTED;
+	int clopt, p;
+
+	/* Command line config */
+	const char *pattern_file = NULL;
+	const char *input_file;
+	short count = 0;
+	short hw = 0;
+	AC_FOLD fold = AC_FOLD_NONE;
+	unsigned int bound = 0;
+	AC_SEMANTICS semantics = AC_SEMANTICS_OVERLAPPING;
+	AC_PAGES pages = AC_PAGES_DEFAULT;
+	AC_PAGES input_pages = AC_PAGES_DEFAULT, input_got = AC_PAGES_DEFAULT;
+
+	while ((clopt = getopt(argc, argv, "P:r:s:p:b:ciwHh?")) != -1) {
+		switch (clopt) {
+			case 'P':
+				pattern_file = optarg;
+				break;
+			case 'r':
+				repeat = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				if (!strcmp(optarg, "longest"))
+					semantics = AC_SEMANTICS_LEFTMOST_LONGEST;
+				else if (!strcmp(optarg, "first"))
+					semantics = AC_SEMANTICS_LEFTMOST_FIRST;
+				else {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'p':
+				if (parse_pages(optarg, &pages)) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'b':
+				if (parse_pages(optarg, &input_pages)) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'c':
+				count = 1;
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			case 'w':
+				bound = AC_BOUND_WORD;
+				break;
+			case 'H':
+				hw = 1;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!pattern_file || optind >= argc || !repeat) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+	input_file = argv[optind];
+
+	for (p = 0; p < PHASES; p++)
+		msec[p] = (double *) malloc(repeat * sizeof(double));
+
+	for (r = 0; r < repeat; r++) {
+		t = now_msec();
+		patterns = read_patterns(pattern_file, &no_of_patterns, 1);
+		msec[LOAD][r] = now_msec() - t;
+
+		t = now_msec();
+		ac_automata_init(&aca, match_handler);
+		ac_automata_set_fold(&aca, fold);
+		ac_automata_set_semantics(&aca, semantics);
+		ac_automata_set_pages(&aca, pages);
+		for (i = 0; i < no_of_patterns; i++)
+			ac_automata_add_string_ex(&aca, &patterns[i], bound);
+		msec[ADD][r] = now_msec() - t;
+
+		t = now_msec();
+		ac_automata_locate_failure(&aca);
+		msec[LOCATE][r] = now_msec() - t;
+		states = aca.all_nodes_num;
+		if (!r)
+			ac_automata_stats(&aca, &stats);
+
+		if (hw && ac_automata_set_hw_counters(&aca, 1) != ACERR_NONE && !r)
+			fprintf(stderr, "Hardware counters are not available\n");
+
+		t = now_msec();
+		input = read_input(input_file, &length, input_pages, &input_got);
+		msec[READ][r] = now_msec() - t;
+
+		/* The empty chunk ends the input, for -w and -s */
+		t = now_msec();
+		hits = 0;
+		text.str = input;
+		text.length = length;
+		if (count) {
+			hits = ac_automata_count(&aca, &text);
+			instrumented = ac_automata_scan_stats(&aca, &scan);
+			text.length = 0;
+			hits += ac_automata_count(&aca, &text);
+		}
+		else {
+			ac_automata_search(&aca, &text, 0, 0);
+			instrumented = ac_automata_scan_stats(&aca, &scan);
+			text.length = 0;
+			ac_automata_search(&aca, &text, 0, 0);
+		}
+		msec[SEARCH][r] = now_msec() - t;
+		huge_kb = anon_huge_kb();
+		found = hits;
+
+		t = now_msec();
+		ac_automata_release(&aca);
+		for (i = 0; i < no_of_patterns; i++)
+			free(patterns[i].str);
+		free(patterns);
+		if (input_pages != AC_PAGES_DEFAULT)
+			ac_pages_free(input, length ? length : 1, input_got);
+		else
+			free(input);
+		msec[RELEASE][r] = now_msec() - t;
+	}
+
+	for (p = 0; p < PHASES; p++)
+		qsort(msec[p], repeat, sizeof(double), compare_double);
+
+	search = percentile(msec[SEARCH], repeat, 50);
+
+	printf("{\n");
+	printf("  \"patterns\": ");
+	print_string(pattern_file);
+	printf(",\n  \"input\": ");
+	print_string(input_file);
+	printf(",\n  \"mode\": \"%s\",\n", count ? "count" : "callback");
+	printf("  \"pattern_count\": %u,\n", no_of_patterns);
+	printf("  \"states\": %u,\n", states);
+	printf("  \"input_bytes\": %lu,\n", length);
+	printf("  \"matches\": %lu,\n", found);
+	printf("  \"repeat\": %u,\n", repeat);
+	printf("  \"phases_ms\": {\n");
+	for (p = 0; p < PHASES; p++)
+		printf("    \"%s\": { \"median\": %.3f, \"p95\": %.3f, \"min\": %.3f, \"max\": %.3f }%s\n",
+			phase_names[p], percentile(msec[p], repeat, 50), percentile(msec[p], repeat, 95),
+			msec[p][0], msec[p][repeat - 1], p < PHASES - 1 ? "," : "");
+	printf("  },\n");
+	printf("  \"automata\": ");
+	ac_stats_print(&stats, stdout);
+	printf(",\n");
+	printf("  \"input_pages\": \"%s\",\n", ac_pages_name(input_got));
+	printf("  \"anon_huge_kb\": %lu,\n", huge_kb);
+	printf("  \"search_mb_per_s\": %.2f,\n", search > 0 ? length / search / 1000.0 : 0);
+	printf("  \"matches_per_s\": %.0f%s\n", search > 0 ? found / search * 1000.0 : 0,
+		instrumented == ACERR_NONE ? "," : "");
+	if (instrumented == ACERR_NONE) {
+		printf("  \"scan\": { \"alphas\": %lu, \"transitions\": %lu, \"failure_hops\": %lu, "
+			"\"root_restarts\": %lu, \"final_nodes\": %lu, \"outputs\": %lu, "
+			"\"longest_output\": %lu, \"reports\": %lu, \"callbacks\": %lu, "
+			"\"wm_windows\": %lu, \"wm_compares\": %lu",
+			scan.alphas, scan.transitions, scan.failure_hops, scan.root_restarts,
+			scan.final_nodes, scan.outputs, scan.longest_output, scan.reports,
+			scan.callbacks, scan.wm_windows, scan.wm_compares);
+		if (scan.hw)
+			printf(", \"cycles\": %llu, \"llc_misses\": %llu, \"branch_misses\": %llu, "
+				"\"dtlb_misses\": %llu", scan.cycles, scan.llc_misses, scan.branch_misses,
+				scan.dtlb_misses);
+		printf(" }\n");
+	}
+	printf("}\n");
+
+	for (p = 0; p < PHASES; p++)
+		free(msec[p]);
+
+	return 0;
+}
+
+
+/* Monotonic wall time in milliseconds */
+double now_msec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+int compare_double (const void *l, const void *r)
+{
+	double a = *(const double *) l, b = *(const double *) r;
+
+	return (a > b) - (a < b);
+}
+
+
+/* Nearest rank p-th percentile of n sorted values */
+double percentile (double *sorted, unsigned int n, unsigned int p)
+{
+	unsigned int rank = (n * p + 99) / 100;
+
+	return sorted[rank ? rank - 1 : 0];
+}
+
+
+/* A JSON string */
+void print_string (const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			printf("\\u%04x", (unsigned char) *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+
+/* The whole input, decompressed; in a region of the given pages unless
+   AC_PAGES_DEFAULT */
+ALPHA* read_input (const char *filename, unsigned long *length, AC_PAGES pages, AC_PAGES *got)
+{
+	AC_STREAM input;
+	STRING block;
+	ALPHA *buffer = NULL, *region;
+	unsigned long size = 0;
+	int status;
+
+	if (ac_stream_open(&input, filename)) {
+		fprintf(stderr, "Cannot read input file - %s\n", filename);
+		exit(1);
+	}
+
+	*length = 0;
+	while ((status = ac_stream_next(&input, &block)) > 0) {
+		if (*length + block.length > size) {
+			size = 2 * (*length + block.length);
+			buffer = (ALPHA *) realloc(buffer, size);
+		}
+		memcpy(buffer + *length, block.str, block.length);
+		*length += block.length;
+	}
+	if (status < 0) {
+		fprintf(stderr, "Cannot read input file - %s\n", filename);
+		exit(1);
+	}
+
+	ac_stream_close(&input);
+
+	*got = AC_PAGES_DEFAULT;
+	if (pages != AC_PAGES_DEFAULT) {
+		if (!(region = (ALPHA *) ac_pages_alloc(*length ? *length : 1, pages, got))) {
+			fprintf(stderr, "No memory for the input - %lu bytes\n", *length);
+			exit(1);
+		}
+		memcpy(region, buffer, *length);
+		free(buffer);
+		return region;
+	}
+
+	return buffer ? buffer : (ALPHA *) malloc(1);
+}
+
+
+int parse_pages (const char *name, AC_PAGES *pages)
+{
+	if (!strcmp(name, "packed"))
+		*pages = AC_PAGES_PACKED;
+	else if (!strcmp(name, "huge"))
+		*pages = AC_PAGES_HUGE;
+	else if (!strcmp(name, "hugetlb"))
+		*pages = AC_PAGES_HUGETLB;
+	else if (!strcmp(name, "default"))
+		*pages = AC_PAGES_DEFAULT;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/* AnonHugePages of the process in kB, 0 if not known */
+unsigned long anon_huge_kb (void)
+{
+	char line[256];
+	unsigned long kb = 0;
+	FILE *fp;
+
+	if (!(fp = fopen("/proc/self/smaps_rollup", "r")))
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (!strncmp(line, "AnonHugePages:", 14)) {
+			kb = strtoul(line + 14, NULL, 10);
+			break;
+		}
+	fclose(fp);
+
+	return kb;
+}
+
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-ciwH] [-s longest|first] [-p pages] [-b pages] [-r repeat] -P pattern_file file1 (plain, .gz or .zst)\n", exec_file);
+	fprintf(stderr, "    -r repeat  number of runs (5)\n");
+	fprintf(stderr, "    -c         count matches instead of a callback per match\n");
+	fprintf(stderr, "    -H         read hardware counters (library built with INSTRUMENT=1)\n");
+	fprintf(stderr, "    -p pages   pages of the automata: packed, huge or hugetlb\n");
+	fprintf(stderr, "    -b pages   pages of the input buffer, the same\n");
+	fprintf(stderr, "    -i -w -s   as for serial\n");
+}
+
+
+int match_handler(MATCH * m, int automata_num, int thread_num)
+{
+	hits += m->match_num;
+	return 0;
+}
@@ -0,0 +1,226 @@
+/*
+	corpus: generate a pattern file and an input file for scaling studies.
+	The same options and seed give the same files on every platform.
+
+	usage: corpus [-k random|prefix|overlap] [-S seed] [-n patterns]
+	              [-l min,max] [-a alphabet] [-d density] [-b bytes]
+	              -o prefix
+
+	It writes prefix.pat, in the format of serial, and prefix.txt. Kinds:
+
+	random   patterns of random alphas
+	prefix   every pattern starts with the same min - 1 alphas, so the
+	         trie is a long path with all branches at its end
+	overlap  the input repeats one word of max alphas and the patterns
+	         are pieces of it, so nearly every position ends matches of
+	         many patterns at once; -d is not used
+
+	For random and prefix the input is random alphas where, with
+	probability density at every position, a random pattern is planted.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aho_corasick.h"
+
+/* Alphas of the alphabet; -a takes the first ones */
+const char alphabet[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+	"!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+
+unsigned long long state; /* Of the random generator */
+
+unsigned long long next_random (void);
+unsigned long random_below (unsigned long n);
+void random_alphas (char *s, unsigned long length, unsigned int alphas);
+unsigned long parse_size (const char *s);
+void print_usage (const char *exec_file);
+
+int main(int argc, char **argv)
+{
+	const char *kind = "random", *prefix = NULL;
+	unsigned long long seed = 1;
+	unsigned long no_of_patterns = 1000, min = 8, max = 16, bytes = 1 << 20;
+	unsigned long i, k, length, word_length = 0;
+	unsigned int alphas = 26;
+	double density = 0.01;
+	char **patterns, *word = NULL, *planted, *name, *end;
+	FILE *pat, *txt;
+	int clopt;
+
+	while ((clopt = getopt(argc, argv, "k:S:n:l:a:d:b:o:h?")) != -1) {
+		switch (clopt) {
+			case 'k':
+				kind = optarg;
+				break;
+			case 'S':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'n':
+				no_of_patterns = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				min = strtoul(optarg, &end, 10);
+				max = (*end == ',') ? strtoul(end + 1, NULL, 10) : min;
+				break;
+			case 'a':
+				alphas = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				density = strtod(optarg, NULL);
+				break;
+			case 'b':
+				bytes = parse_size(optarg);
+				break;
+			case 'o':
+				prefix = optarg;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!prefix || !min || min > max || max > AC_PATTRN_MAX_LENGTH ||
+		!alphas || alphas > sizeof(alphabet) - 1 || density < 0 || density > 1 ||
+		(strcmp(kind, "random") && strcmp(kind, "prefix") && strcmp(kind, "overlap")) ||
+		(!strcmp(kind, "prefix") && min < 2)) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+
+	/* xorshift64* must not start at 0 */
+	state = seed * 0x9E3779B97F4A7C15ULL;
+	if (!state)
+		state = 1;
+
+	patterns = (char **) malloc(no_of_patterns * sizeof(char *));
+
+	if (!strcmp(kind, "overlap")) {
+		/* Twice the word, so a piece may wrap around */
+		word_length = max;
+		word = (char *) malloc(2 * word_length);
+		random_alphas(word, word_length, alphas);
+		memcpy(word + word_length, word, word_length);
+	}
+
+	for (i = 0; i < no_of_patterns; i++) {
+		length = min + random_below(max - min + 1);
+		patterns[i] = (char *) malloc(length + 1);
+
+		if (word)
+			memcpy(patterns[i], word + random_below(word_length), length);
+		else if (!strcmp(kind, "prefix") && i) {
+			memcpy(patterns[i], patterns[0], min - 1);
+			random_alphas(patterns[i] + min - 1, length - min + 1, alphas);
+		}
+		else
+			random_alphas(patterns[i], length, alphas);
+
+		patterns[i][length] = 0;
+	}
+
+	name = (char *) malloc(strlen(prefix) + 5);
+
+	sprintf(name, "%s.pat", prefix);
+	if (!(pat = fopen(name, "w"))) {
+		fprintf(stderr, "Cannot write file - %s\n", name);
+		exit(1);
+	}
+	fprintf(pat, "%lu\n", no_of_patterns);
+	for (i = 0; i < no_of_patterns; i++)
+		fprintf(pat, "%s\n", patterns[i]);
+	fclose(pat);
+
+	sprintf(name, "%s.txt", prefix);
+	if (!(txt = fopen(name, "w"))) {
+		fprintf(stderr, "Cannot write file - %s\n", name);
+		exit(1);
+	}
+	for (i = 0; i < bytes; ) {
+		if (word) {
+			k = word_length < bytes - i ? word_length : bytes - i;
+			fwrite(word, 1, k, txt);
+		}
+		else if (no_of_patterns && (next_random() >> 11) < density * (1ULL << 53)) {
+			planted = patterns[random_below(no_of_patterns)];
+			length = strlen(planted);
+			k = length < bytes - i ? length : bytes - i;
+			fwrite(planted, 1, k, txt);
+		}
+		else {
+			putc(alphabet[random_below(alphas)], txt);
+			k = 1;
+		}
+		i += k;
+	}
+	fclose(txt);
+
+	for (i = 0; i < no_of_patterns; i++)
+		free(patterns[i]);
+	free(patterns);
+	free(word);
+	free(name);
+
+	return 0;
+}
+
+
+/* xorshift64*: small, fast and the same everywhere, unlike rand() */
+unsigned long long next_random (void)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+
+unsigned long random_below (unsigned long n)
+{
+	return (unsigned long) (next_random() % n);
+}
+
+
+void random_alphas (char *s, unsigned long length, unsigned int alphas)
+{
+	unsigned long i;
+
+	for (i = 0; i < length; i++)
+		s[i] = alphabet[random_below(alphas)];
+}
+
+
+/* A number of bytes with an optional K, M or G suffix */
+unsigned long parse_size (const char *s)
+{
+	char *end;
+	unsigned long n = strtoul(s, &end, 10);
+
+	switch (*end) {
+		case 'G': case 'g': n <<= 10;
+		case 'M': case 'm': n <<= 10;
+		case 'K': case 'k': n <<= 10;
+	}
+
+	return n;
+}
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-k random|prefix|overlap] [-S seed] [-n patterns] [-l min,max] [-a alphabet] [-d density] [-b bytes] -o prefix\n", exec_file);
+	fprintf(stderr, "    -k kind      of patterns and input (random)\n");
+	fprintf(stderr, "    -S seed      of the random generator (1)\n");
+	fprintf(stderr, "    -n patterns  number of patterns (1000)\n");
+	fprintf(stderr, "    -l min,max   pattern lengths (8,16)\n");
+	fprintf(stderr, "    -a alphabet  number of distinct alphas, up to %u (26)\n",
+		(unsigned int) sizeof(alphabet) - 1);
+	fprintf(stderr, "    -d density   probability of a planted pattern at a position (0.01)\n");
+	fprintf(stderr, "    -b bytes     input size, K/M/G suffix allowed (1M)\n");
+	fprintf(stderr, "    writes prefix.pat and prefix.txt\n");
+}
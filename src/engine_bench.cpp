@@ -0,0 +1,200 @@
+/*
+	Compare the C search API with the C++ engine (lib/ac_engine.hpp) on one
+	pattern file and one input file held in memory. Every variant counts
+	the matched strings; the counts must agree.
+
+	usage: engine_bench -P pattern_file [-r repeat] input_file
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "ac_engine.hpp"
+
+static unsigned long hits;
+
+static STRING * read_patterns (const char * filename, unsigned int * no_of_patterns);
+static char * read_input (const char * filename, size_t * length);
+
+extern "C" int count_handler (MATCH * m, int automata_num, int thread_num)
+{
+	hits += m->match_num;
+	return 0;
+}
+
+template <typename Run>
+static void measure (const char * name, unsigned int repeat, size_t length, Run run)
+{
+	std::chrono::steady_clock::duration best = std::chrono::steady_clock::duration::max ();
+	unsigned long found = 0;
+	unsigned int r;
+	double msec;
+
+	for (r = 0; r < repeat; r++)
+	{
+		auto start = std::chrono::steady_clock::now ();
+		found = run ();
+		best = std::min (best, std::chrono::steady_clock::now () - start);
+	}
+
+	msec = std::chrono::duration<double, std::milli> (best).count ();
+	printf ("%-28s %12lu matches %10.2f ms %8.1f MB/s\n", name, found, msec,
+		length / msec / 1000.0);
+}
+
+template <typename Engine>
+static void build (Engine & e, STRING * patterns, unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		e.add (patterns[i].str, patterns[i].length, patterns[i].id);
+	e.compile ();
+}
+
+int main (int argc, char ** argv)
+{
+	const char * pattern_file = NULL;
+	unsigned int repeat = 5, no_of_patterns, i;
+	STRING * patterns, text;
+	AC_AUTOMATA aca;
+	size_t length;
+	char * input;
+	int clopt;
+
+	while ((clopt = getopt (argc, argv, "P:r:h?")) != -1) {
+		switch (clopt) {
+			case 'P':
+				pattern_file = optarg;
+				break;
+			case 'r':
+				repeat = strtoul (optarg, NULL, 10);
+				break;
+			default:
+				fprintf (stderr, "usage: %s -P pattern_file [-r repeat] input_file\n", argv[0]);
+				exit (1);
+		}
+	}
+
+	if (!pattern_file || optind >= argc || !repeat) {
+		fprintf (stderr, "usage: %s -P pattern_file [-r repeat] input_file\n", argv[0]);
+		exit (1);
+	}
+
+	patterns = read_patterns (pattern_file, &no_of_patterns);
+	input = read_input (argv[optind], &length);
+
+	text.str = input;
+	text.length = length;
+
+	ac_automata_init (&aca, count_handler);
+	for (i = 0; i < no_of_patterns; i++)
+		ac_automata_add_string (&aca, &patterns[i]);
+	ac_automata_locate_failure (&aca);
+
+	ac::engine<> sparse;
+	ac::engine<char, std::uint32_t, ac::dense_transitions> dense;
+
+	build (sparse, patterns, no_of_patterns);
+	build (dense, patterns, no_of_patterns);
+
+	printf ("%u patterns, %u states, %lu bytes of input\n", no_of_patterns,
+		(unsigned int) sparse.size (), (unsigned long) length);
+	printf ("engine tables: sparse %lu bytes, dense %lu bytes\n\n",
+		(unsigned long) sparse.memory (), (unsigned long) dense.memory ());
+
+	measure ("C search + callback", repeat, length, [&] {
+		hits = 0;
+		ac_automata_reset (&aca);
+		ac_automata_search (&aca, &text, 0, 0);
+		return hits;
+	});
+
+	measure ("C count", repeat, length, [&] {
+		ac_automata_reset (&aca);
+		return ac_automata_count (&aca, &text);
+	});
+
+	measure ("sparse + callback_sink", repeat, length, [&] {
+		hits = 0;
+		sparse.search (input, length, ac::callback_sink { count_handler, 0, 0 });
+		return hits;
+	});
+
+	measure ("sparse + inline sink", repeat, length, [&] {
+		unsigned long found = 0;
+		sparse.search (input, length, [&] (size_t, const STRING *, size_t num) {
+			found += num;
+		});
+		return found;
+	});
+
+	measure ("dense + inline sink", repeat, length, [&] {
+		unsigned long found = 0;
+		dense.search (input, length, [&] (size_t, const STRING *, size_t num) {
+			found += num;
+		});
+		return found;
+	});
+
+	ac_automata_release (&aca);
+
+	return 0;
+}
+
+static char * read_input (const char * filename, size_t * length)
+{
+	FILE * fp;
+	char * buffer;
+	long size;
+
+	if (!(fp = fopen (filename, "rb"))) {
+		fprintf (stderr, "Cannot read input file - %s\n", filename);
+		exit (1);
+	}
+
+	fseek (fp, 0, SEEK_END);
+	size = ftell (fp);
+	fseek (fp, 0, SEEK_SET);
+
+	buffer = (char *) malloc (size ? size : 1);
+	*length = fread (buffer, 1, size, fp);
+	fclose (fp);
+
+	return buffer;
+}
+
+/* Same format as for serial: the number of patterns, then one per line */
+static STRING * read_patterns (const char * filename, unsigned int * no_of_patterns)
+{
+	char buffer[AC_PATTRN_MAX_LENGTH + 1], line_format[32];
+	STRING * patterns;
+	unsigned int i;
+	FILE * fp;
+
+	if (!(fp = fopen (filename, "r")) || fscanf (fp, "%u\n", no_of_patterns) != 1) {
+		fprintf (stderr, "Cannot read pattern file - %s\n", filename);
+		exit (1);
+	}
+
+	sprintf (line_format, "%%%ds%%*[^ \t\n]\n", AC_PATTRN_MAX_LENGTH);
+	patterns = (STRING *) malloc (*no_of_patterns * sizeof(STRING));
+
+	for (i = 0; i < *no_of_patterns; i++) {
+		if (fscanf (fp, line_format, buffer) != 1)
+			break;
+
+		patterns[i].length = strlen (buffer);
+		patterns[i].str = (ALPHA *) malloc (patterns[i].length + 1);
+		memcpy (patterns[i].str, buffer, patterns[i].length + 1);
+		patterns[i].id = i + 1;
+	}
+	*no_of_patterns = i;
+
+	fclose (fp);
+
+	return patterns;
+}
@@ -0,0 +1,1101 @@
+/*
+	fuzz: cross-check every search engine and mode of the library with a
+	naive matcher on small pattern sets and inputs.
+
+	usage: fuzz [-n iterations] [-S seed] [-v] [input_file ...]
+
+	An input is a byte string that gives the options, the text and the
+	patterns (see decode_input). For each input the naive matcher finds
+	the expected matches and each of these must find exactly them:
+
+	search     ac_automata_search over the whole text, then an empty chunk
+	split      the same over random chunks, with code point positions
+	count      ac_automata_count, ac_automata_exists and
+	           ac_automata_count_each over random chunks
+	first_n    ac_automata_first_n against the first matches of search
+	partition  the grid of parallel, planned and sharded by shards.h on
+	           the raw patterns: pattern shards times text chunks, each
+	           cell a view searching its chunk from an overlap before it
+	           (overlapping semantics only)
+	dynamic    an ac_dynamic snapshot, after removing some patterns
+	           (without boundaries, groups or leftmost semantics)
+	static     the tables acgen generates, searched and counted by
+	           ac_static.h over random chunks (likewise)
+	engine     ac::engine of ac_engine.hpp, sparse and dense, over random
+	           chunks (likewise; see fuzz_engine.cpp)
+
+	Long patterns (option bit 7) make the Wu-Manber search run where it
+	applies. The seed also picks the pages of the automata (AC_PAGES), so
+	packed nodes are searched as well. A difference prints the input and the first differing match
+	and aborts, so fuzzers take it for a crash.
+
+	With files, each one is an input, as AFL runs it:
+		afl-fuzz -i in -o out -- bin/fuzz @@
+	Without, it runs a few fixed cases that once went wrong, then random
+	inputs of a small alphabet (make fuzz). Built
+	with -DAC_LIBFUZZER there is no main() for libFuzzer:
+		clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address -Ilib -c \
+			src/fuzz_engine.cpp
+		clang -g -O1 -fsanitize=fuzzer,address -DAC_LIBFUZZER -Ilib \
+			src/fuzz.c fuzz_engine.o lib/[a-z]*.c -lz -pthread -lstdc++
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aho_corasick.h"
+#include "ac_dynamic.h"
+#include "ac_pages.h"
+#include "ac_static.h"
+#include "ac_utf8.h"
+#include "shards.h"
+#include "tables.h"
+
+#define MAX_PATTERNS 32
+#define MAX_TEXT 4096
+#define MAX_CELLS 12 /* shards * chunks */
+
+/* Options: byte 0 of an input */
+#define OPT_FOLD       0x03 /* AC_FOLD_* */
+#define OPT_SEMANTICS  0x0C /* AC_SEMANTICS_* << 2 (3 is OVERLAPPING) */
+#define OPT_BOUNDS     0x10 /* AC_BOUND_* flags on patterns */
+#define OPT_GROUPS     0x20 /* Three groups, some of them selected */
+#define OPT_CODEPOINTS 0x40 /* Check MATCH::cp_position */
+#define OPT_LONG       0x80 /* Patterns of 16 alphas or more */
+
+struct pattern
+{
+	STRING s; /* id is the index */
+	unsigned int flags;
+	unsigned int group;
+	int accepted; /* Added to the automata without an error */
+	int removed; /* Removed from the dynamic set */
+};
+
+struct hit
+{
+	unsigned long position;
+	unsigned long key; /* id, or length of the string in leftmost semantics */
+};
+
+struct hits
+{
+	struct hit *v;
+	unsigned long num, max;
+	unsigned long calls; /* Of the callback */
+};
+
+/* A cell of the partition, as in parallel */
+struct cell
+{
+	unsigned long base, from, to;
+};
+
+/* The current input */
+const unsigned char *input;
+size_t input_size;
+AC_FOLD fold;
+AC_SEMANTICS semantics;
+AC_PAGES pages;
+unsigned int options;
+AC_GROUPS selected;
+unsigned long long seed;
+struct pattern patterns[MAX_PATTERNS];
+unsigned int no_of_patterns;
+ALPHA text[MAX_TEXT];
+unsigned long text_length;
+
+/* The tables of acgen for check_static */
+unsigned long (*fuzz_delta)[256];
+unsigned long *fuzz_out_begin;
+STRING *fuzz_out;
+AC_STATIC_DEFINE(fuzz, unsigned long)
+
+struct hits got;
+struct cell cells[MAX_CELLS];
+int check_codepoints;
+int cp_wrong;
+short verbose = 0;
+
+unsigned long long state; /* Of the random generator */
+
+int LLVMFuzzerTestOneInput (const unsigned char *data, size_t size);
+int decode_input (const unsigned char *data, size_t size);
+void reference (struct hits *expected, int dynamic);
+int occurs (struct pattern *p, unsigned long start);
+int passes (struct pattern *p, unsigned long start);
+unsigned char fold_alpha (unsigned char c);
+unsigned long fold_cp (unsigned long cp);
+int word_alpha (int c);
+void build (AC_AUTOMATA *aca, STRING *order, unsigned int *shard_of, unsigned int shard);
+void check_search (struct hits *expected, AC_AUTOMATA *aca, struct hits *first);
+void check_split (struct hits *expected, AC_AUTOMATA *aca);
+void check_count (struct hits *expected, AC_AUTOMATA *aca);
+void check_first_n (AC_AUTOMATA *aca, struct hits *first);
+void check_partition (struct hits *expected);
+void check_dynamic (void);
+void check_static (struct hits *expected, AC_AUTOMATA *aca);
+void check_engine (struct hits *expected);
+void engine_search (int dense, AC_FOLD fold, const STRING *patterns,
+		unsigned int no_of_patterns, int *accepted, const ALPHA *text,
+		unsigned long length, unsigned long (*next_chunk) (unsigned long done),
+		MATCH_CALBACK callback, unsigned long *count);
+void check_regressions (void);
+unsigned long next_chunk (unsigned long done);
+void add_hit (struct hits *h, unsigned long position, unsigned long key);
+void compare (const char *engine, struct hits *expected, struct hits *h, int sorted);
+int compare_hits (const void *l, const void *r);
+void failure (const char *engine, const char *what, struct hits *expected, struct hits *h);
+void print_escaped (const ALPHA *s, unsigned long length);
+unsigned long long next_random (void);
+unsigned char *random_input (size_t *size);
+void print_usage (const char *exec_file);
+int collect (MATCH * m, int automata_num, int thread_num);
+
+#ifndef AC_LIBFUZZER
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 10000, i;
+	unsigned char *data;
+	size_t size, max;
+	FILE *fp;
+	int clopt;
+
+	while ((clopt = getopt(argc, argv, "n:S:vh?")) != -1) {
+		switch (clopt) {
+			case 'n':
+				iterations = strtoul(optarg, NULL, 10);
+				break;
+			case 'S':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (optind < argc) {
+		for (; optind < argc; optind++) {
+			if (!(fp = fopen(argv[optind], "rb"))) {
+				fprintf(stderr, "Cannot read input file - %s\n", argv[optind]);
+				exit(1);
+			}
+			data = NULL;
+			for (size = max = 0; !feof(fp); size += fread(data + size, 1, max - size, fp))
+				data = (unsigned char *) realloc(data, max += 1 << 16);
+			fclose(fp);
+
+			LLVMFuzzerTestOneInput(data, size);
+			free(data);
+		}
+		return 0;
+	}
+
+	check_regressions();
+
+	/* xorshift64* must not start at 0 */
+	state = (seed ? seed : 1) * 0x9E3779B97F4A7C15ULL;
+
+	for (i = 0; i < iterations; i++) {
+		data = random_input(&size);
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+
+		if (verbose && (i + 1) % 1000 == 0)
+			printf("%lu inputs\n", i + 1);
+	}
+	printf("%lu inputs, all engines agree\n", iterations);
+
+	return 0;
+}
+#endif
+
+
+int LLVMFuzzerTestOneInput (const unsigned char *data, size_t size)
+{
+	struct hits expected = { NULL, 0, 0, 0 }, first = { NULL, 0, 0, 0 };
+	unsigned long long keep = state;
+	AC_AUTOMATA aca;
+	unsigned int i;
+
+	if (!decode_input(data, size))
+		return 0;
+
+	/* Chunk sizes and the like come from the seed of the input */
+	state = seed * 0x9E3779B97F4A7C15ULL | 1;
+
+	build(&aca, NULL, NULL, 0);
+	reference(&expected, 0);
+
+	check_search(&expected, &aca, &first);
+	check_split(&expected, &aca);
+	check_count(&expected, &aca);
+	check_first_n(&aca, &first);
+
+	if (semantics == AC_SEMANTICS_OVERLAPPING && !(options & (OPT_BOUNDS | OPT_GROUPS))) {
+		check_static(&expected, &aca);
+		check_engine(&expected);
+	}
+
+	ac_automata_release(&aca);
+
+	if (semantics == AC_SEMANTICS_OVERLAPPING)
+		check_partition(&expected);
+
+	if (semantics == AC_SEMANTICS_OVERLAPPING && !(options & (OPT_BOUNDS | OPT_GROUPS)))
+		check_dynamic();
+
+	for (i = 0; i < no_of_patterns; i++)
+		free(patterns[i].s.str);
+	free(expected.v);
+	free(first.v);
+	free(got.v);
+	got.v = NULL;
+	got.max = 0;
+
+	state = keep;
+
+	return 0;
+}
+
+
+/* An input is:
+	byte 0      options, OPT_*
+	byte 1      number of patterns, 1 + byte % MAX_PATTERNS
+	bytes 2-5   seed of chunk sizes, grids, removals and pages
+	bytes 6-7   length of the text, little endian
+	the text
+	the patterns, each of them 3 bytes c, d, e and maybe the string:
+	            length 1 + c % 32 (16 + c % 48 with OPT_LONG); if d is odd
+	            it is a piece of the text from (d >> 1) / 128 of it, else
+	            the string follows; AC_BOUND_* flags e & 0x0F, group
+	            (e >> 4) % 3
+   Returns 0 when there is no pattern */
+int decode_input (const unsigned char *data, size_t size)
+{
+	const unsigned char *p = data + 8, *end = data + size, *src;
+	unsigned int wanted, c, d, e;
+	unsigned long length, offset;
+
+	if (size < 8)
+		return 0;
+
+	input = data;
+	input_size = size;
+	options = data[0];
+	fold = (AC_FOLD) (options & OPT_FOLD);
+	semantics = ((options & OPT_SEMANTICS) >> 2) == 3 ? AC_SEMANTICS_OVERLAPPING :
+		(AC_SEMANTICS) ((options & OPT_SEMANTICS) >> 2);
+	wanted = 1 + data[1] % MAX_PATTERNS;
+	seed = data[2] | data[3] << 8 | data[4] << 16 | (unsigned long long) data[5] << 24;
+	selected = (options & OPT_GROUPS) ? 1 + seed % 7 : AC_GROUPS_ALL;
+	pages = (AC_PAGES) ((seed >> 8) % 3); /* Default, packed or huge */
+
+	text_length = data[6] | data[7] << 8;
+	if (text_length > (unsigned long) (end - p))
+		text_length = end - p;
+	if (text_length > MAX_TEXT)
+		text_length = MAX_TEXT;
+	memcpy(text, p, text_length);
+	p += text_length;
+
+	for (no_of_patterns = 0; no_of_patterns < wanted && end - p >= 3; ) {
+		c = p[0];
+		d = p[1];
+		e = p[2];
+		p += 3;
+
+		length = (options & OPT_LONG) ? 16 + c % 48 : 1 + c % 32;
+		if ((d & 1) && text_length) {
+			offset = (d >> 1) * text_length / 128;
+			if (offset + length > text_length)
+				length = text_length - offset;
+			src = (const unsigned char *) text + offset;
+		}
+		else {
+			if (length > (unsigned long) (end - p))
+				length = end - p;
+			src = p;
+			p += length;
+		}
+		if (!length)
+			continue;
+
+		patterns[no_of_patterns].s.str = (ALPHA *) malloc(length);
+		memcpy(patterns[no_of_patterns].s.str, src, length);
+		patterns[no_of_patterns].s.length = length;
+		patterns[no_of_patterns].s.id = no_of_patterns;
+		patterns[no_of_patterns].flags = (options & OPT_BOUNDS) ? e & 0x0F : 0;
+		patterns[no_of_patterns].group = (options & OPT_GROUPS) ? (e >> 4) % 3 : 0;
+		patterns[no_of_patterns].removed = 0;
+		no_of_patterns++;
+	}
+
+	return no_of_patterns > 0;
+}
+
+
+/* The naive matcher: every accepted pattern at every position. With
+   'dynamic', removed patterns are left out. */
+void reference (struct hits *expected, int dynamic)
+{
+	unsigned long start, end, best_length;
+	unsigned int i, best;
+
+	if (semantics == AC_SEMANTICS_OVERLAPPING) {
+		for (end = 1; end <= text_length; end++)
+			for (i = 0; i < no_of_patterns; i++) {
+				if (!patterns[i].accepted || (dynamic && patterns[i].removed) ||
+					patterns[i].s.length > end)
+					continue;
+				start = end - patterns[i].s.length;
+				if (occurs(&patterns[i], start) && passes(&patterns[i], start))
+					add_hit(expected, end, i);
+			}
+		return;
+	}
+
+	/* Leftmost: of the strings at the leftmost start the longest, or the
+	   first added; then go on after it */
+	for (start = 0; start < text_length; ) {
+		best = no_of_patterns;
+		for (i = 0; i < no_of_patterns; i++) {
+			if (!patterns[i].accepted || !occurs(&patterns[i], start) ||
+				!passes(&patterns[i], start))
+				continue;
+			if (best == no_of_patterns || (semantics == AC_SEMANTICS_LEFTMOST_LONGEST &&
+					patterns[i].s.length > patterns[best].s.length))
+				best = i;
+		}
+
+		if (best == no_of_patterns) {
+			start++;
+			continue;
+		}
+
+		best_length = patterns[best].s.length;
+		add_hit(expected, start + best_length, best_length);
+		start += best_length;
+	}
+}
+
+
+int occurs (struct pattern *p, unsigned long start)
+{
+	unsigned long i, cp, text_cp;
+	AC_OFFSET length;
+
+	if (start + p->s.length > text_length)
+		return 0;
+
+	for (i = 0; i < p->s.length; ) {
+		/* AC_FOLD_UTF8: code points of the pattern and of the text at the
+		   same place compare folded, other alphas as they are */
+		if (fold == AC_FOLD_UTF8 &&
+			(length = ac_utf8_decode(p->s.str + i, p->s.length - i, &cp)) &&
+			ac_utf8_decode(text + start + i, text_length - start - i, &text_cp) == length) {
+			if (fold_cp(cp) != fold_cp(text_cp))
+				return 0;
+			i += length;
+			continue;
+		}
+
+		if (fold_alpha(text[start + i]) != fold_alpha(p->s.str[i]))
+			return 0;
+		i++;
+	}
+
+	return 1;
+}
+
+
+/* Group selection and AC_BOUND_* flags, as documented in ac_types.h */
+int passes (struct pattern *p, unsigned long start)
+{
+	unsigned long end = start + p->s.length;
+	int prev = start ? (unsigned char) text[start - 1] : -1;
+	int next = end < text_length ? (unsigned char) text[end] : -1;
+
+	if (!(selected & AC_GROUP(p->group)))
+		return 0;
+
+	if ((p->flags & AC_BOUND_WORD_LEFT) && word_alpha(prev))
+		return 0;
+	if ((p->flags & AC_BOUND_WORD_RIGHT) && word_alpha(next))
+		return 0;
+	if ((p->flags & AC_BOUND_LINE_START) && prev >= 0 && prev != '\n')
+		return 0;
+	if ((p->flags & AC_BOUND_LINE_END) && next >= 0 && next != '\n')
+		return 0;
+
+	return 1;
+}
+
+
+unsigned char fold_alpha (unsigned char c)
+{
+	if (fold != AC_FOLD_NONE && c >= 'A' && c <= 'Z')
+		return c + 32;
+	if (fold == AC_FOLD_LATIN1 && c >= 0xC0 && c <= 0xDE && c != 0xD7)
+		return c + 32;
+
+	return c;
+}
+
+
+/* Simple case folding, to a code point of the same UTF-8 length only */
+unsigned long fold_cp (unsigned long cp)
+{
+	ALPHA bytes[AC_UTF8_MAX];
+	unsigned long folded = ac_utf8_fold(cp);
+
+	return ac_utf8_encode(folded, bytes) == ac_utf8_encode(cp, bytes) ? folded : cp;
+}
+
+
+/* Letters, digits, '_' and bytes above 0x7F; -1 is no alpha */
+int word_alpha (int c)
+{
+	return c >= 0 && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') || c == '_' || c > 0x7F);
+}
+
+
+/* The automata of one pattern shard: the patterns of 'order' in shard
+   'shard' of 'shard_of'. Without 'order' it is the whole set in file
+   order, and tells which patterns are accepted; a shard must accept
+   the same ones. */
+void build (AC_AUTOMATA *aca, STRING *order, unsigned int *shard_of, unsigned int shard)
+{
+	struct pattern *p;
+	unsigned int i;
+	AC_ERROR status;
+
+	ac_automata_init(aca, collect);
+	ac_automata_set_fold(aca, fold);
+	ac_automata_set_semantics(aca, semantics);
+	ac_automata_set_pages(aca, pages);
+
+	for (i = 0; i < no_of_patterns; i++) {
+		if (order && shard_of[i] != shard)
+			continue;
+		p = order ? &patterns[order[i].id] : &patterns[i];
+
+		status = ac_automata_add_string_group(aca, &p->s, p->group, p->flags);
+		if (!order)
+			p->accepted = (status == ACERR_NONE);
+		else if ((status == ACERR_NONE) != p->accepted) {
+			fprintf(stderr, "partition: pattern %lu is %s in shard %u\n",
+				(unsigned long) p->s.id, p->accepted ? "refused" : "accepted", shard);
+			failure("partition", "a shard accepts other patterns than the whole set", NULL, NULL);
+		}
+	}
+
+	ac_automata_locate_failure(aca);
+	ac_automata_select_groups(aca, selected);
+}
+
+
+/* The whole text at once; its matches in order of report are kept in
+   'first' for check_first_n */
+void check_search (struct hits *expected, AC_AUTOMATA *aca, struct hits *first)
+{
+	STRING chunk;
+	unsigned long i;
+
+	got.num = got.calls = 0;
+	chunk.str = text;
+	chunk.length = text_length;
+	ac_automata_search(aca, &chunk, 0, -1);
+	chunk.length = 0;
+	ac_automata_search(aca, &chunk, 0, -1);
+
+	for (i = 1; i < got.num; i++)
+		if (got.v[i].position < got.v[i - 1].position)
+			failure("search", "matches are not reported in order of position", NULL, &got);
+
+	for (i = 0; i < got.num; i++)
+		add_hit(first, got.v[i].position, got.v[i].key);
+	first->calls = got.calls;
+
+	compare("search", expected, &got, 0);
+}
+
+
+void check_split (struct hits *expected, AC_AUTOMATA *aca)
+{
+	STRING chunk;
+	unsigned long done, length;
+
+	ac_automata_reset(aca);
+	check_codepoints = (options & OPT_CODEPOINTS) != 0;
+	cp_wrong = 0;
+	ac_automata_set_codepoints(aca, check_codepoints);
+
+	got.num = got.calls = 0;
+	for (done = 0; done < text_length; done += length) {
+		length = next_chunk(done);
+		chunk.str = text + done;
+		chunk.length = length;
+		ac_automata_search(aca, &chunk, 0, -1);
+	}
+	chunk.length = 0;
+	ac_automata_search(aca, &chunk, 0, -1);
+
+	check_codepoints = 0;
+	ac_automata_set_codepoints(aca, 0);
+
+	if (cp_wrong)
+		failure("split", "a code point position is wrong", NULL, &got);
+
+	compare("split", expected, &got, 0);
+}
+
+
+void check_count (struct hits *expected, AC_AUTOMATA *aca)
+{
+	STRING chunk;
+	unsigned long done, length, count, i;
+	unsigned long counts[MAX_PATTERNS + 1];
+	int exists;
+
+	chunk.str = text;
+	chunk.length = text_length;
+
+	ac_automata_reset(aca);
+	count = ac_automata_count(aca, &chunk);
+	chunk.length = 0;
+	count += ac_automata_count(aca, &chunk);
+	if (count != expected->num) {
+		fprintf(stderr, "count: %lu, expected %lu\n", count, expected->num);
+		failure("count", "wrong number of matches", expected, NULL);
+	}
+
+	ac_automata_reset(aca);
+	chunk.length = text_length;
+	exists = ac_automata_exists(aca, &chunk);
+	chunk.length = 0;
+	exists = exists || ac_automata_exists(aca, &chunk);
+	if (exists != (expected->num > 0))
+		failure("exists", exists ? "a match where there is none" : "no match", expected, NULL);
+
+	/* Counts by id; leftmost keys are lengths, so only the total is checked */
+	ac_automata_reset(aca);
+	memset(counts, 0, sizeof(counts));
+	count = 0;
+	for (done = 0; done < text_length; done += length) {
+		length = next_chunk(done);
+		chunk.str = text + done;
+		chunk.length = length;
+		count += ac_automata_count_each(aca, &chunk, counts, no_of_patterns);
+	}
+	chunk.length = 0;
+	count += ac_automata_count_each(aca, &chunk, counts, no_of_patterns);
+
+	if (count != expected->num)
+		failure("count_each", "wrong number of matches", expected, NULL);
+
+	if (semantics == AC_SEMANTICS_OVERLAPPING) {
+		for (i = 0; i < expected->num; i++)
+			counts[expected->v[i].key]--;
+		for (i = 0; i < no_of_patterns; i++)
+			if (counts[i]) {
+				fprintf(stderr, "count_each: pattern %lu is off by %ld\n", i, (long) counts[i]);
+				failure("count_each", "wrong count of a pattern", expected, NULL);
+			}
+	}
+}
+
+
+/* The first n matches are the first n calls of the callback */
+void check_first_n (AC_AUTOMATA *aca, struct hits *first)
+{
+	MATCH matches[8];
+	STRING chunk;
+	unsigned int n = 1 + next_random() % 8, k, i;
+	unsigned long expected_k = first->calls < n ? first->calls : n;
+
+	ac_automata_reset(aca);
+	chunk.str = text;
+	chunk.length = text_length;
+	got.num = 0;
+
+	/* matched_strings are valid until the next call */
+	k = ac_automata_first_n(aca, &chunk, matches, n);
+	for (i = 0; i < k; i++)
+		collect(&matches[i], 0, -1);
+	if (k < n) {
+		chunk.length = 0;
+		i = k;
+		k += ac_automata_first_n(aca, &chunk, matches + k, n - k);
+		for (; i < k; i++)
+			collect(&matches[i], 0, -1);
+	}
+
+	if (k != expected_k || got.num > first->num) {
+		fprintf(stderr, "first_n: %u of %u, expected %lu\n", k, n, expected_k);
+		failure("first_n", "wrong number of matches", first, &got);
+	}
+	first->num = got.num;
+	compare("first_n", first, &got, 1);
+}
+
+
+/* The grid of parallel: shards times chunks, each cell searching its
+   chunk from an overlap before it and reporting matches ending in it.
+   As parallel, the planner and the sharding of shards.h get all the
+   patterns, duplicates and refused ones included. */
+void check_partition (struct hits *expected)
+{
+	AC_AUTOMATA shard[MAX_CELLS], views[MAX_CELLS];
+	STRING order[MAX_PATTERNS];
+	unsigned int shard_of[MAX_PATTERNS + 1];
+	unsigned int threads = 1 + next_random() % MAX_CELLS, shards, chunks;
+	unsigned long nodes, overlap = 0;
+	int i;
+
+	for (i = 0; i < (int) no_of_patterns; i++) {
+		order[i] = patterns[i].s;
+		if (patterns[i].s.length > overlap)
+			overlap = patterns[i].s.length;
+	}
+	overlap++;
+
+	/* A cache of a few nodes and an input of a few chunks, so that the
+	   small sets of a fuzz input are split as a large one is */
+	nodes = count_nodes(order, no_of_patterns, fold, NULL);
+	plan_grid(nodes, (next_random() % 5) * MIN_CHUNK_SIZE, threads, no_of_patterns,
+		(1 + next_random() % 32) * node_bytes(), &shards, &chunks);
+	for (i = 0; i < (int) no_of_patterns; i++)
+		shard_of[i] = shards;
+	count_nodes(order, no_of_patterns, fold, shard_of);
+
+	for (i = 0; i < (int) shards; i++)
+		build(&shard[i], order, shard_of, i);
+
+	for (i = 0; i < (int) (shards * chunks); i++) {
+		struct cell *c = &cells[i];
+		unsigned int chunk = i / shards;
+
+		c->from = text_length * chunk / chunks;
+		c->to = text_length * (chunk + 1) / chunks;
+		c->base = c->from > overlap ? c->from - overlap : 0;
+		ac_automata_view(&views[i], &shard[i % shards], collect);
+	}
+
+	got.num = got.calls = 0;
+
+	#pragma omp parallel for schedule(dynamic)
+	for (i = 0; i < (int) (shards * chunks); i++) {
+		struct cell *c = &cells[i];
+		unsigned long stop = c->to + 1 < text_length ? c->to + 1 : text_length;
+		STRING chunk;
+
+		if (c->to == c->from)
+			continue;
+
+		chunk.str = text + c->base;
+		chunk.length = stop - c->base;
+		ac_automata_search(&views[i], &chunk, i % shards, i);
+		chunk.length = 0;
+		ac_automata_search(&views[i], &chunk, i % shards, i);
+	}
+
+	for (i = 0; i < (int) (shards * chunks); i++)
+		ac_automata_view_release(&views[i]);
+	for (i = 0; i < (int) shards; i++)
+		ac_automata_release(&shard[i]);
+
+	compare("partition", expected, &got, 0);
+}
+
+
+/* A snapshot of the accepted patterns, some of them removed */
+void check_dynamic (void)
+{
+	struct hits expected = { NULL, 0, 0, 0 };
+	AC_DYNAMIC dynamic;
+	AC_SNAPSHOT *snap;
+	AC_AUTOMATA view;
+	STRING chunk;
+	unsigned int i, ticket;
+
+	ac_dynamic_init(&dynamic, collect, fold);
+
+	for (i = 0; i < no_of_patterns; i++)
+		if (patterns[i].accepted)
+			ac_dynamic_add_string(&dynamic, &patterns[i].s);
+
+	for (i = 0; i < no_of_patterns; i++)
+		if (patterns[i].accepted && !(next_random() % 4)) {
+			patterns[i].removed = 1;
+			ac_dynamic_remove_string(&dynamic, i);
+		}
+
+	ac_dynamic_sync(&dynamic, ac_dynamic_commit(&dynamic));
+
+	snap = ac_dynamic_enter(&dynamic, &ticket);
+	ac_automata_view(&view, &snap->automata, collect);
+
+	got.num = got.calls = 0;
+	chunk.str = text;
+	chunk.length = text_length;
+	ac_automata_search(&view, &chunk, 0, -1);
+	chunk.length = 0;
+	ac_automata_search(&view, &chunk, 0, -1);
+
+	ac_automata_view_release(&view);
+	ac_dynamic_leave(&dynamic, ticket);
+	ac_dynamic_release(&dynamic);
+
+	reference(&expected, 1);
+	compare("dynamic", &expected, &got, 0);
+	free(expected.v);
+}
+
+
+/* The tables acgen would generate for the automata, over random chunks */
+void check_static (struct hits *expected, AC_AUTOMATA *aca)
+{
+	AC_STATIC_CURSOR cursor = AC_STATIC_CURSOR_INIT;
+	struct tables t;
+	unsigned long done, length, count, k;
+
+	build_tables(aca, &t);
+	fuzz_delta = (unsigned long (*)[256]) t.delta;
+	fuzz_out_begin = t.out_begin;
+	fuzz_out = (STRING *) malloc((t.out_num + 1) * sizeof(STRING));
+	for (k = 0; k < t.out_num; k++)
+		fuzz_out[k] = aca->patterns[t.out[k]];
+
+	got.num = got.calls = 0;
+	for (done = 0; done < text_length; done += length) {
+		length = next_chunk(done);
+		fuzz_search(&cursor, text + done, length, collect, 0, -1);
+	}
+	compare("static", expected, &got, 0);
+
+	cursor.state = cursor.base = 0;
+	for (done = count = 0; done < text_length; done += length) {
+		length = next_chunk(done);
+		count += fuzz_count(&cursor, text + done, length);
+	}
+	if (count != expected->num) {
+		fprintf(stderr, "static count: %lu, expected %lu\n", count, expected->num);
+		failure("static", "wrong number of matches", expected, NULL);
+	}
+
+	free(fuzz_out);
+	release_tables(&t);
+}
+
+
+/* Both transition policies of ac::engine, given all the patterns */
+void check_engine (struct hits *expected)
+{
+	STRING strings[MAX_PATTERNS];
+	int accepted[MAX_PATTERNS];
+	unsigned long count;
+	unsigned int i;
+	int dense;
+
+	for (i = 0; i < no_of_patterns; i++)
+		strings[i] = patterns[i].s;
+
+	for (dense = 0; dense < 2; dense++) {
+		got.num = got.calls = 0;
+		engine_search(dense, fold, strings, no_of_patterns, accepted, text, text_length,
+			next_chunk, collect, &count);
+
+		for (i = 0; i < no_of_patterns; i++)
+			if (accepted[i] != patterns[i].accepted) {
+				fprintf(stderr, "engine: pattern %u is %s\n", i,
+					accepted[i] ? "accepted" : "refused");
+				failure("engine", "the engine accepts other patterns than the C API", NULL, NULL);
+			}
+
+		compare(dense ? "engine dense" : "engine sparse", expected, &got, 0);
+
+		if (count != expected->num) {
+			fprintf(stderr, "engine count: %lu, expected %lu\n", count, expected->num);
+			failure("engine", "wrong number of matches", expected, NULL);
+		}
+	}
+}
+
+
+/* Cases that went wrong once and that random inputs rarely hit */
+void check_regressions (void)
+{
+	AC_AUTOMATA aca;
+	STRING s, chunk;
+	AC_ERROR status;
+
+	/* With AC_FOLD_UTF8 a pattern from inside a code point, here the end
+	   of U+03C3, would lose its matches in the code point to U+03A3, which
+	   has another last byte and the same node: it is refused */
+	ac_automata_init(&aca, collect);
+	ac_automata_set_fold(&aca, AC_FOLD_UTF8);
+	s.str = "\x83";
+	s.length = 1;
+	s.id = 0;
+	status = ac_automata_add_string(&aca, &s);
+	s.str = "\xce\xa3";
+	s.length = 2;
+	s.id = 1;
+	ac_automata_add_string(&aca, &s);
+	ac_automata_locate_failure(&aca);
+
+	got.num = got.calls = 0;
+	chunk.str = "\xcf\x83\xce\xa3";
+	chunk.length = 4;
+	ac_automata_search(&aca, &chunk, 0, -1);
+	ac_automata_release(&aca);
+
+	if (status != ACERR_PARTIAL_STRING || got.num != 2 || got.v[0].key != 1 || got.v[1].key != 1) {
+		fprintf(stderr, "fuzz: regression: a UTF-8 continuation byte starts a pattern\n");
+		abort();
+	}
+}
+
+
+/* Length of the next chunk: often 1 or a few alphas, to cut through
+   matches, pending boundaries and leftmost candidates */
+unsigned long next_chunk (unsigned long done)
+{
+	unsigned long left = text_length - done, length;
+
+	switch (next_random() % 4) {
+		case 0: length = 1; break;
+		case 1: length = 1 + next_random() % 4; break;
+		case 2: length = 1 + next_random() % 64; break;
+		default: length = 1 + next_random() % (left ? left : 1);
+	}
+
+	return length < left ? length : left;
+}
+
+
+void add_hit (struct hits *h, unsigned long position, unsigned long key)
+{
+	if (h->num >= h->max) {
+		h->max = h->max ? 2 * h->max : 64;
+		h->v = (struct hit *) realloc(h->v, h->max * sizeof(struct hit));
+	}
+	h->v[h->num].position = position;
+	h->v[h->num].key = key;
+	h->num++;
+}
+
+
+/* Same matches as expected. With 'sorted' they must come in the same
+   order, otherwise both are sorted by position and key first */
+void compare (const char *engine, struct hits *expected, struct hits *h, int sorted)
+{
+	unsigned long i;
+
+	if (!sorted && expected->num > 1)
+		qsort(expected->v, expected->num, sizeof(struct hit), compare_hits);
+	if (!sorted && h->num > 1)
+		qsort(h->v, h->num, sizeof(struct hit), compare_hits);
+
+	for (i = 0; i < expected->num && i < h->num; i++)
+		if (expected->v[i].position != h->v[i].position || expected->v[i].key != h->v[i].key)
+			break;
+
+	if (i < expected->num || i < h->num)
+		failure(engine, "matches differ from the reference", expected, h);
+}
+
+
+int compare_hits (const void *l, const void *r)
+{
+	const struct hit *a = (const struct hit *) l, *b = (const struct hit *) r;
+
+	if (a->position != b->position)
+		return (a->position > b->position) - (a->position < b->position);
+
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+
+/* Print the input and the first difference, and abort */
+void failure (const char *engine, const char *what, struct hits *expected, struct hits *h)
+{
+	static const char *folds[] = { "none", "ascii", "latin1", "utf8" };
+	static const char *semantics_names[] = { "overlapping", "leftmost-longest", "leftmost-first" };
+	unsigned long i = 0, n;
+	unsigned int k;
+	FILE *fp;
+
+	fprintf(stderr, "fuzz: %s: %s\n", engine, what);
+	fprintf(stderr, "fold %s, semantics %s, groups %llx%s%s%s, pages %s, seed %llu\n",
+		folds[fold], semantics_names[semantics], selected,
+		(options & OPT_BOUNDS) ? ", bounds" : "", (options & OPT_CODEPOINTS) ? ", codepoints" : "",
+		(options & OPT_LONG) ? ", long" : "", ac_pages_name(pages), seed);
+
+	for (k = 0; k < no_of_patterns; k++) {
+		fprintf(stderr, "pattern %u: ", k);
+		print_escaped(patterns[k].s.str, patterns[k].s.length);
+		fprintf(stderr, " flags %x group %u%s%s\n", patterns[k].flags, patterns[k].group,
+			patterns[k].accepted ? "" : " (rejected)", patterns[k].removed ? " (removed)" : "");
+	}
+	fprintf(stderr, "text (%lu): ", text_length);
+	print_escaped(text, text_length);
+	fprintf(stderr, "\n");
+
+	if (expected && h) {
+		n = expected->num < h->num ? expected->num : h->num;
+		for (i = 0; i < n; i++)
+			if (expected->v[i].position != h->v[i].position || expected->v[i].key != h->v[i].key)
+				break;
+		fprintf(stderr, "expected %lu matches, got %lu; (position, %s) at %lu: ",
+			expected->num, h->num, semantics ? "length" : "id", i);
+		if (i < expected->num)
+			fprintf(stderr, "expected (%lu, %lu) ", expected->v[i].position, expected->v[i].key);
+		if (i < h->num)
+			fprintf(stderr, "got (%lu, %lu)", h->v[i].position, h->v[i].key);
+		fprintf(stderr, "\n");
+	}
+
+	/* Replay it with: fuzz fuzz-failure */
+	if ((fp = fopen("fuzz-failure", "wb"))) {
+		fwrite(input, 1, input_size, fp);
+		fclose(fp);
+		fprintf(stderr, "input written to fuzz-failure\n");
+	}
+
+	abort();
+}
+
+
+void print_escaped (const ALPHA *s, unsigned long length)
+{
+	unsigned long i;
+	unsigned char c;
+
+	fputc('"', stderr);
+	for (i = 0; i < length; i++) {
+		c = (unsigned char) s[i];
+		if (c == '"' || c == '\\')
+			fprintf(stderr, "\\%c", c);
+		else if (c < 0x20 || c > 0x7E)
+			fprintf(stderr, "\\x%02x", c);
+		else
+			fputc(c, stderr);
+	}
+	fputc('"', stderr);
+}
+
+
+/* xorshift64*, as in corpus */
+unsigned long long next_random (void)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+
+/* An input of a few alphas, so that patterns match often. Upper and
+   lower case of ASCII and Latin-1 letters test folding; '_', ' ' and
+   '\n' boundaries; the other bytes make UTF-8 code points and their case
+   variants, e.g. U+00E9 and U+00C9, U+03C3 and U+03A3. Some patterns
+   are a case variant of the one before, for the sharding of parallel. */
+unsigned char *random_input (size_t *size)
+{
+	static const unsigned char pool[] = "ab AB_\n\xC9\xE9\xC3\xA9\x89\xCE\xCF\x83\xA3";
+	unsigned int alphas = 2 + next_random() % (sizeof(pool) - 2);
+	unsigned int n = 1 + next_random() % 16, i, length;
+	unsigned long text_size = next_random() % 512, k;
+	unsigned char *data = (unsigned char *) malloc(8 + text_size + n * (3 + 64));
+	unsigned char *p = data + 8, *previous = NULL;
+
+	data[0] = next_random();
+	data[1] = n - 1;
+	for (i = 2; i < 6; i++)
+		data[i] = next_random();
+	data[6] = text_size & 0xFF;
+	data[7] = text_size >> 8;
+
+	for (k = 0; k < text_size; k++)
+		*p++ = pool[next_random() % alphas];
+
+	for (i = 0; i < n; i++) {
+		p[0] = next_random() % ((data[0] & OPT_LONG) ? 48 : 8);
+		p[1] = next_random() | (next_random() % 4 ? 1 : 0);
+		p[2] = next_random();
+		if (previous && !(p[1] & 1) && !(next_random() % 4)) {
+			/* a <-> A, U+00E9 <-> U+00C9 in Latin-1 and in UTF-8 */
+			p[0] = previous[0];
+			length = (data[0] & OPT_LONG) ? 16 + p[0] % 48 : 1 + p[0] % 32;
+			for (k = 0; k < length; k++) {
+				unsigned char c = previous[3 + k];
+				p[3 + k] = strchr("ab\xE9\xA9", c | 0x20) && next_random() % 2 ? c ^ 0x20 : c;
+			}
+			previous = p;
+			p += 3 + length;
+			continue;
+		}
+
+		length = (data[0] & OPT_LONG) ? 16 + p[0] % 48 : 1 + p[0] % 32;
+		if (p[1] & 1)
+			p += 3;
+		else {
+			previous = p;
+			for (p += 3, k = 0; k < length; k++)
+				*p++ = pool[next_random() % alphas];
+		}
+	}
+
+	*size = p - data;
+
+	return data;
+}
+
+
+void print_usage (const char *exec_file)
+{
+	fprintf(stderr, "Usage: %s [-n iterations] [-S seed] [-v] [input_file ...]\n", exec_file);
+	fprintf(stderr, "    -n iterations  random inputs to check (10000)\n");
+	fprintf(stderr, "    -S seed        of the random inputs (0)\n");
+	fprintf(stderr, "    input_file     check these inputs instead, e.g. from a fuzzer\n");
+}
+
+
+/* Collects the matches; thread_num is the cell in check_partition, -1
+   otherwise */
+int collect (MATCH * m, int automata_num, int thread_num)
+{
+	unsigned long position = m->position;
+	unsigned int j;
+
+	if (thread_num >= 0) {
+		struct cell *c = &cells[thread_num];
+
+		position += c->base;
+		if (position <= c->from || position > c->to)
+			return 0;
+	}
+
+	if (check_codepoints && m->cp_position != ac_utf8_count(text, position))
+		cp_wrong = 1;
+
+	#pragma omp critical
+	{
+		got.calls++;
+		for (j = 0; j < m->match_num; j++)
+			add_hit(&got, position, semantics ? m->matched_strings[j].length :
+				m->matched_strings[j].id);
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+/*
+	The C++ engine (lib/ac_engine.hpp) for fuzz.c: both transition
+	policies search the input of fuzz over its random chunks.
+*/
+
+#include <cstdint>
+
+#include "ac_engine.hpp"
+
+extern "C" void engine_search (int dense, AC_FOLD fold, const STRING * patterns,
+		unsigned int no_of_patterns, int * accepted, const ALPHA * text,
+		unsigned long length, unsigned long (* next_chunk) (unsigned long done),
+		MATCH_CALBACK callback, unsigned long * count);
+
+template <typename Engine>
+static void search (Engine & e, AC_FOLD fold, const STRING * patterns,
+		unsigned int no_of_patterns, int * accepted, const ALPHA * text,
+		unsigned long length, unsigned long (* next_chunk) (unsigned long done),
+		MATCH_CALBACK callback, unsigned long * count)
+{
+	typename Engine::cursor c;
+	unsigned long done, chunk;
+	unsigned int i;
+
+	e.set_fold (fold);
+	for (i = 0; i < no_of_patterns; i++)
+		accepted[i] = e.add (patterns[i].str, patterns[i].length,
+			patterns[i].id) == ACERR_NONE;
+	e.compile ();
+
+	for (done = 0; done < length; done += chunk) {
+		chunk = next_chunk (done);
+		e.search (c, text + done, chunk, ac::callback_sink { callback, 0, -1 });
+	}
+
+	/* A sink without a result, over the whole text */
+	*count = 0;
+	e.search (text, length, [&] (std::size_t, const STRING *, std::size_t num) {
+		*count += num;
+	});
+}
+
+/* Add the patterns to an engine, telling which ones it accepts, search
+   the text in chunks of next_chunk() reporting to the callback, then
+   count the matches of the whole text */
+extern "C" void engine_search (int dense, AC_FOLD fold, const STRING * patterns,
+		unsigned int no_of_patterns, int * accepted, const ALPHA * text,
+		unsigned long length, unsigned long (* next_chunk) (unsigned long done),
+		MATCH_CALBACK callback, unsigned long * count)
+{
+	if (dense) {
+		ac::engine<char, std::uint16_t, ac::dense_transitions> e;
+		search (e, fold, patterns, no_of_patterns, accepted, text, length,
+			next_chunk, callback, count);
+	}
+	else {
+		ac::engine<> e;
+		search (e, fold, patterns, no_of_patterns, accepted, text, length,
+			next_chunk, callback, count);
+	}
+}
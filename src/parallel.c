@@ -1,46 +1,94 @@
+#include <limits.h>
 #include <math.h>
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "aho_corasick.h"
-
-#define NO_OF_THREADS 2
-#define MAX_PATTERN_SIZE 128
+#include "ac_output.h"
+#include "ac_stream.h"
+#include "patterns.h"
+#include "shards.h"
+
+/* The work is a grid: every pattern shard (an automata) searches every
+   text chunk of each block. A cell is one shard and one chunk. */
+struct cell
+{
+	AC_AUTOMATA view; /* View of the automata of the shard */
+	unsigned int shard;
+	unsigned long base; /* Absolute position of the searched text */
+	unsigned long from, to; /* The cell reports matches ending in (from, to] */
+};
 
 short verbosity = 0;
+short formatted = 0; /* Report matches with the writers below (-f) */
+AC_OUTPUT *writers; /* One writer per cell */
+pthread_mutex_t stdout_lock = PTHREAD_MUTEX_INITIALIZER; /* Writers and -v share stdout */
+struct cell *cells;
 
-STRING read_file_to_search (const char *filename);
-STRING** read_patterns (const char *filename, unsigned int *no_of_patterns);
 void print_usage (const char *exec_file);
 int match_handler(MATCH * m, int automata_num, int thread_num);
 
 int main(int argc, char **argv)
 {
-	clock_t start = clock(), end, difference;
+	double start = omp_get_wtime(); /* Wall time; clock() sums all threads */
 	AC_AUTOMATA *aca;
-	STRING **patterns, input_buffer;
-	unsigned int i, j, no_of_patterns, chunk;
-	int clopt;
+	AC_STREAM input;
+	STRING *patterns, input_buffer, text;
+	unsigned int i, no_of_patterns, *shard_of;
+	unsigned int threads = omp_get_max_threads(), shards = 0, chunks = 0, no_of_cells;
+	unsigned long nodes, input_size = 0, overlap = 0, done = 0, text_base = 0, keep;
+	char *buffer;
+	int clopt, last = 0, status;
+	struct stat st;
 
 	/* Command line config*/
 	const char *pattern_file;
 	const char *input_file;
 	short timeit = 0;
+	AC_OUTPUT_FORMAT format;
+	AC_FOLD fold = AC_FOLD_NONE;
+	unsigned int bound = 0; /* AC_BOUND_* flags of all patterns */
 
 	if (argc < 4) {
 		print_usage(argv[0]);
 		exit(1);
 	}
 
-	while ((clopt = getopt(argc, argv, "P:vth?")) != -1) {
+	while ((clopt = getopt(argc, argv, "P:f:n:g:iwvth?")) != -1) {
 		switch (clopt) {
 			case 'P':
 				pattern_file = optarg;
 				break;
+			case 'f':
+				if (ac_output_parse_format(optarg, &format)) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				formatted = 1;
+				break;
+			case 'n':
+				if (!(threads = strtoul(optarg, NULL, 10))) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'g':
+				/* Force the grid: shards,chunks */
+				if (sscanf(optarg, "%u,%u", &shards, &chunks) != 2 || !shards || !chunks) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			case 'w':
+				bound = AC_BOUND_WORD;
+				break;
 			case 'v':
 				verbosity = 1;
 				break;
@@ -55,142 +103,219 @@ int main(int argc, char **argv)
 		}
 	}
 	input_file = *(argv + optind);
+	omp_set_num_threads(threads);
 
 	if (verbosity)
 		printf("Loading patterns from file - %s\n", pattern_file);
-	
-	patterns =  read_patterns (pattern_file, &no_of_patterns);
 
-	aca = (AC_AUTOMATA *) malloc(sizeof(AC_AUTOMATA)*NO_OF_THREADS);
+	patterns =  read_patterns (pattern_file, &no_of_patterns, 1);
+
+	for (i = 0; i < no_of_patterns; i++)
+		if (patterns[i].length > overlap)
+			overlap = patterns[i].length;
+
+	/* Compressed inputs are larger than their file, which is fine for
+	   an estimate of how many chunks are worth it */
+	if (!stat(input_file, &st))
+		input_size = st.st_size;
+
+	shard_of = (unsigned int *) malloc((no_of_patterns + 1) * sizeof(unsigned int));
+	nodes = count_nodes(patterns, no_of_patterns, fold, NULL);
+
+	if (!shards)
+		plan_grid(nodes, input_size, threads, no_of_patterns, cache_size(), &shards, &chunks);
+	if (shards > no_of_patterns)
+		shards = no_of_patterns ? no_of_patterns : 1;
+	no_of_cells = shards * chunks;
+
+	/* Balance the shards by node count */
+	for (i = 0; i < no_of_patterns; i++)
+		shard_of[i] = shards;
+	count_nodes(patterns, no_of_patterns, fold, shard_of);
+
+	if (verbosity)
+		printf("Plan: %lu nodes (about %lu KB), %u pattern shard(s) x %u text chunk(s)\n",
+			nodes, nodes * node_bytes() >> 10, shards, chunks);
+
+	aca = (AC_AUTOMATA *) malloc(sizeof(AC_AUTOMATA) * shards);
 
 	if (verbosity)
 		printf("Initialising automata\n");
-	
+
 	#pragma omp parallel for shared(aca)
-	for(i = 0; i < NO_OF_THREADS; i++)
+	for(i = 0; i < shards; i++) {
 		ac_automata_init (&aca[i], match_handler);
+		ac_automata_set_fold (&aca[i], fold);
+	}
 
 	if (verbosity)
 		printf("Adding strings\n");
 
 	#pragma omp parallel for shared(aca)
-	for (i = 0; i < NO_OF_THREADS; i++)
-		for (j = 0; j < no_of_patterns/NO_OF_THREADS; j++)
-			ac_automata_add_string(&aca[i], &patterns[i][j]);
-
-	input_buffer = read_file_to_search(input_file);
+	for (i = 0; i < shards; i++) {
+		unsigned int j;
+		for (j = 0; j < no_of_patterns; j++)
+			if (shard_of[j] == i)
+				ac_automata_add_string_ex(&aca[i], &patterns[j], bound);
+	}
 
 	if (verbosity)
 		printf("Locating failure nodes\n");
 
 	#pragma omp parallel for shared(aca)
-	for (i = 0; i < NO_OF_THREADS; i++)
+	for (i = 0; i < shards; i++)
 			ac_automata_locate_failure (&aca[i]);
 
-	if (verbosity)
-		printf("Searching\n");
+	cells = (struct cell *) malloc(sizeof(struct cell) * no_of_cells);
+	for (i = 0; i < no_of_cells; i++) {
+		cells[i].shard = i % shards;
+		ac_automata_view(&cells[i].view, &aca[cells[i].shard], NULL);
+	}
 
-	#pragma omp parallel for shared(aca)
-	for (i = 0; i < NO_OF_THREADS; i++) {
-		int id = omp_get_thread_num();
-		if (verbosity) {
-			printf("In thread: %d, Automata: %d\n", id, i);
-		}
+	if (formatted) {
+		writers = (AC_OUTPUT *) malloc(sizeof(AC_OUTPUT) * no_of_cells);
+		for (i = 0; i < no_of_cells; i++)
+			ac_output_init(&writers[i], STDOUT_FILENO, format, &stdout_lock);
+	}
 
-		ac_automata_search(&aca[i], &input_buffer, i, id);
+	if (ac_stream_open(&input, input_file)) {
+		fprintf(stderr, "Cannot read input file - %s\n", input_file);
+		exit(1);
 	}
-	
+
 	if (verbosity)
-		printf("Freeing resources\n");
+		printf("Searching\n");
+	/* The writers bypass stdio; what it buffered goes first */
+	fflush(stdout);
+
+	/* A cell searches its chunk from 'overlap' alphas before it, so that
+	   matches crossing chunks and blocks are found, and their left
+	   boundary is seen, and one alpha after it for the right boundary.
+	   That alpha is only known with the next block, so every round
+	   reports matches ending before the last alpha of the block, and an
+	   empty block at the end reports the rest. */
+	overlap += 1;
+	buffer = (char *) malloc(overlap + 2 + AC_STREAM_BLOCK_SIZE);
+	text.str = buffer;
+	text.length = 0;
+
+	while (!last) {
+		unsigned long owned_to;
+
+		if ((status = ac_stream_next(&input, &input_buffer)) < 0) {
+			fprintf(stderr, "Cannot read input file - %s\n", input_file);
+			exit(1);
+		}
+		if (status == 0) {
+			input_buffer.length = 0;
+			last = 1;
+		}
 
-	for (i = 0; i < NO_OF_THREADS; i++)
-		ac_automata_release (&aca[i]);
+		memcpy(buffer + text.length, input_buffer.str, input_buffer.length);
+		text.length += input_buffer.length;
 
-	if (timeit) {
-		int msec;
-		end = clock();
-		difference = end - start;
-		msec = difference * 1000 / CLOCKS_PER_SEC;
-		printf("\nTotal time taken - %d milliseconds\n", msec);
-	}
-	
-	return 0;
-}
+		owned_to = text_base + text.length - (last ? 0 : 1);
 
+		if (owned_to > done) {
+			for (i = 0; i < no_of_cells; i++) {
+				unsigned int chunk = i / shards;
+				struct cell *c = &cells[i];
 
-STRING read_file_to_search (const char *filename)
-{
-	STRING buffer;
-	FILE *fp;
+				c->from = done + (owned_to - done) * chunk / chunks;
+				c->to = done + (owned_to - done) * (chunk + 1) / chunks;
+				c->base = c->from > text_base + overlap ? c->from - overlap : text_base;
+			}
 
-	fp = fopen(filename, "r");
+			#pragma omp parallel for schedule(dynamic) shared(cells, text)
+			for (i = 0; i < no_of_cells; i++) {
+				struct cell *c = &cells[i];
+				unsigned long stop = c->to + 1 < text_base + text.length ? c->to + 1 :
+					text_base + text.length;
+				STRING chunk;
 
-    fseek(fp, 0, SEEK_END);
-    buffer.length = ftell(fp) + 1;
-    rewind(fp);
+				if (c->to == c->from)
+					continue;
 
-    buffer.str = (ALPHA *) malloc((buffer.length) * sizeof(ALPHA));
-    fread(buffer.str, buffer.length - 1, 1, fp);
-    buffer.str[buffer.length - 1] = '\0';
+				if (verbosity) {
+					pthread_mutex_lock(&stdout_lock);
+					printf("In thread: %d, Automata: %d\n", omp_get_thread_num(), c->shard);
+					fflush(stdout);
+					pthread_mutex_unlock(&stdout_lock);
+				}
 
-    fclose(fp);
+				chunk.str = text.str + (c->base - text_base);
+				chunk.length = stop - c->base;
 
-    return buffer;
-}
+				ac_automata_reset(&c->view);
+				ac_automata_search(&c->view, &chunk, c->shard, i);
 
+				/* Where the chunk stops, the cell's view of the input ends */
+				chunk.length = 0;
+				ac_automata_search(&c->view, &chunk, c->shard, i);
+			}
 
-STRING** read_patterns (const char *filename, unsigned int *no_of_patterns)
-{
-	unsigned int i, j, chunk;
-	ALPHA *buffer = (ALPHA *) malloc(MAX_PATTERN_SIZE * sizeof(char));
-	STRING **patterns = (STRING **) malloc(NO_OF_THREADS * sizeof(STRING *));
-	FILE *fp;
-
-	fp = fopen(filename, "r");
-
-	fscanf(fp, "%u\n", no_of_patterns);
-
-	chunk = *no_of_patterns / NO_OF_THREADS;
-	for(i = 0; i < NO_OF_THREADS; i++) {
-		
-		patterns[i] = (STRING *) malloc(chunk * sizeof(STRING));
-		
-		for(j = 0; j < chunk; j++) {
-			if (fscanf(fp, "%s\n", buffer) == -1)
-				break;
-			
-			patterns[i][j].str = (ALPHA *) malloc((strlen(buffer)+1) * sizeof(ALPHA));
-			
-			strcpy(patterns[i][j].str, buffer);
-			patterns[i][j].length = strlen(buffer);
-			patterns[i][j].id = i + 1;
+			done = owned_to;
 		}
+
+		/* Keep the tail for the next round */
+		keep = text.length < overlap + 1 ? text.length : overlap + 1;
+		memmove(buffer, buffer + text.length - keep, keep);
+		text_base += text.length - keep;
+		text.length = keep;
 	}
 
-	fclose(fp);
+	ac_stream_close(&input);
 
-	return patterns;
+	if (formatted)
+		for (i = 0; i < no_of_cells; i++)
+			ac_output_release(&writers[i]);
+
+	if (verbosity)
+		printf("Freeing resources\n");
+
+	for (i = 0; i < no_of_cells; i++)
+		ac_automata_view_release (&cells[i].view);
+	for (i = 0; i < shards; i++)
+		ac_automata_release (&aca[i]);
+
+	if (timeit)
+		printf("\nTotal time taken - %d milliseconds\n",
+			(int) ((omp_get_wtime() - start) * 1000));
+
+	return 0;
 }
 
 
 void print_usage (const char *exec_file)
 {
-    printf("Usage: %s [-vt] -P pattern_file file1\n", exec_file);
+    printf("Usage: %s [-vtiw] [-n threads] [-g shards,chunks] [-f bin|tsv|jsonl] -P pattern_file file1 (plain, .gz or .zst)\n", exec_file);
 }
 
 
 int match_handler(MATCH * m, int automata_num, int thread_num)
 {
-	if (verbosity) {
+	struct cell *c = &cells[thread_num];
+	unsigned long position = c->base + m->position;
+
+	/* Matches around the chunk belong to the neighbouring cells */
+	if (position <= c->from || position > c->to)
+		return 0;
+
+	m->position = position;
+
+	if (formatted)
+		ac_output_match(&writers[thread_num], m);
+	else if (verbosity) {
 		unsigned int j;
 
 		printf ("@ Thread %ld Automata %ld position %ld string(s) ", thread_num, automata_num, m->position);
 
 		for (j=0; j < m->match_num; j++)
-			printf("%ld (%s), ", m->matched_strings[j].id, m->matched_strings[j].str);
-		
+			printf("%ld (%.*s), ", m->matched_strings[j].id,
+				(int) m->matched_strings[j].length, m->matched_strings[j].str);
+
 		printf("matched\n");
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
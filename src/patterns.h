@@ -0,0 +1,74 @@
+/*
+	Pattern files of the drivers, shared by them.
+
+	A pattern file holds the number of patterns, then the patterns
+	separated by white space, usually one per line. A pattern longer
+	than AC_PATTRN_MAX_LENGTH is skipped with a warning, as a prefix of
+	it would be found where the pattern is not.
+*/
+
+#ifndef _PATTERNS_H_
+#define _PATTERNS_H_
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho_corasick.h"
+
+/* Read the patterns of 'filename'; their ids go on from 'first_id'.
+   Exits if the file cannot be read. */
+static STRING* read_patterns (const char *filename, unsigned int *no_of_patterns,
+		unsigned long first_id)
+{
+	unsigned int i, n = 0;
+	unsigned long length;
+	ALPHA *buffer = (ALPHA *) malloc((AC_PATTRN_MAX_LENGTH + 1) * sizeof(ALPHA));
+	STRING *patterns;
+	FILE *fp;
+	int c;
+
+	if (!(fp = fopen(filename, "r")) || fscanf(fp, "%u", no_of_patterns) != 1) {
+		fprintf(stderr, "Cannot read pattern file - %s\n", filename);
+		exit(1);
+	}
+
+	patterns = (STRING *) malloc(*no_of_patterns * sizeof(STRING));
+
+	for (i = 0; i < *no_of_patterns; i++) {
+		while ((c = getc(fp)) != EOF && isspace(c))
+			;
+		if (c == EOF)
+			break;
+
+		/* The whole word, whatever its length */
+		length = 0;
+		do {
+			if (length < AC_PATTRN_MAX_LENGTH)
+				buffer[length] = c;
+			length++;
+		} while ((c = getc(fp)) != EOF && !isspace(c));
+
+		if (length > AC_PATTRN_MAX_LENGTH) {
+			fprintf(stderr, "Skipping pattern %u of %s - longer than %d bytes\n",
+				i + 1, filename, AC_PATTRN_MAX_LENGTH);
+			continue;
+		}
+
+		patterns[n].length = length;
+		patterns[n].str = (ALPHA *) malloc(length + 1);
+		memcpy(patterns[n].str, buffer, length);
+		patterns[n].str[length] = '\0';
+		patterns[n].id = first_id + n;
+		n++;
+	}
+	*no_of_patterns = n;
+
+	fclose(fp);
+	free(buffer);
+
+	return patterns;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#!/bin/sh
+#
+# Run bin/bench over a fixed suite and compare it with the baseline
+# stored in data/perf/baseline; exit 1 when a case got slower than the
+# tolerance allows or found other matches. -u writes the baseline of
+# this machine instead, e.g.
+#
+#	sh src/perf_check.sh -u     (make perf-baseline)
+#	sh src/perf_check.sh        (make perf-check)
+#
+# The baseline is of the code it is committed with: a commit which
+# changes throughput on purpose records it again, and so does the last
+# commit of a series.
+#
+# A case gives the median search throughput and the median build time
+# (add + locate_failure) over REPEAT runs, and for each of them its noise,
+# (median - min) / median, which one slow run does not move. A case fails when
+#
+#	throughput drop  > TOLERANCE + baseline noise + current noise
+#	build increase   > BUILD_TOLERANCE + baseline noise + current noise
+#
+# in per cent; a build within 1 ms of the baseline is never slower. The
+# matches must be the same. A failing case is run once more and the better of the two
+# runs is kept, so a single hiccup of the machine does not fail it.
+#
+#	TOLERANCE BUILD_TOLERANCE     per cent (10, 20)
+#	REPEAT                        runs of bench per case (7)
+#	BASELINE                      file of the baseline
+#	BIN DATA WORK                 binaries, data, generated corpora
+
+BIN=${BIN:-bin}
+DATA=${DATA:-data}
+WORK=${WORK:-$BIN/perf}
+BASELINE=${BASELINE:-$DATA/perf/baseline}
+
+TOLERANCE=${TOLERANCE:-10}
+BUILD_TOLERANCE=${BUILD_TOLERANCE:-20}
+REPEAT=${REPEAT:-7}
+
+mkdir -p "$WORK" || exit 1
+
+"$BIN/corpus" -k random -n 10000 -l 4,12 -b 4M -S 1 -o "$WORK/random" || exit 1
+"$BIN/corpus" -k overlap -a 4 -l 4,32 -b 4M -S 1 -o "$WORK/overlap" || exit 1
+
+# The suite: name and options of bench
+suite () {
+	echo "wiki -c -P $DATA/patterns/wiki_pat $DATA/files/example2.txt"
+	echo "example2 -P $DATA/patterns/example2.pat $DATA/files/example2.txt"
+	echo "random -c -P $WORK/random.pat $WORK/random.txt"
+	echo "overlap -c -P $WORK/overlap.pat $WORK/overlap.txt"
+	echo "longest -c -s longest -P $DATA/patterns/wiki_pat $DATA/files/example2.txt"
+}
+
+# measure name options: prints
+#	name matches mb_per_s noise% build_ms noise%
+measure () {
+	name=$1
+	shift
+	"$BIN/bench" -r "$REPEAT" "$@" | awk -v name="$name" '
+		/"matches":/ { matches = $2 + 0 }
+		/"search":/ { median = $4 + 0; noise = median > 0 ? (median - $8) / median : 0 }
+		/"(add|locate_failure)":/ { build += $4; low += $8 }
+		/"search_mb_per_s":/ { throughput = $2 + 0 }
+		END {
+			if (matches == "")
+				exit 1
+			printf "%s %d %.2f %.1f %.3f %.1f\n", name, matches, throughput,
+				100 * noise, build, (build > 0 ? 100 * (build - low) / build : 0)
+		}' || { echo "$name: bench failed" >&2; exit 1; }
+}
+
+# compare baseline_line current_line: prints the rows of the case and
+# exits 1 when it fails
+compare () {
+	echo "$1 $2" | awk -v tolerance="$TOLERANCE" -v build_tolerance="$BUILD_TOLERANCE" '{
+		status = 0
+		if ($2 != $8) {
+			printf "%-10s %-16s %12s %12s %9s %8s  FAIL\n", $1, "matches", $2, $8, "", ""
+			status = 1
+		}
+		change = $3 > 0 ? 100 * ($9 - $3) / $3 : 0
+		limit = tolerance + $4 + $10
+		printf "%-10s %-16s %12.2f %12.2f %+8.1f%% %7.1f%%  %s\n", $1, "search MB/s",
+			$3, $9, change, -limit, (change < -limit ? "FAIL" : "ok")
+		if (change < -limit)
+			status = 1
+		change = $5 > 0 ? 100 * ($11 - $5) / $5 : 0
+		limit = build_tolerance + $6 + $12
+		slower = change > limit && $11 - $5 > 1
+		printf "%-10s %-16s %12.3f %12.3f %+8.1f%% %+7.1f%%  %s\n", $1, "build ms",
+			$5, $11, change, limit, (slower ? "FAIL" : "ok")
+		if (slower)
+			status = 1
+		exit status
+	}'
+}
+
+# better first second: the better throughput and build time of two runs
+better () {
+	echo "$1 $2" | awk '{
+		printf "%s %s %s %s %s %s\n", $1, $2,
+			($3 >= $9 ? $3 : $9), ($3 >= $9 ? $4 : $10),
+			($5 <= $11 ? $5 : $11), ($5 <= $11 ? $6 : $12)
+	}'
+}
+
+if [ "$1" = "-u" ]; then
+	mkdir -p "$(dirname "$BASELINE")" || exit 1
+	{
+		echo "# perf-check baseline, $(uname -m), $(date -u +%Y-%m-%d), REPEAT=$REPEAT"
+		echo "# name matches search_mb_per_s noise% build_ms noise%"
+		suite | while read -r name options; do
+			measure "$name" $options || exit 1
+		done
+	} > "$BASELINE.tmp" && mv "$BASELINE.tmp" "$BASELINE" || exit 1
+	cat "$BASELINE"
+	exit 0
+fi
+
+if [ ! -r "$BASELINE" ]; then
+	echo "No baseline - $BASELINE, make perf-baseline first" >&2
+	exit 1
+fi
+
+printf "%-10s %-16s %12s %12s %9s %8s\n" case metric baseline current change limit
+suite | {
+	failed=0
+	while read -r name options; do
+		base=$(awk -v name="$name" '$1 == name' "$BASELINE")
+		if [ -z "$base" ]; then
+			echo "$name: not in the baseline" >&2
+			failed=1
+			continue
+		fi
+		current=$(measure "$name" $options) || exit 1
+		if ! compare "$base" "$current" > "$WORK/rows"; then
+			again=$(measure "$name" $options) || exit 1
+			current=$(better "$current" "$again")
+			compare "$base" "$current" > "$WORK/rows" || failed=1
+		fi
+		cat "$WORK/rows"
+	done
+	if [ $failed = 1 ]; then
+		echo "perf-check: FAILED against $BASELINE"
+		exit 1
+	fi
+	echo "perf-check: ok"
+}
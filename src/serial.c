@@ -3,42 +3,114 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 
 #include "aho_corasick.h"
+#include "ac_output.h"
+#include "ac_pages.h"
+#include "ac_stream.h"
+#include "patterns.h"
 
-#define MAX_PATTERN_SIZE 128
 
 short verbosity = 0;
+short formatted = 0; /* Report matches with the writer below (-f) */
+short utf8 = 0; /* Input and patterns are UTF-8 (-u) */
+AC_OUTPUT writer;
 
-STRING read_file_to_search (const char *filename);
-STRING* read_patterns (const char *filename, unsigned int *no_of_patterns);
 void print_usage (const char *exec_file);
 int match_handler(MATCH * m, int automata_num, int thread_num);
 
 int main(int argc, char **argv)
 {
-	clock_t start = clock(), end, difference;
+	double start = omp_get_wtime(); /* Wall time; clock() sums all threads */
 	AC_AUTOMATA aca;
-	STRING *patterns, input_buffer;
-	unsigned int i, j, no_of_patterns;
-	int clopt;
+	AC_STREAM input;
+	STRING *patterns[AC_GROUP_MAX], input_buffer;
+	unsigned int i, j, no_of_patterns[AC_GROUP_MAX], total = 0;
+	int clopt, status;
 
 	/* Command line config*/
-	const char *pattern_file;
+	const char *pattern_file[AC_GROUP_MAX]; /* -P file of every group */
+	unsigned int no_of_groups = 0;
+	AC_GROUPS groups = AC_GROUPS_ALL;
+	char *list;
 	const char *input_file;
 	short timeit = 0;
+	short query = 0; /* 'c': count matches, 'e': check existence */
+	unsigned long hits = 0;
+	AC_OUTPUT_FORMAT format;
+	AC_FOLD fold = AC_FOLD_NONE;
+	unsigned int bound = 0; /* AC_BOUND_* flags of all patterns */
+	AC_SEMANTICS semantics = AC_SEMANTICS_OVERLAPPING;
+	AC_PAGES pages = AC_PAGES_DEFAULT; /* Of the automata and the input blocks (-p) */
 
 	if (argc < 4) {
 		print_usage(argv[0]);
 		exit(1);
 	}
 
-	while ((clopt = getopt(argc, argv, "P:vth?")) != -1) {
+	while ((clopt = getopt(argc, argv, "P:G:f:s:p:icewuvth?")) != -1) {
 		switch (clopt) {
 			case 'P':
-				pattern_file = optarg;
+				if (no_of_groups == AC_GROUP_MAX) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				pattern_file[no_of_groups++] = optarg;
+				break;
+			case 'G':
+				/* Comma separated groups, numbered by the order of -P */
+				for (groups = 0, list = optarg; ; list++) {
+					groups |= AC_GROUP(strtoul(list, &list, 10) % AC_GROUP_MAX);
+					if (*list != ',')
+						break;
+				}
+				if (*list) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'f':
+				if (ac_output_parse_format(optarg, &format)) {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				formatted = 1;
+				break;
+			case 'c':
+			case 'e':
+				query = clopt;
+				break;
+			case 'i':
+				fold = AC_FOLD_LATIN1;
+				break;
+			case 'w':
+				bound = AC_BOUND_WORD;
+				break;
+			case 'u':
+				utf8 = 1;
+				break;
+			case 's':
+				if (!strcmp(optarg, "longest"))
+					semantics = AC_SEMANTICS_LEFTMOST_LONGEST;
+				else if (!strcmp(optarg, "first"))
+					semantics = AC_SEMANTICS_LEFTMOST_FIRST;
+				else {
+					print_usage(argv[0]);
+					exit(1);
+				}
+				break;
+			case 'p':
+				if (!strcmp(optarg, "packed"))
+					pages = AC_PAGES_PACKED;
+				else if (!strcmp(optarg, "huge"))
+					pages = AC_PAGES_HUGE;
+				else if (!strcmp(optarg, "hugetlb"))
+					pages = AC_PAGES_HUGETLB;
+				else {
+					print_usage(argv[0]);
+					exit(1);
+				}
 				break;
 			case 'v':
 				verbosity = 1;
@@ -55,117 +127,122 @@ int main(int argc, char **argv)
 	}
 	input_file = *(argv + optind);
 
-	if (verbosity)
-		printf("Loading patterns from file - %s\n", pattern_file);
-	
-	patterns =  read_patterns (pattern_file, &no_of_patterns);
+	/* Every pattern file is a group of its own; ids go on across files */
+	for (i = 0; i < no_of_groups; i++) {
+		if (verbosity)
+			printf("Loading patterns from file - %s\n", pattern_file[i]);
+
+		patterns[i] = read_patterns (pattern_file[i], &no_of_patterns[i], total + 1);
+		total += no_of_patterns[i];
+	}
 
 	if (verbosity)
 		printf("Initialising automata\n");
 
 	ac_automata_init (&aca, match_handler);
+	ac_automata_set_fold (&aca, (utf8 && fold) ? AC_FOLD_UTF8 : fold);
+	ac_automata_set_codepoints (&aca, utf8);
+	ac_automata_set_semantics (&aca, semantics);
+	ac_automata_select_groups (&aca, groups);
+	ac_automata_set_pages (&aca, pages);
 
 	if (verbosity)
 		printf("Adding strings\n");
 
-	for (i = 0; i < no_of_patterns; i++)
-		ac_automata_add_string(&aca, &patterns[i]);
-
-	input_buffer = read_file_to_search(input_file);
+	for (i = 0; i < no_of_groups; i++)
+		for (j = 0; j < no_of_patterns[i]; j++)
+			ac_automata_add_string_group(&aca, &patterns[i][j], i, bound);
 
 	if (verbosity)
 		printf("Locating failure nodes\n");
 
 	ac_automata_locate_failure (&aca);
 
+	if (formatted)
+		ac_output_init(&writer, STDOUT_FILENO, format, NULL);
+
+	if (ac_stream_open_ex(&input, input_file, pages)) {
+		fprintf(stderr, "Cannot read input file - %s\n", input_file);
+		exit(1);
+	}
+
 	if (verbosity)
 		printf("Searching\n");
+	/* The writer bypasses stdio; what it buffered goes first */
+	fflush(stdout);
+
+	/* Compressed inputs are decompressed on the stream's own thread
+	   while we search the blocks already read */
+	while ((status = ac_stream_next(&input, &input_buffer)) > 0) {
+		if (query == 'c')
+			hits += ac_automata_count(&aca, &input_buffer);
+		else if (query == 'e') {
+			if ((hits = ac_automata_exists(&aca, &input_buffer)))
+				break;
+		}
+		else
+			ac_automata_search(&aca, &input_buffer, 0, 0);
+	}
+	if (status < 0) {
+		fprintf(stderr, "Cannot read input file - %s\n", input_file);
+		exit(1);
+	}
 
-	ac_automata_search(&aca, &input_buffer, 0, 0);
+	/* An empty block tells the automata that the input has ended,
+	   so that a -w or -s match at the very end is reported */
+	input_buffer.length = 0;
+	if (query == 'c')
+		hits += ac_automata_count(&aca, &input_buffer);
+	else if (query == 'e')
+		hits = hits || ac_automata_exists(&aca, &input_buffer);
+	else
+		ac_automata_search(&aca, &input_buffer, 0, 0);
+
+	ac_stream_close(&input);
+
+	if (query == 'c')
+		printf("%lu\n", hits);
+	else if (query == 'e')
+		printf("%s\n", hits ? "yes" : "no");
+
+	if (formatted)
+		ac_output_release(&writer);
 	
 	if (verbosity)
 		printf("Freeing resources\n");
 
 	ac_automata_release (&aca);
 
-	if (timeit) {
-		int msec;
-		end = clock();
-		difference = end - start;
-		msec = difference * 1000 / CLOCKS_PER_SEC;
-		printf("\nTotal time taken - %d milliseconds\n", msec);
-	}
+	if (timeit)
+		printf("\nTotal time taken - %d milliseconds\n",
+			(int) ((omp_get_wtime() - start) * 1000));
 
 	return 0;
 }
 
 
-STRING read_file_to_search (const char *filename)
-{
-	STRING buffer;
-	FILE *fp;
-
-	fp = fopen(filename, "r");
-
-    fseek(fp, 0, SEEK_END);
-    buffer.length = ftell(fp) + 1;
-    rewind(fp);
-
-    buffer.str = (ALPHA *) malloc((buffer.length) * sizeof(ALPHA));
-    fread(buffer.str, buffer.length - 1, 1, fp);
-    buffer.str[buffer.length - 1] = '\0';
-
-    fclose(fp);
-
-    return buffer;
-}
-
-
-STRING* read_patterns (const char *filename, unsigned int *no_of_patterns)
-{
-	unsigned int i, j, chunk;
-	ALPHA *buffer = (ALPHA *) malloc(MAX_PATTERN_SIZE * sizeof(char));
-	STRING *patterns;
-	FILE *fp;
-
-	fp = fopen(filename, "r");
-
-	fscanf(fp, "%u\n", no_of_patterns);
-	patterns = (STRING *) malloc(*no_of_patterns * sizeof(STRING));
-
-	for(i = 0; i < *no_of_patterns; i++) {
-		
-		if (fscanf(fp, "%s\n", buffer) == -1)
-			break;
-			
-		patterns[i].str = (ALPHA *) malloc((strlen(buffer)+1) * sizeof(ALPHA));
-			
-		strcpy(patterns[i].str, buffer);
-		patterns[i].length = strlen(buffer);
-		patterns[i].id = i + 1;
-	}
-
-	fclose(fp);
-
-	return patterns;
-}
-
 
 void print_usage (const char *exec_file)
 {
-    printf("Usage: %s [-vt] -P pattern_file file1\n", exec_file);
+    printf("Usage: %s [-vtiwu] [-s longest|first] [-p packed|huge|hugetlb] [-c | -e | -f bin|tsv|jsonl] [-G group,...] -P pattern_file [-P pattern_file ...] file1 (plain, .gz or .zst)\n", exec_file);
 }
 
 
 int match_handler(MATCH * m, int automata_num, int thread_num)
 {
-	if (verbosity) {
+	if (formatted)
+		ac_output_match(&writer, m);
+	else if (verbosity) {
 		unsigned int j;
 
-		printf ("@ Thread %ld Automata %ld position %ld string(s) ", thread_num, automata_num, m->position);
+		printf ("@ Thread %ld Automata %ld position %ld ", thread_num, automata_num, m->position);
+		if (utf8)
+			printf ("(code point %lu) ", m->cp_position);
+		printf ("string(s) ");
 
 		for (j=0; j < m->match_num; j++)
-			printf("%ld (%s), ", m->matched_strings[j].id, m->matched_strings[j].str);
+			printf("%ld (%.*s), ", m->matched_strings[j].id,
+				(int) m->matched_strings[j].length, m->matched_strings[j].str);
 		
 		printf("matched\n");
 	}
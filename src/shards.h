@@ -0,0 +1,177 @@
+/*
+	The grid of parallel, shared with fuzz: pattern shards of about the
+	same trie size times text chunks.
+
+	count_nodes() sorts the patterns on their folded form and cuts them
+	into shards; fold-equal patterns always share a shard, the first of
+	them in file order (lowest id) first, so that the automata keeps the
+	one serial keeps. plan_grid() chooses the number of shards and chunks.
+*/
+
+#ifndef _SHARDS_H_
+#define _SHARDS_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aho_corasick.h"
+
+/* Cache an automata should fit in when sysconf() does not know it */
+#define DEFAULT_CACHE_SIZE (1 << 20)
+
+/* Smallest part of the input worth a thread of its own */
+#define MIN_CHUNK_SIZE (64 << 10)
+
+/* A pattern and its folded form, the key of the sort */
+struct sort_key
+{
+	STRING pattern;
+	ALPHA *folded;
+};
+
+/* Folded alphas, then length; ids are in file order, and of duplicate
+   patterns the first one is the one the automata keeps */
+static int pattern_compare (const void *l, const void *r)
+{
+	const struct sort_key *a = (const struct sort_key *) l, *b = (const struct sort_key *) r;
+	int c = memcmp(a->folded, b->folded, a->pattern.length < b->pattern.length ?
+		a->pattern.length : b->pattern.length);
+
+	if (c)
+		return c;
+	if (a->pattern.length != b->pattern.length)
+		return a->pattern.length > b->pattern.length ? 1 : -1;
+	return (a->pattern.id > b->pattern.id) - (a->pattern.id < b->pattern.id);
+}
+
+
+/* Sort the patterns and count the nodes of their trie: in sorted order
+   a pattern adds a node for every alpha after its common prefix with the
+   previous one. Both are taken on the patterns folded as the automata
+   adds them. With 'shard_of' holding the number of shards, cut the
+   sorted patterns into shards of about the same number of nodes, so that
+   patterns sharing a prefix mostly end up in the same shard; duplicates,
+   case variants included, always do. */
+static unsigned long count_nodes (STRING *patterns, unsigned int no_of_patterns, AC_FOLD fold,
+		unsigned int *shard_of)
+{
+	unsigned long nodes = 1, added = 0, total, k;
+	unsigned int i, shards = 0, shard = 0;
+	AC_OFFSET common, longest = 1;
+	struct sort_key *keys;
+	ALPHA *folded, *previous, *swap;
+
+	for (i = 0; i < no_of_patterns; i++)
+		if (patterns[i].length > longest)
+			longest = patterns[i].length;
+
+	if (!shard_of) {
+		keys = (struct sort_key *) malloc((no_of_patterns + 1) * sizeof(struct sort_key));
+		for (i = 0; i < no_of_patterns; i++) {
+			keys[i].pattern = patterns[i];
+			keys[i].folded = (ALPHA *) malloc(patterns[i].length + 1);
+			ac_automata_fold_string(fold, &patterns[i], keys[i].folded);
+		}
+		qsort(keys, no_of_patterns, sizeof(struct sort_key), pattern_compare);
+		for (i = 0; i < no_of_patterns; i++) {
+			patterns[i] = keys[i].pattern;
+			free(keys[i].folded);
+		}
+		free(keys);
+	}
+	else {
+		shards = shard_of[0];
+		total = count_nodes(patterns, no_of_patterns, fold, NULL);
+	}
+
+	folded = (ALPHA *) malloc(longest);
+	previous = (ALPHA *) malloc(longest);
+
+	for (i = 0; i < no_of_patterns; i++) {
+		ac_automata_fold_string(fold, &patterns[i], folded);
+
+		common = 0;
+		if (i)
+			while (common < patterns[i].length && common < patterns[i-1].length &&
+					folded[common] == previous[common])
+				common++;
+
+		k = patterns[i].length - common;
+
+		/* The next shard starts when this one has its share; it has a
+		   trie of its own, so the common prefix is added again */
+		if (shard_of && shard + 1 < shards && added * shards >= (total - 1) * (shard + 1) &&
+				i && (k || common < patterns[i-1].length)) {
+			shard++;
+			k = patterns[i].length;
+		}
+		if (shard_of)
+			shard_of[i] = shard;
+
+		nodes += k;
+		added += k;
+
+		swap = previous;
+		previous = folded;
+		folded = swap;
+	}
+
+	free(folded);
+	free(previous);
+
+	return nodes;
+}
+
+
+/* Bytes of a node of the trie with its initial edge array; matched
+   strings are kept in the pattern table and output pool of the automata */
+static unsigned long node_bytes (void)
+{
+	return sizeof(NODE) + 8 * sizeof(struct edge) + sizeof(NODE *);
+}
+
+
+/* Cache of one core: L2 if known, else L3, else DEFAULT_CACHE_SIZE */
+static unsigned long cache_size (void)
+{
+	long size = -1;
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL3_CACHE_SIZE
+	if (size <= 0)
+		size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+
+	return size > 0 ? size : DEFAULT_CACHE_SIZE;
+}
+
+
+/* Choose the grid: enough pattern shards for each automata to fit in
+   'cache' (but no more than there are threads), then split the text
+   among the remaining threads, keeping chunks of MIN_CHUNK_SIZE */
+static void plan_grid (unsigned long nodes, unsigned long input_size, unsigned int threads,
+		unsigned int no_of_patterns, unsigned long cache, unsigned int *shards,
+		unsigned int *chunks)
+{
+	unsigned long bytes = nodes * node_bytes(), limit;
+
+	*shards = (bytes + cache - 1) / cache;
+	if (*shards > threads)
+		*shards = threads;
+	if (*shards > no_of_patterns)
+		*shards = no_of_patterns;
+	if (!*shards)
+		*shards = 1;
+
+	*chunks = threads / *shards;
+	limit = input_size / MIN_CHUNK_SIZE;
+	if (*chunks > limit)
+		*chunks = limit;
+	if (!*chunks)
+		*chunks = 1;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+	Search with an automata compiled at build time: the tables of
+	example2_ac.h are generated by acgen from data/patterns/example2.pat
+	(see Makefile), so nothing is built when the program starts.
+
+	usage: static_example [-c] input_file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ac_stream.h"
+#include "example2_ac.h"
+
+int match_handler(MATCH * m, int automata_num, int thread_num)
+{
+	unsigned int j;
+
+	printf ("@ Thread %d Automata %d position %ld string(s) ", thread_num,
+		automata_num, m->position);
+
+	for (j=0; j < m->match_num; j++)
+		printf("%ld (%.*s), ", (long) m->matched_strings[j].id,
+			(int) m->matched_strings[j].length, m->matched_strings[j].str);
+
+	printf("matched\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	AC_STATIC_CURSOR cursor = AC_STATIC_CURSOR_INIT;
+	AC_STREAM input;
+	STRING block;
+	unsigned long hits = 0;
+	int count = 0, clopt, status;
+
+	while ((clopt = getopt(argc, argv, "ch?")) != -1) {
+		if (clopt != 'c') {
+			fprintf(stderr, "Usage : %s [-c] input_file\n", argv[0]);
+			exit(1);
+		}
+		count = 1;
+	}
+
+	if (optind >= argc || ac_stream_open(&input, argv[optind])) {
+		fprintf(stderr, "Usage : %s [-c] input_file\n", argv[0]);
+		exit(1);
+	}
+
+	while ((status = ac_stream_next(&input, &block)) > 0) {
+		if (count)
+			hits += example2_count(&cursor, block.str, block.length);
+		else
+			example2_search(&cursor, block.str, block.length, match_handler, 0, 0);
+	}
+	if (status < 0) {
+		fprintf(stderr, "Cannot read input file - %s\n", argv[optind]);
+		exit(1);
+	}
+
+	ac_stream_close(&input);
+
+	if (count)
+		printf("%lu\n", hits);
+
+	return 0;
+}
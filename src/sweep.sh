@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# Run bin/bench over generated corpora (bin/corpus), varying one axis at
+# a time around a base point: kind, pattern count, pattern length,
+# alphabet size and match density. Every run prints one JSON line with
+# the corpus parameters and the output of bench, e.g.
+#
+#	sh src/sweep.sh > sweep.jsonl
+#
+# The axes, the base point and the run are set from the environment:
+#
+#	KINDS LENGTHS COUNTS ALPHABETS DENSITIES   values of each axis
+#	KIND LENGTH COUNT ALPHABET DENSITY         base point
+#	BYTES SEED REPEAT                          input size, seed, runs
+#	BENCH_FLAGS                                more options of bench (-c)
+#	ENGINES=1                                  also run engine_bench; its
+#	                                           dense table takes 1 KB per
+#	                                           state, mind large sets
+#	BIN WORK                                   binaries, generated files
+
+BIN=${BIN:-bin}
+WORK=${WORK:-$BIN/sweep}
+
+KINDS=${KINDS:-"random prefix overlap"}
+COUNTS=${COUNTS:-"10 100 1000 10000 100000"}
+LENGTHS=${LENGTHS:-"2,4 4,8 8,16 16,32 64,128 200,256"}
+ALPHABETS=${ALPHABETS:-"2 4 26 94"}
+DENSITIES=${DENSITIES:-"0 0.001 0.01 0.1"}
+
+KIND=${KIND:-random}
+COUNT=${COUNT:-1000}
+LENGTH=${LENGTH:-8,16}
+ALPHABET=${ALPHABET:-26}
+DENSITY=${DENSITY:-0.01}
+
+BYTES=${BYTES:-4M}
+SEED=${SEED:-1}
+REPEAT=${REPEAT:-5}
+
+mkdir -p "$WORK" || exit 1
+
+# run axis kind count length alphabet density
+run () {
+	case $2 in
+		prefix) [ "${4%%,*}" -ge 2 ] || return 0 ;;
+	esac
+
+	"$BIN/corpus" -k "$2" -n "$3" -l "$4" -a "$5" -d "$6" -b "$BYTES" \
+		-S "$SEED" -o "$WORK/corpus" || exit 1
+
+	printf '{"axis": "%s", "kind": "%s", "count": %s, "length": "%s", "alphabet": %s, "density": %s, "seed": %s, "bench": ' \
+		"$1" "$2" "$3" "$4" "$5" "$6" "$SEED"
+	"$BIN/bench" $BENCH_FLAGS -r "$REPEAT" -P "$WORK/corpus.pat" \
+		"$WORK/corpus.txt" | tr -d '\n' || exit 1
+
+	if [ "${ENGINES:-0}" = 1 ]; then
+		printf ', "engines_ms": {'
+		"$BIN/engine_bench" -r "$REPEAT" -P "$WORK/corpus.pat" "$WORK/corpus.txt" |
+			awk '/ matches / { name = substr($0, 1, 28); sub(/ +$/, "", name);
+				printf "%s\"%s\": %s", n++ ? ", " : "", name, $(NF - 3) }'
+		printf '}'
+	fi
+
+	printf '}\n'
+}
+
+for v in $KINDS; do run kind "$v" "$COUNT" "$LENGTH" "$ALPHABET" "$DENSITY"; done
+for v in $COUNTS; do run count "$KIND" "$v" "$LENGTH" "$ALPHABET" "$DENSITY"; done
+for v in $LENGTHS; do run length "$KIND" "$COUNT" "$v" "$ALPHABET" "$DENSITY"; done
+for v in $ALPHABETS; do run alphabet "$KIND" "$COUNT" "$LENGTH" "$v" "$DENSITY"; done
+for v in $DENSITIES; do run density "$KIND" "$COUNT" "$LENGTH" "$ALPHABET" "$v"; done
@@ -0,0 +1,84 @@
+/*
+	Tables of acgen, shared with fuzz: the full transition table of a
+	located automata and the matched strings of every state, as
+	ac_static.h searches them.
+*/
+
+#ifndef _TABLES_H_
+#define _TABLES_H_
+
+#include <stdlib.h>
+
+#include "aho_corasick.h"
+
+struct tables
+{
+	unsigned long states;
+	unsigned long *delta; /* [states][256] */
+	unsigned long *out_begin; /* [states + 1]: the range of 'out' of a state */
+	AC_INDEX *out; /* Indices in the pattern table of the automata */
+	unsigned long out_num;
+};
+
+/* Fill the tables of a located automata. The row of a state is the row
+   of its failure node with its own edges on top; rows are filled in BFS
+   order so the row of the failure node is complete when it is copied */
+static void build_tables (AC_AUTOMATA * aca, struct tables * t)
+{
+	unsigned long head, tail, a, k, j;
+	NODE **queue, *node, *next;
+	char *seen;
+	AC_COUNT e;
+
+	t->states = aca->all_nodes_num;
+	t->delta = (unsigned long *) calloc(t->states * 256, sizeof(unsigned long));
+	queue = (NODE **) malloc(t->states * sizeof(NODE *));
+	seen = (char *) calloc(t->states, 1);
+
+	queue[0] = aca->root;
+	seen[aca->root->id] = 1;
+
+	for (head = 0, tail = 1; head < tail; head++) {
+		node = queue[head];
+
+		if (node->failure_node)
+			for (a = 0; a < 256; a++)
+				t->delta[node->id * 256 + a] = t->delta[node->failure_node->id * 256 + a];
+
+		for (e = 0; e < node->outgoing_degree; e++) {
+			next = node->outgoing[e].next;
+			t->delta[node->id * 256 + (unsigned char) node->outgoing[e].alpha] = next->id;
+			if (!seen[next->id]) {
+				seen[next->id] = 1;
+				queue[tail++] = next;
+			}
+		}
+	}
+
+	free(queue);
+	free(seen);
+
+	/* Matched strings of every state, as AC_AUTOMATA keeps them */
+	t->out_begin = (unsigned long *) malloc((t->states + 1) * sizeof(unsigned long));
+	for (k = 0, t->out_num = 0; k < t->states; k++) {
+		t->out_begin[k] = t->out_num;
+		t->out_num += aca->all_nodes[k]->outputs_num;
+	}
+	t->out_begin[t->states] = t->out_num;
+
+	t->out = (AC_INDEX *) malloc((t->out_num + 1) * sizeof(AC_INDEX));
+	for (k = 0; k < t->states; k++) {
+		node = aca->all_nodes[k];
+		for (j = 0; j < node->outputs_num; j++)
+			t->out[t->out_begin[k] + j] = aca->output_ids[node->outputs + j];
+	}
+}
+
+static void release_tables (struct tables * t)
+{
+	free(t->delta);
+	free(t->out_begin);
+	free(t->out);
+}
+
+#endif